@@ -0,0 +1,228 @@
+#include "atom.h"
+#include "err.h"
+#include "mem.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * the spellings are stored in a memory pool, and found with an open addressing
+ * hash table of atoms, which is kept at most half full
+ */
+
+#define ATOM_POOL_BLOCK_SIZE (64 * 1024)
+#define ATOM_MIN_SLOTS       1024
+
+typedef struct atom_entry
+{
+    const char *str;
+    uint32_t    len;
+
+    /* kept so the table can grow without hashing the spellings again */
+    uint32_t hash;
+
+} atom_entry_t;
+
+#define VEC_TYPE atom_entry_t
+#include "templates/vec.h"
+#undef VEC_TYPE
+
+typedef struct atom_table
+{
+    bool initialized;
+
+    mem_pool_t         pool;
+    vec_atom_entry_t   entries;
+
+    /* 0 is an empty slot, since ATOM_NULL is never stored */
+    uint32_t *slots;
+    uint32_t  slot_mask;
+
+} atom_table_t;
+
+static atom_table_t table;
+
+
+static void
+create_table(void)
+{
+    atom_entry_t null_entry = { "", 0, 0 };
+
+    table.pool    = mem_pool_create(ATOM_POOL_BLOCK_SIZE);
+    table.entries = vec_atom_entry_t_create(ATOM_MIN_SLOTS / 2);
+
+    table.slots     = calloc(ATOM_MIN_SLOTS, sizeof(uint32_t));
+    table.slot_mask = ATOM_MIN_SLOTS - 1;
+
+    if (!table.slots)
+    {
+        fatal_error("out of memory");
+    }
+
+    /* ATOM_NULL points to an empty string */
+    vec_atom_entry_t_push(&table.entries, null_entry);
+
+    table.initialized = true;
+}
+
+/* doubles the number of slots, and inserts every atom again */
+static void
+grow_table(void)
+{
+    uint32_t  slot_count = (table.slot_mask + 1) * 2;
+    uint32_t *slots      = calloc(slot_count, sizeof(uint32_t));
+    uint32_t  atom;
+    uint32_t  slot;
+
+    if (!slots)
+    {
+        fatal_error("out of memory");
+    }
+
+    for (atom = 1; atom < table.entries.size; ++atom)
+    {
+        slot = table.entries.data[atom].hash & (slot_count - 1);
+
+        while (slots[slot])
+        {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+
+        slots[slot] = atom;
+    }
+
+    c_free(table.slots);
+
+    table.slots     = slots;
+    table.slot_mask = slot_count - 1;
+}
+
+
+uint32_t
+atom_hash(const char *str, uint32_t len)
+{
+    uint64_t h = ATOM_HASH_SEED;
+    uint64_t word;
+    uint32_t i;
+
+    for (i = 0; i + 8 <= len; i += 8)
+    {
+        memcpy(&word, str + i, 8);
+        h = atom_hash_word(h, word);
+    }
+
+    if (i < len)
+    {
+        word = 0;
+        memcpy(&word, str + i, len - i);
+        h = atom_hash_word(h, word);
+    }
+
+    return atom_hash_finish(h, len);
+}
+
+
+atom_t
+atom_intern(const char *str, uint32_t len)
+{
+    return atom_intern_hashed(str, len, atom_hash(str, len));
+}
+
+
+atom_t
+atom_intern_hashed(const char *str, uint32_t len, uint32_t hash)
+{
+    atom_entry_t entry;
+    uint32_t     slot;
+    atom_t       atom;
+    char *       spelling;
+
+    if (!table.initialized)
+    {
+        create_table();
+    }
+
+    slot = hash & table.slot_mask;
+
+    while ((atom = table.slots[slot]))
+    {
+        entry = table.entries.data[atom];
+
+        if (entry.hash == hash && entry.len == len && memcmp(entry.str, str, len) == 0)
+        {
+            return atom;
+        }
+
+        slot = (slot + 1) & table.slot_mask;
+    }
+
+    if (len >= ATOM_POOL_BLOCK_SIZE)
+    {
+        fatal_error("identifier is longer than %u bytes", ATOM_POOL_BLOCK_SIZE - 1);
+    }
+
+    /* a new spelling, which is copied into the pool */
+    spelling = mem_pool_alloc(&table.pool, len + 1);
+    memcpy(spelling, str, len);
+    spelling[len] = '\0';
+
+    entry.str  = spelling;
+    entry.len  = len;
+    entry.hash = hash;
+
+    atom = table.entries.size;
+
+    vec_atom_entry_t_push(&table.entries, entry);
+    table.slots[slot] = atom;
+
+    if (table.entries.size * 2 > table.slot_mask + 1)
+    {
+        grow_table();
+    }
+
+    return atom;
+}
+
+
+const char *
+atom_str(atom_t atom)
+{
+    assert(table.initialized && atom < table.entries.size);
+
+    return table.entries.data[atom].str;
+}
+
+
+uint32_t
+atom_len(atom_t atom)
+{
+    assert(table.initialized && atom < table.entries.size);
+
+    return table.entries.data[atom].len;
+}
+
+
+uint32_t
+atom_count(void)
+{
+    return table.initialized ? table.entries.size : 1;
+}
+
+
+void
+atom_destroy_table(void)
+{
+    if (!table.initialized)
+    {
+        return;
+    }
+
+    mem_pool_destroy(&table.pool);
+    vec_atom_entry_t_destroy(&table.entries);
+    c_free(table.slots);
+
+    table.slots       = NULL;
+    table.initialized = false;
+}
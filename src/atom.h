@@ -0,0 +1,52 @@
+#ifndef _ATOM_
+#define _ATOM_
+
+#include <stdint.h>
+
+/*
+ * interns identifiers, every spelling is stored once and given a dense id
+ * starting from 1, so two identifiers are the same if their atoms are equal,
+ * and atoms can be used directly as indices into side tables
+ */
+
+typedef uint32_t atom_t;
+
+/* never returned by atom_intern, used for anonymous names */
+#define ATOM_NULL 0
+
+/*
+ * the hash works on 8 bytes at a time, so the lexer can compute it while it
+ * scans an identifier, the last word is zero padded
+ */
+#define ATOM_HASH_SEED 525201411107845655ull
+
+static inline uint64_t
+atom_hash_word(uint64_t h, uint64_t word)
+{
+    h = (h ^ word) * 0x5bd1e9955bd1e995ull;
+    return h ^ (h >> 47);
+}
+
+static inline uint32_t
+atom_hash_finish(uint64_t h, uint32_t len)
+{
+    h = (h ^ len) * 0x5bd1e9955bd1e995ull;
+    return h ^ (h >> 32);
+}
+
+uint32_t    atom_hash(const char *str, uint32_t len);
+atom_t      atom_intern(const char *str, uint32_t len);
+
+/* same as atom_intern, when the hash is already known */
+atom_t      atom_intern_hashed(const char *str, uint32_t len, uint32_t hash);
+
+const char *atom_str(atom_t atom);
+uint32_t    atom_len(atom_t atom);
+
+/* one more than the largest atom, the size a table indexed by atom needs */
+uint32_t    atom_count(void);
+
+/* frees every spelling, all atoms are invalid after this */
+void        atom_destroy_table(void);
+
+#endif
@@ -1,11 +1,40 @@
 #include "err.h"
+#include "source.h"
 
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-/* just prints the error message and exits the program */
+static _Thread_local err_trap_t *trap;
+
+static uint32_t warning_count;
+
 void
+err_set_trap(err_trap_t *new_trap)
+{
+	trap = new_trap;
+}
+
+/* prints the file, line and column of a location */
+static void
+print_location(err_location_t loc)
+{
+	uint32_t line = 0;
+	uint32_t col  = 0;
+
+	if (!loc.source)
+	{
+		printf("(null): 0, 0: ");
+		return;
+	}
+
+	source_location(loc.source, loc.offset, &line, &col);
+
+	printf("%s: %u, %u: ", loc.source->filename, line, col);
+}
+
+/* just prints the error message and exits the program */
+_Noreturn void
 fatal_error(const char *fmt, ...)
 {
 	va_list args;
@@ -23,17 +52,24 @@ fatal_error(const char *fmt, ...)
 }
 
 /* prints the error and a code location and exits the program*/
-void
+_Noreturn void
 syntax_error(err_location_t loc, const char *fmt, ...)
 {
 	va_list args;
+
+	if (trap)
+	{
+		++trap->count;
+		longjmp(trap->env, 1);
+	}
+
 	va_start(args, fmt);
 
-	printf("%s: %u, %u: "
-		   "\x1B[31m"
+	print_location(loc);
+
+	printf("\x1B[31m"
 		   "[Syntax Error]: "
-		   "\x1B[0m",
-		   loc.filename, loc.line, loc.col);
+		   "\x1B[0m");
 
 	vprintf(fmt, args);
 
@@ -47,17 +83,30 @@ void
 syntax_warning(err_location_t loc, const char *fmt, ...)
 {
 	va_list args;
+
+	if (trap)
+	{
+		++trap->count;
+		return;
+	}
+
+	++warning_count;
+
 	va_start(args, fmt);
 
-	printf("%s: %u, %u: "
-		   "\x1B[33m"
+	print_location(loc);
+
+	printf("\x1B[33m"
 		   "[Warning]: "
-		   "\x1B[0m",
-		   loc.filename, loc.line, loc.col);
+		   "\x1B[0m");
 
 	vprintf(fmt, args);
 
 	printf("\n");
 }
 
-
+uint32_t
+err_warning_count(void)
+{
+	return warning_count;
+}
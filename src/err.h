@@ -1,25 +1,48 @@
 #ifndef ERR_H
 #define ERR_H
 
+#include <setjmp.h>
 #include <stdint.h>
 #include <stdint.h>
 
+struct source;
+
 /* Error handeling */
+/* only the byte offset is stored, the line and column are
+ * looked up in the source when an error is printed */
 typedef struct err_location
 {
-	char*						filename;
-	uint32_t					line;
-	uint32_t					col;
+	struct source*				source;
+	uint32_t					offset;
 }
 err_location_t;
 
+/* while a trap is set, the diagnostics of the thread are counted instead of
+ * printed, and syntax errors jump back to it instead of exiting. used to lex
+ * speculatively, where a diagnostic may not be real */
+typedef struct err_trap
+{
+	jmp_buf						env;
+	uint32_t					count;
+}
+err_trap_t;
+
+/* NULL removes the trap of the calling thread */
 void
+err_set_trap(err_trap_t *trap);
+
+/* neither returns, syntax_error jumps back to the trap if one is set */
+_Noreturn void
 fatal_error(const char *fmt, ...);
 
-void
+_Noreturn void
 syntax_error(err_location_t loc, const char *fmt, ...);
 
 void
 syntax_warning(err_location_t loc, const char *fmt, ...);
 
+/* the number of warnings printed so far */
+uint32_t
+err_warning_count(void);
+
 #endif
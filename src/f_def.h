@@ -3,7 +3,7 @@
 
 #include <stdint.h>
 
-#define MAX_SUFFIX_LEN 2
+#define MAX_SUFFIX_LEN 3
 
 typedef enum suffix_flags
 {
@@ -32,7 +32,10 @@ typedef struct literal
 	/* perhaps not the best way to represent the type of literal */
 	enum {
 		LITERAL_TYPE_INT,
+		LITERAL_TYPE_UINT,
 		LITERAL_TYPE_LONG,
+		LITERAL_TYPE_ULONG,
+		LITERAL_TYPE_FLOAT,
 		LITERAL_TYPE_DOUBLE,
 		LITERAL_TYPE_STR
 
@@ -0,0 +1,1407 @@
+#include "f_deps.h"
+
+#include "err.h"
+#include "mem.h"
+#include "scan.h"
+
+#include <limits.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* the directives which can change the dependencies, the others are skipped */
+typedef enum dep_kind
+{
+    DEP_INCLUDE,
+
+    /* #include NAME, which is followed if NAME is defined as a header name */
+    DEP_INCLUDE_MACRO,
+
+    DEP_DEFINE,
+    DEP_UNDEF,
+
+    /* #if, #ifdef and #ifndef */
+    DEP_IF,
+
+    /* #elif, #elifdef and #elifndef */
+    DEP_ELIF,
+
+    DEP_ELSE,
+    DEP_ENDIF,
+    DEP_ONCE,
+
+} dep_kind_t;
+
+/* the conditions which are known without the values of macros,
+ * FALSE, TRUE and UNKNOWN are also what they evaluate to */
+typedef enum dep_condition
+{
+    DEP_COND_FALSE,
+    DEP_COND_TRUE,
+    DEP_COND_UNKNOWN,
+    DEP_COND_DEFINED,
+    DEP_COND_NOT_DEFINED,
+
+} dep_condition_t;
+
+/* an #include which hasn't been looked for yet, or wasn't found */
+#define DEP_UNRESOLVED -1
+#define DEP_NOT_FOUND  -2
+
+typedef struct dep_directive
+{
+    uint8_t kind;
+    uint8_t condition;
+
+    /* the header name is <name> and not "name" */
+    bool angled;
+    bool warned;
+
+    /* the macro, or the name of the included file */
+    atom_t name;
+
+    /* a #define of a header name, or ATOM_NULL */
+    atom_t value;
+
+    /* the index of the file an #include found, the directories searched
+     * never change, so it's only looked for once */
+    int32_t file;
+
+    uint32_t offset;
+
+} dep_directive_t;
+
+typedef struct dep_file
+{
+    atom_t    path;
+    source_t *source;
+
+    dev_t device;
+    ino_t inode;
+
+    dep_directive_t *directives;
+    uint32_t         directive_count;
+    bool             scanned;
+
+    /* the macro of the #ifndef around the whole file, or ATOM_NULL */
+    atom_t guard;
+
+    /* the last unit which listed the file, and which read a #pragma once in it */
+    uint32_t listed;
+    uint32_t once;
+
+    /* the file is being read, and including it again adds nothing */
+    bool active;
+
+} dep_file_t;
+
+typedef enum dep_state
+{
+    DEP_UNDEFINED,
+    DEP_DEFINED,
+
+    /* defined in a group which may not be taken, or a name an implementation
+     * may define itself */
+    DEP_MAYBE_DEFINED,
+
+} dep_state_t;
+
+typedef struct dep_macro
+{
+    uint32_t unit;
+    uint8_t  state;
+
+    /* the header name the macro is defined as, for #include NAME */
+    bool   angled;
+    atom_t value;
+
+} dep_macro_t;
+
+typedef enum dep_group
+{
+    DEP_GROUP_TAKEN,
+    DEP_GROUP_SKIPPED,
+    DEP_GROUP_MAYBE,
+
+} dep_group_t;
+
+typedef struct dep_conditional
+{
+    uint8_t group;
+
+    /* a group before has certainly been taken, or may have been */
+    bool done;
+    bool maybe;
+
+} dep_conditional_t;
+
+typedef struct dep_unit
+{
+    atom_t    path;
+    uint32_t *deps;
+    uint32_t  dep_count;
+
+} dep_unit_t;
+
+static const struct
+{
+    const char *name;
+    uint8_t     kind;
+    uint8_t     condition;
+
+} directive_names[] = {
+    { "include", DEP_INCLUDE, DEP_COND_UNKNOWN },
+    { "define", DEP_DEFINE, DEP_COND_UNKNOWN },
+    { "undef", DEP_UNDEF, DEP_COND_UNKNOWN },
+    { "if", DEP_IF, DEP_COND_UNKNOWN },
+    { "ifdef", DEP_IF, DEP_COND_DEFINED },
+    { "ifndef", DEP_IF, DEP_COND_NOT_DEFINED },
+    { "elif", DEP_ELIF, DEP_COND_UNKNOWN },
+    { "elifdef", DEP_ELIF, DEP_COND_DEFINED },
+    { "elifndef", DEP_ELIF, DEP_COND_NOT_DEFINED },
+    { "else", DEP_ELSE, DEP_COND_TRUE },
+    { "endif", DEP_ENDIF, DEP_COND_UNKNOWN },
+    { "pragma", DEP_ONCE, DEP_COND_UNKNOWN },
+};
+
+
+/* ================================================================================= */
+/* scanning */
+
+static inline bool
+is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r';
+}
+
+
+static inline bool
+is_ident_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'
+           || (unsigned char)c >= 0x80;
+}
+
+
+/* skips spaces and comments within a line, a block comment continues the line past
+ * its newlines, and a line comment is skipped to the newline */
+static const char *
+skip_blank(const char *ptr)
+{
+    for (;;)
+    {
+        while (is_blank(*ptr))
+        {
+            ++ptr;
+        }
+
+        if (ptr[0] == '/' && ptr[1] == '*')
+        {
+            ptr = scan_find_comment_end(ptr + 2);
+            ptr += *ptr ? 2 : 0;
+        }
+        else if (ptr[0] == '/' && ptr[1] == '/')
+        {
+            return scan_find_line_end(ptr + 2);
+        }
+        else
+        {
+            return ptr;
+        }
+    }
+}
+
+
+/* skips whitespace, newlines included, and comments */
+static const char *
+skip_space(const char *ptr)
+{
+    for (;;)
+    {
+        ptr = scan_skip_whitespace(ptr);
+
+        if (ptr[0] == '/' && ptr[1] == '*')
+        {
+            ptr = scan_find_comment_end(ptr + 2);
+            ptr += *ptr ? 2 : 0;
+        }
+        else if (ptr[0] == '/' && ptr[1] == '/')
+        {
+            ptr = scan_find_line_end(ptr + 2);
+        }
+        else
+        {
+            return ptr;
+        }
+    }
+}
+
+
+/* skips a string or character literal, which ends at the newline if it isn't closed */
+static const char *
+skip_quoted(const char *ptr)
+{
+    char quote = *ptr++;
+
+    while (*ptr != quote && *ptr != '\n' && *ptr != '\0')
+    {
+        ptr += ptr[0] == '\\' && ptr[1] != '\0' ? 2 : 1;
+    }
+
+    return *ptr == quote ? ptr + 1 : ptr;
+}
+
+
+/* the newline which ends the directive, or the '\0' after the last line */
+static const char *
+skip_line(const char *ptr)
+{
+    for (;;)
+    {
+        switch (*ptr)
+        {
+        case '\n':
+        case '\0':
+            return ptr;
+
+        case '"':
+        case '\'':
+            ptr = skip_quoted(ptr);
+            break;
+
+        case '/':
+            ptr = ptr[1] == '*' || ptr[1] == '/' ? skip_blank(ptr) : ptr + 1;
+            break;
+
+        default:
+            ++ptr;
+            break;
+        }
+    }
+}
+
+
+static inline bool
+at_line_end(const char *ptr)
+{
+    ptr = skip_blank(ptr);
+
+    return *ptr == '\n' || *ptr == '\0';
+}
+
+
+static const char *
+skip_ident(const char *ptr)
+{
+    if (*ptr >= '0' && *ptr <= '9')
+    {
+        return ptr;
+    }
+
+    while (is_ident_char(*ptr))
+    {
+        ++ptr;
+    }
+
+    return ptr;
+}
+
+
+/* reads "name" or <name> into 'name', or returns NULL if there is none */
+static const char *
+header_name(const char *ptr, atom_t *name, bool *angled)
+{
+    char        close = *ptr == '<' ? '>' : '"';
+    const char *end;
+
+    if (*ptr != '"' && *ptr != '<')
+    {
+        return NULL;
+    }
+
+    for (end = ptr + 1; *end != close && *end != '\n' && *end != '\0'; ++end)
+    {
+    }
+
+    if (*end != close || end == ptr + 1)
+    {
+        return NULL;
+    }
+
+    *name   = atom_intern(ptr + 1, end - ptr - 1);
+    *angled = close == '>';
+
+    return end + 1;
+}
+
+
+/* the simple conditions of #if, a number, or whether a single macro is defined */
+static void
+read_condition(const char *ptr, dep_directive_t *directive)
+{
+    const char *ident;
+    bool        zero   = true;
+    bool        negate = false;
+    bool        paren;
+
+    directive->condition = DEP_COND_UNKNOWN;
+
+    ptr = skip_blank(ptr);
+
+    if (*ptr >= '0' && *ptr <= '9')
+    {
+        for (; *ptr >= '0' && *ptr <= '9'; ++ptr)
+        {
+            zero &= *ptr == '0';
+        }
+
+        while (*ptr == 'u' || *ptr == 'U' || *ptr == 'l' || *ptr == 'L')
+        {
+            ++ptr;
+        }
+
+        if (at_line_end(ptr))
+        {
+            directive->condition = zero ? DEP_COND_FALSE : DEP_COND_TRUE;
+        }
+
+        return;
+    }
+
+    if (*ptr == '!')
+    {
+        negate = true;
+        ptr    = skip_blank(ptr + 1);
+    }
+
+    ident = ptr;
+    ptr   = skip_ident(ptr);
+
+    if (ptr - ident != 7 || memcmp(ident, "defined", 7) != 0)
+    {
+        return;
+    }
+
+    ptr   = skip_blank(ptr);
+    paren = *ptr == '(';
+    ptr   = paren ? skip_blank(ptr + 1) : ptr;
+    ident = ptr;
+    ptr   = skip_blank(skip_ident(ptr));
+
+    if (ptr == ident || (paren && *ptr++ != ')') || !at_line_end(ptr))
+    {
+        return;
+    }
+
+    directive->name      = atom_intern(ident, skip_ident(ident) - ident);
+    directive->condition = negate ? DEP_COND_NOT_DEFINED : DEP_COND_DEFINED;
+}
+
+
+static void
+add_directive(dep_directive_t **directives, uint32_t *count, uint32_t *capacity,
+              const dep_directive_t *directive)
+{
+    if (*count == *capacity)
+    {
+        *capacity   = *capacity ? *capacity * 2 : 64;
+        *directives = c_realloc(*directives, *capacity * sizeof(dep_directive_t));
+    }
+
+    (*directives)[(*count)++] = *directive;
+}
+
+
+/* reads the directive starting at 'hash', and returns the end of its line */
+static const char *
+read_directive(dep_scanner_t *scanner, const char *start, const char *hash)
+{
+    dep_directive_t directive = { .file = DEP_UNRESOLVED, .offset = hash - start };
+    const char *    ptr       = skip_blank(hash + 1);
+    const char *    name      = ptr;
+    const char *    operand;
+    uint32_t        i;
+
+    ptr = skip_ident(ptr);
+
+    for (i = 0; i < sizeof(directive_names) / sizeof(directive_names[0]); ++i)
+    {
+        if (strlen(directive_names[i].name) == (size_t)(ptr - name)
+            && memcmp(directive_names[i].name, name, ptr - name) == 0)
+        {
+            break;
+        }
+    }
+
+    if (i == sizeof(directive_names) / sizeof(directive_names[0]))
+    {
+        return skip_line(ptr);
+    }
+
+    directive.kind      = directive_names[i].kind;
+    directive.condition = directive_names[i].condition;
+
+    operand = skip_blank(ptr);
+    ptr     = skip_ident(operand);
+
+    switch (directive.kind)
+    {
+    case DEP_INCLUDE:
+        if (ptr != operand)
+        {
+            directive.kind = DEP_INCLUDE_MACRO;
+            directive.name = atom_intern(operand, ptr - operand);
+        }
+        else if (!(ptr = header_name(operand, &directive.name, &directive.angled)))
+        {
+            return skip_line(operand);
+        }
+        break;
+
+    case DEP_DEFINE:
+        if (ptr == operand)
+        {
+            return skip_line(operand);
+        }
+
+        directive.name = atom_intern(operand, ptr - operand);
+
+        /* only object-like macros can be header names */
+        if (*ptr != '(')
+        {
+            operand = header_name(skip_blank(ptr), &directive.value, &directive.angled);
+
+            if (operand && at_line_end(operand))
+            {
+                ptr = operand;
+            }
+            else
+            {
+                directive.value = ATOM_NULL;
+            }
+        }
+        break;
+
+    case DEP_UNDEF:
+        if (ptr == operand)
+        {
+            return skip_line(operand);
+        }
+
+        directive.name = atom_intern(operand, ptr - operand);
+        break;
+
+    case DEP_IF:
+    case DEP_ELIF:
+        /* the conditionals are always kept, or the groups wouldn't match */
+        if (directive.condition == DEP_COND_UNKNOWN)
+        {
+            read_condition(operand, &directive);
+        }
+        else if (ptr != operand && at_line_end(ptr))
+        {
+            directive.name = atom_intern(operand, ptr - operand);
+        }
+        else
+        {
+            directive.condition = DEP_COND_UNKNOWN;
+        }
+        break;
+
+    case DEP_ONCE:
+        if (ptr - operand != 4 || memcmp(operand, "once", 4) != 0)
+        {
+            return skip_line(operand);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    add_directive(&scanner->directives, &scanner->directive_count, &scanner->directive_capacity,
+                  &directive);
+
+    scanner->last_line_end = skip_line(ptr);
+
+    return scanner->last_line_end;
+}
+
+
+/* whether the '#' at 'ptr' starts a directive, which it does when only spaces, or
+ * a comment ending at 'blank', come before it on its line */
+static bool
+at_line_start(const char *ptr, const char *start, const char *blank)
+{
+    while (ptr > start && is_blank(ptr[-1]))
+    {
+        --ptr;
+    }
+
+    return ptr == start || ptr[-1] == '\n' || ptr == blank;
+}
+
+
+/* everything but the directives is skipped a vector at a time, only comments and
+ * literals are followed, since a '#' or the start of a comment in them doesn't count */
+static void
+scan_text(dep_scanner_t *scanner, const char *start, const char *end)
+{
+    const char *ptr   = start;
+    const char *blank = start;
+    const char *comment;
+
+    for (;;)
+    {
+        ptr = scan_find_directive_char(ptr);
+
+        switch (*ptr)
+        {
+        case '#':
+            ptr = at_line_start(ptr, start, blank) ? read_directive(scanner, start, ptr) : ptr + 1;
+            break;
+
+        case '/':
+            if (ptr[1] == '*')
+            {
+                comment = ptr;
+                ptr     = scan_find_comment_end(ptr + 2);
+                ptr += *ptr ? 2 : 0;
+
+                if (at_line_start(comment, start, blank))
+                {
+                    blank = ptr;
+                }
+            }
+            else if (ptr[1] == '/')
+            {
+                ptr = scan_find_line_end(ptr + 2);
+            }
+            else
+            {
+                ++ptr;
+            }
+            break;
+
+        case '"':
+        case '\'':
+            ptr = skip_quoted(ptr);
+            break;
+
+        default:
+            if (ptr >= end)
+            {
+                return;
+            }
+
+            /* a '\0' in the file */
+            ++ptr;
+            break;
+        }
+    }
+}
+
+
+/* the guard of a file is an #ifndef at the very start, followed by a #define of the same
+ * macro, and closed by an #endif at the very end, without an #else */
+static atom_t
+find_guard(const dep_directive_t *directives, uint32_t count, uint32_t first, bool text_after)
+{
+    uint32_t depth = 0;
+    uint32_t i;
+
+    if (count < 3 || text_after || directives[0].offset != first || directives[0].kind != DEP_IF
+        || directives[0].condition != DEP_COND_NOT_DEFINED || directives[1].kind != DEP_DEFINE
+        || directives[1].name != directives[0].name)
+    {
+        return ATOM_NULL;
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+        if (directives[i].kind == DEP_IF)
+        {
+            ++depth;
+        }
+        else if ((directives[i].kind == DEP_ELIF || directives[i].kind == DEP_ELSE) && depth == 1)
+        {
+            return ATOM_NULL;
+        }
+        else if (directives[i].kind == DEP_ENDIF && --depth == 0)
+        {
+            return i == count - 1 ? directives[0].name : ATOM_NULL;
+        }
+    }
+
+    return ATOM_NULL;
+}
+
+
+static void
+scan_file(dep_scanner_t *scanner, dep_file_t *file)
+{
+    const char *start = file->source->start;
+    const char *end   = file->source->end;
+    const char *first = skip_space(start);
+
+    scanner->directive_count = 0;
+    scanner->last_line_end   = start;
+
+    scan_text(scanner, start, end);
+
+    file->directive_count = scanner->directive_count;
+    file->directives      = c_malloc(scanner->directive_count * sizeof(dep_directive_t) + 1);
+    file->scanned         = true;
+
+    memcpy(file->directives, scanner->directives, scanner->directive_count * sizeof(dep_directive_t));
+
+    file->guard = find_guard(file->directives, file->directive_count, first - start,
+                             skip_space(scanner->last_line_end) < end);
+}
+
+
+/* ================================================================================= */
+/* following the directives */
+
+static dep_macro_t *
+get_macro(dep_scanner_t *scanner, atom_t name)
+{
+    uint32_t    capacity = scanner->macro_capacity;
+    const char *str;
+    dep_macro_t *macro;
+
+    if (name >= capacity)
+    {
+        capacity = capacity * 2 > atom_count() ? capacity * 2 : atom_count();
+
+        scanner->macros = c_realloc(scanner->macros, capacity * sizeof(dep_macro_t));
+        memset(scanner->macros + scanner->macro_capacity, 0,
+               (capacity - scanner->macro_capacity) * sizeof(dep_macro_t));
+
+        scanner->macro_capacity = capacity;
+    }
+
+    macro = &scanner->macros[name];
+
+    /* names reserved for the implementation may be predefined */
+    if (macro->unit != scanner->unit)
+    {
+        str = atom_str(name);
+
+        macro->unit  = scanner->unit;
+        macro->value = ATOM_NULL;
+        macro->state = str[0] == '_' && (str[1] == '_' || (str[1] >= 'A' && str[1] <= 'Z'))
+                           ? DEP_MAYBE_DEFINED
+                           : DEP_UNDEFINED;
+    }
+
+    return macro;
+}
+
+
+/* in a group which may not be taken, a macro which was defined may now not be, and
+ * the other way around */
+static void
+define_macro(dep_scanner_t *scanner, const dep_directive_t *directive)
+{
+    dep_macro_t *macro = get_macro(scanner, directive->name);
+
+    if (directive->kind == DEP_DEFINE)
+    {
+        macro->state  = !scanner->maybe || macro->state == DEP_DEFINED ? DEP_DEFINED : DEP_MAYBE_DEFINED;
+        macro->value  = directive->value;
+        macro->angled = directive->angled;
+    }
+    else
+    {
+        macro->state = !scanner->maybe || macro->state == DEP_UNDEFINED ? DEP_UNDEFINED : DEP_MAYBE_DEFINED;
+    }
+}
+
+
+static dep_condition_t
+evaluate(dep_scanner_t *scanner, const dep_directive_t *directive)
+{
+    dep_state_t state;
+
+    if (directive->condition != DEP_COND_DEFINED && directive->condition != DEP_COND_NOT_DEFINED)
+    {
+        return directive->condition;
+    }
+
+    state = get_macro(scanner, directive->name)->state;
+
+    if (state == DEP_MAYBE_DEFINED)
+    {
+        return DEP_COND_UNKNOWN;
+    }
+
+    return (state == DEP_DEFINED) == (directive->condition == DEP_COND_DEFINED) ? DEP_COND_TRUE
+                                                                                 : DEP_COND_FALSE;
+}
+
+
+static void
+set_group(dep_scanner_t *scanner, dep_conditional_t *conditional, dep_group_t group)
+{
+    scanner->skipping -= conditional->group == DEP_GROUP_SKIPPED;
+    scanner->maybe -= conditional->group == DEP_GROUP_MAYBE;
+
+    conditional->group = group;
+
+    scanner->skipping += group == DEP_GROUP_SKIPPED;
+    scanner->maybe += group == DEP_GROUP_MAYBE;
+}
+
+
+/* starts the next group of a conditional, which is taken if its condition is true and
+ * no group before was, and may be taken if either isn't known */
+static void
+next_group(dep_scanner_t *scanner, dep_conditional_t *conditional, dep_condition_t value)
+{
+    dep_group_t group;
+
+    if (conditional->done || value == DEP_COND_FALSE)
+    {
+        group = DEP_GROUP_SKIPPED;
+    }
+    else if (value == DEP_COND_TRUE && !conditional->maybe)
+    {
+        group = DEP_GROUP_TAKEN;
+    }
+    else
+    {
+        group = DEP_GROUP_MAYBE;
+    }
+
+    conditional->done |= value == DEP_COND_TRUE;
+    conditional->maybe |= group == DEP_GROUP_MAYBE;
+
+    set_group(scanner, conditional, group);
+}
+
+
+static void
+push_conditional(dep_scanner_t *scanner, dep_condition_t value)
+{
+    dep_conditional_t *conditional;
+
+    if (scanner->conditional_count == scanner->conditional_capacity)
+    {
+        scanner->conditional_capacity = scanner->conditional_capacity ? scanner->conditional_capacity * 2 : 16;
+        scanner->conditionals         = c_realloc(scanner->conditionals,
+                                          scanner->conditional_capacity * sizeof(dep_conditional_t));
+    }
+
+    conditional = &scanner->conditionals[scanner->conditional_count++];
+
+    /* nothing in a skipped group is taken */
+    conditional->group = DEP_GROUP_TAKEN;
+    conditional->done  = scanner->skipping > 0;
+    conditional->maybe = false;
+
+    next_group(scanner, conditional, value);
+}
+
+
+static void
+pop_conditional(dep_scanner_t *scanner)
+{
+    set_group(scanner, &scanner->conditionals[--scanner->conditional_count], DEP_GROUP_TAKEN);
+}
+
+
+static bool
+try_path(char *path, const char *dir, uint32_t dir_len, const char *name, struct stat *st)
+{
+    const char *separator = dir_len > 0 && dir[dir_len - 1] != '/' ? "/" : "";
+
+    if (snprintf(path, PATH_MAX, "%.*s%s%s", dir_len, dir, separator, name) >= PATH_MAX)
+    {
+        return false;
+    }
+
+    return stat(path, st) == 0 && S_ISREG(st->st_mode);
+}
+
+
+/* the slot of a device and inode in file_of_id, which is 0 if it's not there */
+static uint32_t *
+id_slot(dep_scanner_t *scanner, dev_t device, ino_t inode)
+{
+    uint64_t    hash = ((uint64_t)inode ^ ((uint64_t)device << 40)) * 0x9e3779b97f4a7c15ull;
+    uint32_t    mask = scanner->id_capacity - 1;
+    uint32_t    slot = (hash >> 32) & mask;
+    dep_file_t *file;
+
+    while (scanner->file_of_id[slot])
+    {
+        file = scanner->files[scanner->file_of_id[slot] - 1];
+
+        if (file->device == device && file->inode == inode)
+        {
+            break;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return &scanner->file_of_id[slot];
+}
+
+
+/* keeps file_of_id at most half full, so there is a slot for one more file */
+static void
+grow_ids(dep_scanner_t *scanner)
+{
+    uint32_t i;
+
+    if ((scanner->file_count + 1) * 2 <= scanner->id_capacity)
+    {
+        return;
+    }
+
+    c_free(scanner->file_of_id);
+
+    scanner->id_capacity = scanner->id_capacity ? scanner->id_capacity * 2 : 128;
+    scanner->file_of_id  = c_malloc(scanner->id_capacity * sizeof(uint32_t));
+
+    memset(scanner->file_of_id, 0, scanner->id_capacity * sizeof(uint32_t));
+
+    for (i = 0; i < scanner->file_count; ++i)
+    {
+        *id_slot(scanner, scanner->files[i]->device, scanner->files[i]->inode) = i + 1;
+    }
+}
+
+
+/* the file of a path, which is added the first time the file is found, by any path,
+ * and scanned when it's first read. 'st' is what stat gave for the path */
+static uint32_t
+file_of_path(dep_scanner_t *scanner, const char *path, const struct stat *st)
+{
+    atom_t      atom     = atom_intern(path, strlen(path));
+    uint32_t    capacity = scanner->path_capacity;
+    uint32_t *  slot;
+    dep_file_t *file;
+
+    if (atom >= capacity)
+    {
+        capacity = capacity * 2 > atom_count() ? capacity * 2 : atom_count();
+
+        scanner->file_of_path = c_realloc(scanner->file_of_path, capacity * sizeof(uint32_t));
+        memset(scanner->file_of_path + scanner->path_capacity, 0,
+               (capacity - scanner->path_capacity) * sizeof(uint32_t));
+
+        scanner->path_capacity = capacity;
+    }
+
+    if (scanner->file_of_path[atom])
+    {
+        return scanner->file_of_path[atom] - 1;
+    }
+
+    grow_ids(scanner);
+
+    slot = id_slot(scanner, st->st_dev, st->st_ino);
+
+    /* another path to a file which was found before */
+    if (*slot)
+    {
+        scanner->file_of_path[atom] = *slot;
+        return *slot - 1;
+    }
+
+    if (scanner->file_count == scanner->file_capacity)
+    {
+        scanner->file_capacity = scanner->file_capacity ? scanner->file_capacity * 2 : 64;
+        scanner->files = c_realloc(scanner->files, scanner->file_capacity * sizeof(dep_file_t *));
+    }
+
+    file = c_malloc(sizeof(dep_file_t));
+    memset(file, 0, sizeof(dep_file_t));
+
+    file->path   = atom;
+    file->device = st->st_dev;
+    file->inode  = st->st_ino;
+
+    scanner->files[scanner->file_count] = file;
+    scanner->file_of_path[atom]         = ++scanner->file_count;
+    *slot                               = scanner->file_count;
+
+    return scanner->file_count - 1;
+}
+
+
+/* finds "name" next to the file including it, and then both it and <name>
+ * in the include directories, the same as the preprocessor */
+static int32_t
+find_include(dep_scanner_t *scanner, const dep_file_t *file, const char *name, bool angled)
+{
+    char        path[PATH_MAX];
+    struct stat st;
+    const char *current;
+    const char *slash;
+    bool        found = false;
+    uint32_t    i;
+
+    if (name[0] == '/')
+    {
+        found = try_path(path, "", 0, name, &st);
+    }
+    else if (!angled)
+    {
+        current = atom_str(file->path);
+        slash   = strrchr(current, '/');
+
+        found = try_path(path, current, slash ? slash - current + 1 : 0, name, &st);
+    }
+
+    for (i = 0; i < scanner->include_dir_count && !found && name[0] != '/'; ++i)
+    {
+        found = try_path(path, scanner->include_dirs[i], strlen(scanner->include_dirs[i]), name, &st);
+    }
+
+    return found ? (int32_t)file_of_path(scanner, path, &st) : DEP_NOT_FOUND;
+}
+
+
+static void read_file(dep_scanner_t *scanner, dep_file_t *file);
+
+/* lists the file, and reads it unless it can't add anything */
+static void
+include_file(dep_scanner_t *scanner, dep_file_t *file)
+{
+    if (file->listed != scanner->unit)
+    {
+        if (scanner->dep_count == scanner->dep_capacity)
+        {
+            scanner->dep_capacity = scanner->dep_capacity ? scanner->dep_capacity * 2 : 64;
+            scanner->deps         = c_realloc(scanner->deps, scanner->dep_capacity * sizeof(uint32_t));
+        }
+
+        scanner->deps[scanner->dep_count++] = scanner->file_of_path[file->path] - 1;
+        file->listed                        = scanner->unit;
+    }
+
+    if (file->active || file->once == scanner->unit)
+    {
+        return;
+    }
+
+    if (!file->scanned)
+    {
+        file->source = c_malloc(sizeof(source_t));
+        source_open(file->source, atom_str(file->path));
+
+        scan_file(scanner, file);
+    }
+
+    if (file->guard && get_macro(scanner, file->guard)->state == DEP_DEFINED)
+    {
+        return;
+    }
+
+    read_file(scanner, file);
+}
+
+
+static void
+include_directive(dep_scanner_t *scanner, dep_file_t *file, dep_directive_t *directive)
+{
+    dep_macro_t *macro  = NULL;
+    int32_t      found;
+    bool         angled = directive->angled;
+
+    if (directive->kind == DEP_INCLUDE_MACRO)
+    {
+        macro = get_macro(scanner, directive->name);
+
+        /* other computed includes can't be followed without expanding macros */
+        if (macro->state == DEP_UNDEFINED || macro->value == ATOM_NULL)
+        {
+            return;
+        }
+
+        angled = macro->angled;
+        found  = find_include(scanner, file, atom_str(macro->value), angled);
+    }
+    else
+    {
+        if (directive->file == DEP_UNRESOLVED)
+        {
+            directive->file = find_include(scanner, file, atom_str(directive->name), angled);
+        }
+
+        found = directive->file;
+    }
+
+    /* system headers aren't searched for, and aren't dependencies */
+    if (found == DEP_NOT_FOUND)
+    {
+        if (!angled && !scanner->maybe && !directive->warned)
+        {
+            directive->warned = true;
+            syntax_warning((err_location_t){ file->source, directive->offset }, "'%s' file not found",
+                           atom_str(directive->kind == DEP_INCLUDE ? directive->name : macro->value));
+        }
+
+        return;
+    }
+
+    include_file(scanner, scanner->files[found]);
+}
+
+
+/* follows the directives of a file. the #ifndef of an include guard is taken when it
+ * isn't known if the macro is defined, since it's defined after the file either way */
+static void
+read_file(dep_scanner_t *scanner, dep_file_t *file)
+{
+    uint32_t           base = scanner->conditional_count;
+    dep_directive_t *  directive;
+    dep_conditional_t *conditional;
+    dep_condition_t    value;
+    uint32_t           i;
+
+    file->active = true;
+
+    for (i = 0; i < file->directive_count; ++i)
+    {
+        directive = &file->directives[i];
+
+        switch (directive->kind)
+        {
+        case DEP_IF:
+            value = evaluate(scanner, directive);
+            push_conditional(scanner, i == 0 && file->guard && value == DEP_COND_UNKNOWN ? DEP_COND_TRUE : value);
+            break;
+
+        case DEP_ELIF:
+        case DEP_ELSE:
+            if (scanner->conditional_count > base)
+            {
+                conditional = &scanner->conditionals[scanner->conditional_count - 1];
+                next_group(scanner, conditional, conditional->done ? DEP_COND_FALSE : evaluate(scanner, directive));
+            }
+            break;
+
+        case DEP_ENDIF:
+            if (scanner->conditional_count > base)
+            {
+                pop_conditional(scanner);
+            }
+            break;
+
+        default:
+            if (scanner->skipping)
+            {
+                break;
+            }
+
+            if (directive->kind == DEP_DEFINE || directive->kind == DEP_UNDEF)
+            {
+                define_macro(scanner, directive);
+            }
+            else if (directive->kind == DEP_ONCE)
+            {
+                file->once = scanner->unit;
+            }
+            else
+            {
+                include_directive(scanner, file, directive);
+            }
+            break;
+        }
+    }
+
+    /* an unterminated conditional ends with its file */
+    while (scanner->conditional_count > base)
+    {
+        pop_conditional(scanner);
+    }
+
+    file->active = false;
+}
+
+
+/* ================================================================================= */
+
+void
+f_create_dep_scanner(dep_scanner_t *scanner)
+{
+    memset(scanner, 0, sizeof(dep_scanner_t));
+
+    scan_init();
+}
+
+
+void
+f_destroy_dep_scanner(dep_scanner_t *scanner)
+{
+    uint32_t i;
+
+    for (i = 0; i < scanner->file_count; ++i)
+    {
+        if (scanner->files[i]->source)
+        {
+            source_close(scanner->files[i]->source);
+            c_free(scanner->files[i]->source);
+        }
+
+        c_free(scanner->files[i]->directives);
+        c_free(scanner->files[i]);
+    }
+
+    for (i = 0; i < scanner->include_dir_count; ++i)
+    {
+        c_free(scanner->include_dirs[i]);
+    }
+
+    for (i = 0; i < scanner->unit_capacity; ++i)
+    {
+        c_free(scanner->units[i].deps);
+    }
+
+    c_free(scanner->files);
+    c_free(scanner->file_of_path);
+    c_free(scanner->file_of_id);
+    c_free(scanner->include_dirs);
+    c_free(scanner->predefined);
+    c_free(scanner->directives);
+    c_free(scanner->macros);
+    c_free(scanner->conditionals);
+    c_free(scanner->deps);
+    c_free(scanner->units);
+}
+
+
+void
+f_deps_add_include_dir(dep_scanner_t *scanner, const char *dir)
+{
+    scanner->include_dirs = c_realloc(scanner->include_dirs, (scanner->include_dir_count + 1) * sizeof(char *));
+    scanner->include_dirs[scanner->include_dir_count] = c_malloc(strlen(dir) + 1);
+
+    strcpy(scanner->include_dirs[scanner->include_dir_count++], dir);
+}
+
+
+/* only the name matters, and the value if it's a header name */
+void
+f_deps_define(dep_scanner_t *scanner, const char *definition)
+{
+    dep_directive_t directive = { .kind = DEP_DEFINE };
+    const char *    value     = strchr(definition, '=');
+    uint32_t        len       = value ? (uint32_t)(value - definition) : strlen(definition);
+
+    directive.name = atom_intern(definition, len);
+
+    if (value)
+    {
+        value = header_name(value + 1, &directive.value, &directive.angled);
+
+        if (!value || *value)
+        {
+            directive.value = ATOM_NULL;
+        }
+    }
+
+    add_directive(&scanner->predefined, &scanner->predefined_count, &scanner->predefined_capacity,
+                  &directive);
+}
+
+
+void
+f_deps_undef(dep_scanner_t *scanner, const char *name)
+{
+    dep_directive_t directive = { .kind = DEP_UNDEF };
+
+    directive.name = atom_intern(name, strlen(name));
+
+    add_directive(&scanner->predefined, &scanner->predefined_count, &scanner->predefined_capacity,
+                  &directive);
+}
+
+
+void
+f_deps_scan(dep_scanner_t *scanner, source_t *source, uint32_t index)
+{
+    dep_file_t  file = { 0 };
+    dep_unit_t *unit;
+    uint32_t    capacity = scanner->unit_capacity;
+    uint32_t    i;
+
+    while (source->stream && !source->eof)
+    {
+        source_refill(source, source->start, 0);
+    }
+
+    ++scanner->unit;
+    scanner->dep_count = 0;
+
+    file.path   = atom_intern(source->filename, strlen(source->filename));
+    file.source = source;
+
+    scan_file(scanner, &file);
+
+    for (i = 0; i < scanner->predefined_count; ++i)
+    {
+        define_macro(scanner, &scanner->predefined[i]);
+    }
+
+    read_file(scanner, &file);
+
+    if (index >= capacity)
+    {
+        capacity = capacity * 2 > index + 1 ? capacity * 2 : index + 1;
+
+        scanner->units = c_realloc(scanner->units, capacity * sizeof(dep_unit_t));
+        memset(scanner->units + scanner->unit_capacity, 0,
+               (capacity - scanner->unit_capacity) * sizeof(dep_unit_t));
+
+        scanner->unit_capacity = capacity;
+    }
+
+    unit = &scanner->units[index];
+
+    unit->path      = file.path;
+    unit->dep_count = scanner->dep_count;
+    unit->deps      = c_realloc(unit->deps, scanner->dep_count * sizeof(uint32_t) + 1);
+
+    memcpy(unit->deps, scanner->deps, scanner->dep_count * sizeof(uint32_t));
+
+    c_free(file.directives);
+}
+
+
+/* ================================================================================= */
+/* output */
+
+/* spaces and '#' are escaped with a backslash in make, and '$' with another */
+static uint32_t
+write_make_path(FILE *out, const char *path)
+{
+    uint32_t len = 0;
+
+    for (; *path; ++path, ++len)
+    {
+        if (*path == ' ' || *path == '#')
+        {
+            fputc('\\', out);
+            ++len;
+        }
+        else if (*path == '$')
+        {
+            fputc('$', out);
+            ++len;
+        }
+
+        fputc(*path, out);
+    }
+
+    return len;
+}
+
+
+static void
+write_json_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+
+    for (; *str; ++str)
+    {
+        if (*str == '"' || *str == '\\')
+        {
+            fputc('\\', out);
+            fputc(*str, out);
+        }
+        else if ((unsigned char)*str < 0x20)
+        {
+            fprintf(out, "\\u%04x", (unsigned char)*str);
+        }
+        else
+        {
+            fputc(*str, out);
+        }
+    }
+
+    fputc('"', out);
+}
+
+
+/* the object file of a unit is its name without directories, with the extension ".o" */
+static uint32_t
+write_make_target(FILE *out, const char *path)
+{
+    const char *name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    const char *dot  = strrchr(name, '.');
+
+    return fprintf(out, "%.*s.o:", dot && dot != name ? (int)(dot - name) : (int)strlen(name), name);
+}
+
+
+void
+f_deps_write(dep_scanner_t *scanner, FILE *out, deps_format_t format)
+{
+    const dep_unit_t *unit;
+    const char *      path;
+    uint32_t          column;
+    uint32_t          written = 0;
+    uint32_t          i;
+    uint32_t          j;
+
+    if (format == DEPS_FORMAT_JSON)
+    {
+        fputs("[\n", out);
+    }
+
+    for (i = 0; i < scanner->unit_capacity; ++i)
+    {
+        unit = &scanner->units[i];
+
+        if (unit->path == ATOM_NULL)
+        {
+            continue;
+        }
+
+        if (format == DEPS_FORMAT_JSON)
+        {
+            fputs(written++ ? ",\n  {\n    \"file\": " : "  {\n    \"file\": ", out);
+            write_json_string(out, atom_str(unit->path));
+            fputs(",\n    \"dependencies\": [\n      ", out);
+            write_json_string(out, atom_str(unit->path));
+
+            for (j = 0; j < unit->dep_count; ++j)
+            {
+                fputs(",\n      ", out);
+                write_json_string(out, atom_str(scanner->files[unit->deps[j]]->path));
+            }
+
+            fputs("\n    ]\n  }", out);
+            continue;
+        }
+
+        /* lines are broken before they get longer than 80 columns */
+        column = write_make_target(out, atom_str(unit->path));
+
+        for (j = 0; j <= unit->dep_count; ++j)
+        {
+            path = atom_str(j == 0 ? unit->path : scanner->files[unit->deps[j - 1]]->path);
+
+            if (j > 0 && column + strlen(path) + 1 > 78)
+            {
+                fputs(" \\\n", out);
+                column = 0;
+            }
+
+            fputc(' ', out);
+            column += write_make_path(out, path) + 1;
+        }
+
+        fputc('\n', out);
+    }
+
+    if (format == DEPS_FORMAT_JSON)
+    {
+        fputs(written ? "\n]\n" : "]\n", out);
+    }
+}
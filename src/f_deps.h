@@ -0,0 +1,108 @@
+#ifndef _F_DEPS_
+#define _F_DEPS_
+
+#include "atom.h"
+#include "source.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * finds the files a translation unit includes, without lexing or preprocessing it.
+ * only the lines starting with '#' are read, which are found with a vectorized
+ * search. an #if is only evaluated when it tests whether a macro is defined, or
+ * is a plain number, otherwise every branch is followed, so more dependencies
+ * than needed can be listed, but never fewer. files are scanned once, into a
+ * list of the directives which matter, and include guards are recognized, so
+ * a guarded file isn't even looked at again once its macro is defined
+ */
+
+typedef enum deps_format
+{
+    DEPS_FORMAT_MAKE,
+    DEPS_FORMAT_JSON,
+
+} deps_format_t;
+
+struct dep_file;
+struct dep_directive;
+struct dep_macro;
+struct dep_conditional;
+struct dep_unit;
+
+typedef struct dep_scanner
+{
+    /* every file which has been included, scanned when first read */
+    struct dep_file **files;
+    uint32_t          file_count;
+    uint32_t          file_capacity;
+
+    /* one more than the index of the file of every path, by its atom, or 0 */
+    uint32_t *file_of_path;
+    uint32_t  path_capacity;
+
+    /* the same by device and inode, a hash table with a power of two slots, so
+     * a file reached through two paths is one file, listed by the first */
+    uint32_t *file_of_id;
+    uint32_t  id_capacity;
+
+    /* the directories searched by #include, in order */
+    char **  include_dirs;
+    uint32_t include_dir_count;
+
+    /* -D and -U, done before every translation unit */
+    struct dep_directive *predefined;
+    uint32_t              predefined_count;
+    uint32_t              predefined_capacity;
+
+    /* the directives of the file being scanned */
+    struct dep_directive *directives;
+    uint32_t              directive_count;
+    uint32_t              directive_capacity;
+    const char *          last_line_end;
+
+    /* what is known about every macro, by atom, valid for the unit it was set in */
+    struct dep_macro *macros;
+    uint32_t          macro_capacity;
+
+    /* counts the translation units, to tell which unit the state of a file is from */
+    uint32_t unit;
+
+    /* the open conditionals, and how many of them are in a skipped group,
+     * or in a group which may or may not be taken */
+    struct dep_conditional *conditionals;
+    uint32_t                conditional_count;
+    uint32_t                conditional_capacity;
+    uint32_t                skipping;
+    uint32_t                maybe;
+
+    /* the files the current unit includes, in the order they were found */
+    uint32_t *deps;
+    uint32_t  dep_count;
+    uint32_t  dep_capacity;
+
+    /* the dependencies of every unit, by the index it was scanned as */
+    struct dep_unit *units;
+    uint32_t         unit_capacity;
+
+} dep_scanner_t;
+
+void f_create_dep_scanner(dep_scanner_t *scanner);
+void f_destroy_dep_scanner(dep_scanner_t *scanner);
+
+/* the same as f_pp_add_include_dir, f_pp_define and f_pp_undef */
+void f_deps_add_include_dir(dep_scanner_t *scanner, const char *dir);
+void f_deps_define(dep_scanner_t *scanner, const char *definition);
+void f_deps_undef(dep_scanner_t *scanner, const char *name);
+
+/* finds the dependencies of 'source', which are written as those of the
+ * 'index'th unit. streams are read to the end first */
+void f_deps_scan(dep_scanner_t *scanner, source_t *source, uint32_t index);
+
+/* writes the dependencies of every unit scanned, in the order of their index. the make
+ * format is a rule for the object file of every unit, the json format an array of
+ * objects with a "file" and its "dependencies" */
+void f_deps_write(dep_scanner_t *scanner, FILE *out, deps_format_t format);
+
+#endif
@@ -101,11 +101,11 @@ make_literal_node(parser_t *parser, literal_t literal)
 }
 
 inline static ast_node_t *
-make_lvalue_node(parser_t *parser, sym_hash_t hash, err_location_t err_loc)
+make_lvalue_node(parser_t *parser, atom_t atom, err_location_t err_loc)
 {
     ast_node_t *node;
 	type_info_t type;
-    sym_id_t    id = sym_find_id(parser->sym_table, hash);
+    sym_id_t    id = sym_find_id(parser->sym_table, atom);
 
     if (id == SYM_ID_NULL)
     {
@@ -151,8 +151,8 @@ check_argument_list(parser_t *parser, ast_node_t *func_call)
 
             if (compat == TYPE_COMPAT_INCOMPAT)
             {
-                syntax_error(parser->lexer->last_token.err_loc, "argument doesnt match parameter "
-                                                                "type");
+                syntax_error(f_last_loc(parser), "argument doesnt match parameter "
+                                                 "type");
             }
 
             type_print(argument->right->expr_type);
@@ -167,15 +167,15 @@ check_argument_list(parser_t *parser, ast_node_t *func_call)
 
             if (compat == TYPE_COMPAT_INCOMPAT)
             {
-                syntax_error(parser->lexer->last_token.err_loc, "argument doesnt match parameter "
-                                                                "type");
+                syntax_error(f_last_loc(parser), "argument doesnt match parameter "
+                                                 "type");
             }
 
             /* check that parameter count, and the number of arguments match */
             if (i != 0)
             {
-                syntax_error(parser->lexer->last_token.err_loc, "number of arguments doesnt match "
-                                                                "parameter count");
+                syntax_error(f_last_loc(parser), "number of arguments doesnt match "
+                                                 "parameter count");
             }
 
             break;
@@ -196,12 +196,12 @@ parse_function_call(parser_t *parser)
     token_t token = parser->lexer->curr_token;
 
     /* find the symbol */
-    id = sym_find_id(parser->sym_table, token.hash);
+    id = sym_find_id(parser->sym_table, token.atom);
 
     /* make sure that it's declared */
     if (id == SYM_ID_NULL)
     {
-        syntax_error(token.err_loc, "undefined function");
+        syntax_error(f_token_loc(parser->lexer, &token), "undefined function");
     }
 
     /* get entry */
@@ -210,7 +210,7 @@ parse_function_call(parser_t *parser)
     /* make sure its a function */
     if (func->kind != SYM_GLOBAL_KIND_FUNCTION)
     {
-        syntax_error(token.err_loc, "cannot call variabel");
+        syntax_error(f_token_loc(parser->lexer, &token), "cannot call variabel");
     }
 
     func_call         = f_make_ast_node(parser, AST_FUNCTION_CALL, NULL, NULL, NULL);
@@ -234,17 +234,18 @@ make_postfix_operator(parser_t *parser, ast_type_t type, token_t primary_token)
 
     if (is_lvalue(primary_token.type))
     {
-        node      = make_lvalue_node(parser, primary_token.hash, primary_token.err_loc);
+        node      = make_lvalue_node(parser, primary_token.atom,
+                                     f_token_loc(parser->lexer, &primary_token));
         type_info = sym_get_type_info(parser->sym_table, node->sym_id);
     }
     else if (is_rvalue(primary_token.type))
     {
-        syntax_error(parser->lexer->curr_token.err_loc, "rvalues are not assignable");
+        syntax_error(f_curr_loc(parser), "rvalues are not assignable");
     }
     else
     {
-        syntax_error(parser->lexer->curr_token.err_loc, "unexpected operand "
-                                                        "for postfix operator");
+        syntax_error(f_curr_loc(parser), "unexpected operand "
+                                         "for postfix operator");
     }
 
     node            = f_make_ast_node(parser, type, NULL, NULL, NULL);
@@ -283,7 +284,8 @@ parse_postfix(parser_t *parser)
     default:
         if (is_lvalue(primary_token.type))
         {
-            return make_lvalue_node(parser, primary_token.hash, primary_token.err_loc);
+            return make_lvalue_node(parser, primary_token.atom,
+                                     f_token_loc(parser->lexer, &primary_token));
         }
         else if (is_rvalue(primary_token.type))
         {
@@ -291,7 +293,7 @@ parse_postfix(parser_t *parser)
         }
         else
         {
-            syntax_error(parser->lexer->last_token.err_loc, "expected literal or identifier");
+            syntax_error(f_last_loc(parser), "expected literal or identifier");
         }
 
         return NULL;
@@ -305,8 +307,8 @@ make_pre_x_crement_expression(parser_t *parser, ast_type_t prefix_type, ast_node
 
     if (primary->value_type == AST_RVALUE)
     {
-        syntax_error(parser->lexer->last_token.err_loc, "r-value is not "
-                                                        "assignable");
+        syntax_error(f_last_loc(parser), "r-value is not "
+                                         "assignable");
     }
 
     expr            = f_make_ast_node(parser, prefix_type, primary, NULL, NULL);
@@ -322,7 +324,7 @@ make_addressof_expression(parser_t *parser, ast_node_t *primary)
 
     if (primary->value_type == AST_RVALUE)
     {
-        syntax_error(parser->lexer->last_token.err_loc, "cannot take address of an rvalue");
+        syntax_error(f_last_loc(parser), "cannot take address of an rvalue");
     }
 
     expr = f_make_ast_node(parser, AST_ADDRESS, primary, NULL, NULL);
@@ -341,7 +343,7 @@ make_dereference_expression(parser_t *parser, ast_node_t *primary)
 
     if (primary->value_type == AST_RVALUE)
     {
-        syntax_error(parser->lexer->last_token.err_loc, "cannot dereference an rvalue");
+        syntax_error(f_last_loc(parser), "cannot dereference an rvalue");
     }
 
     expr = f_make_ast_node(parser, AST_ADDRESS, primary, NULL, NULL);
@@ -350,7 +352,7 @@ make_dereference_expression(parser_t *parser, ast_node_t *primary)
     /* if it's not a pointer */
     if (!type.indirection)
     {
-        syntax_error(parser->lexer->last_token.err_loc, "cannot dereference a non-pointer");
+        syntax_error(f_last_loc(parser), "cannot dereference a non-pointer");
     }
 
     --type.indirection;
@@ -564,8 +566,8 @@ expr_type_check(parser_t *parser, ast_node_t **left, ast_node_t **right)
 
     /* if they are incompatible we throw a syntax error */
     case TYPE_COMPAT_INCOMPAT:
-        syntax_error(parser->lexer->curr_token.err_loc, "type incompatible in "
-                                                        "expression");
+        syntax_error(f_curr_loc(parser), "type incompatible in "
+                                         "expression");
         assert(false);
 
     default:
@@ -605,7 +607,7 @@ f_parse_expression(parser_t *parser, int32_t prev_prec, token_type_t terminator)
 
     if (!op_type)
     {
-        syntax_error(err_loc(parser->lexer), "expected expression1");
+        syntax_error(f_token_loc(parser->lexer, &op_token), "expected expression1");
     }
 
     op_info = operator_info[op_type];
@@ -643,8 +645,8 @@ f_parse_expression(parser_t *parser, int32_t prev_prec, token_type_t terminator)
         op_type = op_tok_to_ast(token.type);
         if (!op_type)
         {
-            syntax_error(parser->lexer->curr_token.err_loc, "expected "
-                                                            "expression");
+            syntax_error(f_curr_loc(parser), "expected "
+                                             "expression");
         }
 
         op_info = operator_info[op_type];
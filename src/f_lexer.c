@@ -1,12 +1,25 @@
 #include "f_lexer.h"
 #include "type.h"
 #include "mem.h"
+#include "scan.h"
+#include "f_number.h"
+#include "f_token_cache.h"
+#include "f_unicode.h"
+#include "f_preprocessor.h"
 
 #include <assert.h>
-#include <ctype.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+/* short tokens are never split between the chunks of a stream, since at least
+ * this many bytes are loaded before a token is lexed */
+#define LEXER_LOOKAHEAD 64
 
 /*
  * parses the raw text into tokens
@@ -63,6 +76,8 @@ static const char *tok_str[_TOK_COUNT] = {
     "TOK_COMMA",
     "TOK_ELLIPSIS",
     "TOK_QUERY",
+    "TOK_HASH",
+    "TOK_HASH_HASH",
     "TOK_KEY_IF",
     "TOK_KEY_ELSE",
     "TOK_KEY_WHILE",
@@ -207,33 +222,25 @@ lex_tok_str(enum lex_token_type type)
 #endif
 
 
-/* moves the curr pointer by 1, and returns the char
- * also updates the position */
-static char
-next(lexer_t *in)
+/* offset of a byte from the start of the input, which is only partly
+ * loaded for streams */
+static inline uint32_t
+offset_of(const lexer_t *in, const char *ptr)
 {
-    char c;
+    return in->source.base + (ptr - in->source.start);
+}
 
-    if (in->curr != in->end)
-    {
-        c = *(++in->curr);
-    }
-    else
-    {
-        return '\0';
-    }
 
-    if (c == '\n')
-    {
-        ++in->line;
-        in->col = 1;
-    }
-    else
+/* moves the curr pointer by 1, and returns the char */
+static char
+next(lexer_t *in)
+{
+    if (in->curr != in->source.end)
     {
-        ++in->col;
+        return *(++in->curr);
     }
 
-    return c;
+    return '\0';
 }
 
 
@@ -249,927 +256,1939 @@ skip(lexer_t *in, uint32_t n)
 }
 
 
+/* moves the curr pointer forward to 'ptr' */
+static void
+advance(lexer_t *in, const char *ptr)
+{
+    in->curr = ptr;
+}
+
+
+/* reads more of a streamed source, keeping everything from 'keep', and returns how
+ * far the kept bytes moved, so pointers into them can be adjusted */
+static ptrdiff_t
+refill(lexer_t *in, const char *keep)
+{
+    /* the last token is the oldest one which may be used for an error */
+    ptrdiff_t delta = source_refill(&in->source, keep, in->last_token.offset) - keep;
+
+    if (in->curr >= keep)
+    {
+        in->curr += delta;
+    }
+
+    return delta;
+}
+
+
+/* true if 'ptr' is at the end of the loaded part of a stream, which isn't the end of the input */
+static inline bool
+needs_refill(const lexer_t *in, const char *ptr)
+{
+    return ptr >= in->source.end && !in->source.eof;
+}
+
+
 static char
 skip_single_line_comment(lexer_t *in)
 {
-    char c = *in->curr;
+    const char *ptr = scan_find_line_end(in->curr + 2);
+
+    while (needs_refill(in, ptr))
+    {
+        ptr += refill(in, ptr);
+        ptr = scan_find_line_end(ptr);
+    }
 
-    while (c != '\n' && c != '\0')
-        c = next(in);
+    /* skip the newline as well */
+    if (*ptr == '\n')
+    {
+        ++ptr;
+    }
 
-    c = next(in);
+    advance(in, ptr);
 
-    return c;
+    return *in->curr;
 }
 
 
 static char
 skip_multi_line_comment(lexer_t *in)
 {
-    // skip opening /*
-    skip(in, 2);
+    /* skip opening slash star */
+    const char *ptr  = in->curr + 2;
+    const char *body = ptr;
 
-    while (in->curr != in->end)
+    for (;;)
     {
-        if (in->curr[0] == '*')
+        ptr = scan_find_comment_end(ptr);
+
+        if (*ptr == '*')
         {
-            if (in->curr[1] == '/')
+            advance(in, ptr + 2);
+            return *in->curr;
+        }
+
+        /* a "*" at the end of a chunk may be closed by a "/" in the next */
+        if (needs_refill(in, ptr))
+        {
+            if (ptr > body)
             {
-                skip(in, 2);
-                return *in->curr;
+                --ptr;
             }
+
+            ptr += refill(in, ptr);
+            body = in->source.start;
+            continue;
         }
-        next(in);
+
+        /* a '\0' inside the comment is skipped like any other character */
+        if (ptr >= in->source.end)
+        {
+            break;
+        }
+
+        ++ptr;
     }
 
+    advance(in, in->source.end);
+
     syntax_error(err_loc(in), "Unexpected end of file in comment");
     return '\0';
 }
 
 
+/* skips whitespace and comments, and makes sure the next token is loaded
+ * if it's no longer than LEXER_LOOKAHEAD bytes */
 static char
 skip_whitespace_and_comments(lexer_t *in)
 {
+    const char *ptr;
+
     for (;;)
     {
-        switch (*in->curr)
+        ptr = scan_skip_whitespace(in->curr);
+
+        if (ptr != in->curr)
         {
-        case ' ':
-        case '\n':
-        case '\t':
-        case '\r':
-        case '\v':
-        case '\f':
-            next(in);
-            break;
+            advance(in, ptr);
+        }
 
-        case '/':
-            if (in->curr[1] == '*')
-            {
-                skip_multi_line_comment(in);
-            }
-            else if (in->curr[1] == '/')
-            {
-                skip_single_line_comment(in);
-            }
-            else
-            {
-                return *in->curr;
-            }
-            break;
+        if (in->source.end - ptr < LEXER_LOOKAHEAD && !in->source.eof)
+        {
+            refill(in, ptr);
+            continue;
+        }
 
-        default:
-            return *in->curr;
+        if (ptr[0] != '/')
+        {
+            return *ptr;
+        }
+
+        if (ptr[1] == '*')
+        {
+            skip_multi_line_comment(in);
+        }
+        else if (ptr[1] == '/')
+        {
+            skip_single_line_comment(in);
+        }
+        else
+        {
+            return *ptr;
         }
     }
 }
 
 
-static int
-word_len(const lexer_t *in)
+/* returns a word with the high bit set in every byte which can't be in an identifier,
+ * which is every byte besides letters, digits and '_' */
+static inline uint64_t
+non_word_bytes(uint64_t x)
 {
-    uint32_t    i   = 0;
-    const char *str = in->curr;
-
-    while (str[i])
-    {
-        if (isalpha(str[i]) || str[i] == '_' || isdigit(str[i]))
-            ++i;
-        else
-            return i;
-    }
+    const uint64_t ones = 0x0101010101010101ull;
+    const uint64_t high = ones * 0x80;
+    const uint64_t low  = ~high;
 
-    syntax_error(err_loc(in), "Unexpected end of file");
-    return 0;
-}
+    /* setting the high bit keeps the subtractions from borrowing across bytes */
+    uint64_t y     = x | high;
+    uint64_t lower = y | ones * 0x20;
+    uint64_t under = x ^ ones * '_';
 
+    uint64_t alpha = (lower - ones * 'a') & ~(lower - ones * ('z' + 1));
+    uint64_t digit = (y - ones * '0') & ~(y - ones * ('9' + 1));
 
-static int
-number_len(const lexer_t *in)
-{
-    uint32_t    i   = 0;
-    const char *str = in->curr;
+    under = ~(((under & low) + low) | under | low);
 
-    while (str[i])
-    {
-        if (isdigit(str[i]) || str[i] == '.')
-            ++i;
-        else
-            return i;
-    }
+    /* bytes with the high bit set aren't ascii */
+    return (~(alpha | digit | under) | x) & high;
+}
 
-    syntax_error(err_loc(in), "Unexpected end of file");
-    return 0;
+/* these don't depend on the locale, unlike ctype.h */
+static inline bool
+is_digit(char c)
+{
+    return c >= '0' && c <= '9';
 }
 
+static inline bool
+is_word_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || is_digit(c) || c == '_';
+}
 
-static uint32_t
-string_len(const lexer_t *in)
+/* a letter, '_' or a utf-8 encoded code point with the XID_Start property */
+static inline bool
+is_identifier_start(const char *ptr)
 {
-    uint32_t    i   = 0;
-    const char *str = in->curr;
+    uint32_t width;
 
-    while (str[i])
+    if ((uint8_t)*ptr < 0x80)
     {
-        if (str[i] != '"')
-            ++i;
-        else
-            return i;
+        return is_word_char(*ptr) && !is_digit(*ptr);
     }
 
-    syntax_error(err_loc(in), "Unexpected end of file inside string");
-    return 0;
+    return f_is_xid_start(f_utf8_decode(ptr, &width));
 }
 
-
+/* the rest of an identifier from its first non-ascii byte, which is rare enough that
+ * it's scanned a byte at a time, and hashed again as a whole */
 static uint32_t
-char_len(const lexer_t *in)
+unicode_identifier_len(const char *str, uint32_t len, uint32_t *hash)
 {
-    uint32_t    i       = 0;
-    uint32_t    slashes = 0;
-    const char *str     = in->curr;
+    uint32_t code_point;
+    uint32_t width;
 
-    while (str[i])
+    for (;;)
     {
-        if (str[i] == '\'')
+        if (is_word_char(str[len]))
         {
-            if (slashes == 1)
-            {
-                slashes = 0;
-                ++i;
-                continue;
-            }
-
-            return i;
+            ++len;
+            continue;
         }
-        else if (str[i] == '\\')
+
+        if ((uint8_t)str[len] < 0x80)
         {
-            ++slashes;
-            ++i;
+            break;
         }
-        else
+
+        code_point = f_utf8_decode(str + len, &width);
+
+        if (len == 0 ? !f_is_xid_start(code_point) : !f_is_xid_continue(code_point))
         {
-            slashes = 0;
-            ++i;
+            break;
         }
+
+        len += width;
     }
 
-    syntax_error(err_loc(in), "Unexpected end of file inside char literal");
+    *hash = atom_hash(str, len);
 
-    return 0;
+    return len;
 }
 
-
-static suffix_flags_t
-parse_suffix(lexer_t *lexer, uint32_t len)
+/* scans an identifier 8 bytes at a time, and hashes each word as it goes, the
+ * source padding makes it safe to read past the end. since every byte above ascii
+ * stops a word, plain ascii identifiers never get near the unicode tables */
+static uint32_t
+identifier_len(const char *str, uint32_t *hash)
 {
-    suffix_flags_t flags = 0;
-    uint32_t       i;
+    uint64_t h = ATOM_HASH_SEED;
+    uint64_t word;
+    uint64_t stop;
+    uint32_t len;
+    uint32_t n;
 
-    if (len > MAX_SUFFIX_LEN)
+    for (len = 0;; len += 8)
     {
-        syntax_error(err_loc(lexer), "invalid suffix");
-    }
+        memcpy(&word, str + len, 8);
 
-    for (i = 0; i < len; ++i)
-    {
-        switch (tolower(*lexer->curr))
+        stop = non_word_bytes(word);
+
+        if (stop)
         {
-        case 'u':
-            if (flags & SUFFIX_UNSIGNED)
-            {
-                syntax_error(err_loc(lexer), "invalid suffix");
-            }
-            else
-            {
-                flags |= SUFFIX_UNSIGNED;
-            }
             break;
+        }
 
-        case 'l':
-            if (flags & SUFFIX_LONG)
-            {
-                syntax_error(err_loc(lexer), "invalid suffix");
-            }
-            else
-            {
-                flags |= SUFFIX_LONG;
-            }
-            break;
+        h = atom_hash_word(h, word);
+    }
 
-        case 'f':
-            if (flags & SUFFIX_FLOAT)
-            {
-                syntax_error(err_loc(lexer), "invalid suffix");
-            }
-            else
-            {
-                flags |= SUFFIX_FLOAT;
-            }
-            break;
+    /* the number of bytes before the first stop byte */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    n = __builtin_clzll(stop) / 8;
 
-        default:
-            syntax_error(err_loc(lexer), "invalid suffix");
-            break;
-        }
+    if (n)
+    {
+        h = atom_hash_word(h, word & ~(~0ull >> (n * 8)));
     }
+#else
+    n = __builtin_ctzll(stop) / 8;
 
-    /* check for conflicts */
-    if (flags & SUFFIX_UNSIGNED || flags & SUFFIX_LONG)
+    if (n)
     {
-        if (flags & SUFFIX_FLOAT)
-        {
-            syntax_error(err_loc(lexer), "invalid suffix");
-        }
+        h = atom_hash_word(h, word & ((1ull << (n * 8)) - 1));
     }
+#endif
 
-    return flags;
-}
-
-
-static literal_t
-parse_decimal_constant(const char *str, uint32_t len)
-{
-    literal_t literal;
-    uint32_t  i     = 0;
-    int64_t   tmp   = 0;
-    double    d_tmp = 0;
-    double    k     = 0.1;
+    len += n;
 
-    while (i != len && str[i] != '.')
+    if ((uint8_t)str[len] >= 0x80)
     {
-        tmp = tmp * 10 + str[i] - '0';
-        ++i;
+        return unicode_identifier_len(str, len, hash);
     }
 
-    if (str[i] != '.')
-    {
-        literal.value._int = tmp;
-        /* @todo: check for size and dertermine if its 32 or 64 bit */
-        literal.type = LITERAL_TYPE_LONG;
+    *hash = atom_hash_finish(h, len);
 
-        return literal;
-    }
+    return len;
+}
 
-    ++i;
-    d_tmp = (double)tmp;
 
-    while (i != len)
+/* the end of a preprocessing number, which is a superset of the numeric constants,
+ * used to check that a whole number is loaded */
+static const char *
+number_end(const char *ptr)
+{
+    for (;; ++ptr)
     {
-        d_tmp += (str[i] - '0') * k;
-        k *= 0.1;
-        ++i;
-    }
+        if (is_word_char(*ptr) || *ptr == '.')
+        {
+            continue;
+        }
 
-    literal.value._float = d_tmp;
-    literal.type         = LITERAL_TYPE_DOUBLE;
+        if ((*ptr == '+' || *ptr == '-') && ((ptr[-1] | 0x20) == 'e' || (ptr[-1] | 0x20) == 'p'))
+        {
+            continue;
+        }
 
-    return literal;
+        return ptr;
+    }
 }
 
 
-static literal_t
-parse_octal_constant(const char *str, uint32_t len)
+/* location of a byte in the source, for errors inside a token */
+static err_location_t
+loc_at(const lexer_t *lexer, const char *ptr)
 {
-    literal_t literal;
-    uint32_t  i     = 0;
-    int64_t   tmp   = 0;
-    double    d_tmp = 0;
-    double    k     = 0.125;
+    err_location_t loc = { .source = (source_t *)&lexer->source,
+                           .offset = offset_of(lexer, ptr) };
+
+    return loc;
+}
+
 
-    while (i != len && str[i] != '.')
+/* appends a code point as utf-8 */
+static void
+push_utf8(vec_uint8_t *out, uint32_t c)
+{
+    if (c < 0x80)
     {
-        tmp = tmp * 8 + str[i] - '0';
-        ++i;
+        vec_uint8_t_push(out, c);
     }
-
-    if (str[i] != '.')
+    else if (c < 0x800)
+    {
+        vec_uint8_t_push(out, 0xc0 | c >> 6);
+        vec_uint8_t_push(out, 0x80 | (c & 0x3f));
+    }
+    else if (c < 0x10000)
     {
-        literal.value._int = tmp;
-        literal.type       = LITERAL_TYPE_LONG;
-        return literal;
+        vec_uint8_t_push(out, 0xe0 | c >> 12);
+        vec_uint8_t_push(out, 0x80 | (c >> 6 & 0x3f));
+        vec_uint8_t_push(out, 0x80 | (c & 0x3f));
     }
+    else
+    {
+        vec_uint8_t_push(out, 0xf0 | c >> 18);
+        vec_uint8_t_push(out, 0x80 | (c >> 12 & 0x3f));
+        vec_uint8_t_push(out, 0x80 | (c >> 6 & 0x3f));
+        vec_uint8_t_push(out, 0x80 | (c & 0x3f));
+    }
+}
 
-    ++i;
-    d_tmp = (double)tmp;
 
-    while (i != len)
+static inline uint32_t
+hex_digit_value(char c)
+{
+    if (c >= '0' && c <= '9')
     {
-        d_tmp += (str[i] - '0') * k;
-        k *= 0.125;
-        ++i;
+        return c - '0';
+    }
+
+    if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+    {
+        return (c | 0x20) - 'a' + 10;
     }
 
-    literal.value._float = d_tmp;
-    literal.type         = LITERAL_TYPE_DOUBLE;
+    return 16;
+}
+
 
-    return literal;
+/* the value of a single character escape, or 0 if it isn't one */
+static char
+simple_escape(char c)
+{
+    switch (c)
+    {
+    case 'a':
+        return '\a';
+    case 'b':
+        return '\b';
+    case 'f':
+        return '\f';
+    case 'n':
+        return '\n';
+    case 'r':
+        return '\r';
+    case 't':
+        return '\t';
+    case 'v':
+        return '\v';
+    case '\\':
+    case '\'':
+    case '"':
+    case '?':
+        return c;
+    default:
+        return 0;
+    }
 }
 
 
-static literal_t
-parse_hex_constant(const char *str, uint32_t len)
+/* decodes the escape sequence after a backslash into 'out', and returns the first
+ * byte after it */
+static const char *
+decode_escape(const lexer_t *lexer, const char *ptr, vec_uint8_t *out)
 {
-    literal_t literal;
-    uint32_t  i   = 0;
-    int64_t   tmp = 0;
+    uint32_t value = 0;
+    uint32_t digit;
+    uint32_t i;
+    uint32_t len;
+    char     c;
+
+    if ((c = simple_escape(*ptr)))
+    {
+        vec_uint8_t_push(out, c);
+        return ptr + 1;
+    }
 
-    while (i != len)
+    switch (*ptr)
     {
-        if (str[i] >= 'a' && str[i] <= 'f')
+    /* up to 3 octal digits */
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+        for (i = 0; i < 3 && *ptr >= '0' && *ptr <= '7'; ++i, ++ptr)
         {
-            tmp = tmp * 16 + str[i] - 0x57;
+            value = value * 8 + *ptr - '0';
         }
-        else if (str[i] >= 'A' && str[i] <= 'F')
+
+        if (value > 0xff)
         {
-            tmp = tmp * 16 + str[i] - 0x37;
+            syntax_warning(loc_at(lexer, ptr), "octal escape sequence out of range");
         }
-        else
+
+        vec_uint8_t_push(out, value);
+        return ptr;
+
+    /* any number of hex digits */
+    case 'x':
+        if (hex_digit_value(ptr[1]) == 16)
         {
-            tmp = tmp * 16 + str[i] - '0';
+            syntax_error(loc_at(lexer, ptr), "\\x used with no following hex digits");
+        }
+
+        for (++ptr; (digit = hex_digit_value(*ptr)) < 16; ++ptr)
+        {
+            value = value > 0xff ? value : value * 16 + digit;
         }
-        ++i;
-    }
 
-    literal.value._int = tmp;
-    literal.type       = LITERAL_TYPE_LONG;
+        if (value > 0xff)
+        {
+            syntax_warning(loc_at(lexer, ptr), "hex escape sequence out of range");
+        }
 
-    // @todo: add floating point hex literals
+        vec_uint8_t_push(out, value);
+        return ptr;
 
-    return literal;
-}
+    /* universal character names are stored as utf-8 */
+    case 'u':
+    case 'U':
+        len = *ptr == 'u' ? 4 : 8;
 
+        for (i = 1; i <= len; ++i)
+        {
+            if ((digit = hex_digit_value(ptr[i])) == 16)
+            {
+                syntax_error(loc_at(lexer, ptr), "incomplete universal character name");
+            }
 
-static void
-parse_string_literal(const char *str, uint32_t len, char *buffer)
-{
-}
+            value = value * 16 + digit;
+        }
 
+        if (value > 0x10ffff || (value >= 0xd800 && value <= 0xdfff))
+        {
+            syntax_error(loc_at(lexer, ptr), "invalid universal character");
+        }
 
-static int32_t
-parse_multichar_constant(const lexer_t *in, uint32_t len)
-{
-    syntax_warning(err_loc(in), "multi-character constant");
+        push_utf8(out, value);
+        return ptr + len + 1;
 
-    if (len >= 6)
-    {
-        syntax_warning(err_loc(in), "multi-character constant is too long");
+    default:
+        syntax_warning(loc_at(lexer, ptr), "unknown escape sequence '\\%c'", *ptr);
+        vec_uint8_t_push(out, *ptr);
+        return ptr + 1;
     }
-
-    return in->curr[len - 1];
 }
 
 
-static uint32_t
-parse_char_literal(const lexer_t *lexer, uint32_t len)
+/* decodes the body of a string literal, starting after the opening quote, into
+ * 'out', and returns the closing quote */
+static const char *
+decode_string(lexer_t *lexer, const char *ptr, vec_uint8_t *out)
 {
-    const char *str = lexer->curr;
+    const char *run;
 
-    switch (len)
+    for (;;)
     {
-    case 1:
-        return str[0];
-    case 2:
-        if (str[0] == '\\')
+        /* copy everything up to the next special byte at once */
+        run = ptr;
+
+        while (*ptr != '"' && *ptr != '\\' && *ptr != '\n' && *ptr != '\0')
         {
-            switch (str[1])
-            {
-            case 'a':
-                return '\a';
-            case 'b':
-                return '\b';
-            case 'f':
-                return '\f';
-            case 'r':
-                return '\r';
-            case 'n':
-                return '\n';
-            case 't':
-                return '\t';
-            case 'v':
-                return '\v';
-            case '\\':
-                return '\\';
-            case '\'':
-                return '\'';
-
-            case '0':
-            case '1':
-            case '2':
-            case '3':
-            case '4':
-            case '5':
-            case '6':
-            case '7':
-                return parse_octal_constant(str + 1, len - 1).value._int;
-            case 'x':
-                return parse_hex_constant(str + 2, len - 2).value._int;
-            default:
-                syntax_error(err_loc(lexer), "Invalid escape sequence");
-            }
+            ++ptr;
         }
-        else
-            return parse_multichar_constant(lexer, len);
-        break;
 
-    case 3:
-    case 4:
-        if (str[0] == '\\')
+        if (ptr != run)
         {
-            switch (str[1])
+            if (out->size + (ptr - run) > out->capacity)
             {
-            case '0':
-            case '1':
-            case '2':
-            case '3':
-            case '4':
-            case '5':
-            case '6':
-            case '7':
-                return parse_octal_constant(str + 1, len - 1).value._int;
-            case 'x':
-                return parse_hex_constant(str + 2, len - 2).value._int;
-            case 'u':
-                syntax_error(err_loc(lexer), "Unicode is yet to be implemented");
-                return 0;
-            default:
-                syntax_error(err_loc(lexer), "Invalid escape sequence");
-                return 0;
+                vec_uint8_t_reserve(out, (out->size + (ptr - run)) * 2);
             }
+
+            memcpy(out->data + out->size, run, ptr - run);
+            out->size += ptr - run;
         }
-        else
-            return parse_multichar_constant(lexer, len);
-        break;
 
-    case 8:
-        if (str[0] == '\\')
+        switch (*ptr)
         {
-            if (str[1] == 'U')
+        case '"':
+            return ptr;
+
+        case '\\':
+            /* escapes are short, and are never split between chunks */
+            if (lexer->source.end - ptr < LEXER_LOOKAHEAD && !lexer->source.eof)
             {
-                syntax_error(err_loc(lexer), "Unicode is yet to be implemented");
+                ptr += refill(lexer, ptr);
             }
-        }
-        else
-        {
-            return parse_multichar_constant(lexer, len);
-        }
-        break;
 
-    default:
-        return parse_multichar_constant(lexer, len);
-    }
+            ptr = decode_escape(lexer, ptr + 1, out);
+            break;
+
+        case '\0':
+            if (needs_refill(lexer, ptr))
+            {
+                ptr += refill(lexer, ptr);
+                break;
+            }
+
+            /* a '\0' inside the file is kept like any other byte */
+            if (ptr < lexer->source.end)
+            {
+                vec_uint8_t_push(out, '\0');
+                ++ptr;
+                break;
+            }
 
-    assert(false);
-    return 0;
+            syntax_error(loc_at(lexer, ptr), "Unexpected end of file inside string");
+            return ptr;
+
+        default:
+            syntax_error(loc_at(lexer, ptr), "missing terminating '\"' character");
+            return ptr;
+        }
+    }
 }
 
 
-/* lookup table with pre hashed values for keywords */
-static token_type_t
-lookup_keyword(sym_hash_t hash, uint32_t len)
-{
-    switch (len)
-    {
-    case 2:
-        if (hash == 210805918999320793)
-            return TOK_KEY_IF;
-        if (hash == 3416275755843533644)
-            return TOK_KEY_DO;
-        break;
-
-    case 3:
-        if (hash == 7858283700166231528)
-            return TOK_KEY_INT;
-        if (hash == 691152041897930411)
-            return TOK_KEY_FOR;
-        break;
-
-    case 4:
-        if (hash == 611863941455303809)
-            return TOK_KEY_ELSE;
-        if (hash == 1427961834693360368)
-            return TOK_KEY_ENUM;
-        if (hash == 4089114412274189689)
-            return TOK_KEY_CHAR;
-        if (hash == 1765111298423762854)
-            return TOK_KEY_CASE;
-        if (hash == 4396619338160439502)
-            return TOK_KEY_LONG;
-        if (hash == 7255839161879393319)
-            return TOK_KEY_VOID;
-        if (hash == 8715651464562445227)
-            return TOK_KEY_GOTO;
-        break;
-
-    case 5:
-        if (hash == 3875119015612757251)
-            return TOK_KEY_WHILE;
-        if (hash == 2807200987411122317)
-            return TOK_KEY_FLOAT;
-        if (hash == 1402861911904202446)
-            return TOK_KEY_SHORT;
-        if (hash == 5471028013491099405)
-            return TOK_KEY_CONST;
-        if (hash == 9152775002878652110)
-            return TOK_KEY_BREAK;
-        if (hash == 270728114491518239)
-            return TOK_KEY_UNION;
-        break;
-
-    case 6:
-        if (hash == 7727572673835008135)
-            return TOK_KEY_EXTERN;
-        if (hash == 2646967638904444428)
-            return TOK_KEY_SWITCH;
-        if (hash == 5693220595859545018)
-            return TOK_KEY_STRUCT;
-        if (hash == 7489007233736309326)
-            return TOK_KEY_STATIC;
-        if (hash == 884287416668004567)
-            return TOK_KEY_SIZEOF;
-        if (hash == 3510987647836465774)
-            return TOK_KEY_SIGNED;
-        if (hash == 3362893395776512250)
-            return TOK_KEY_RETURN;
-        if (hash == 7342538386031234340)
-            return TOK_KEY_DOUBLE;
-        break;
-
-    case 7:
-        if (hash == 2936402720817092402)
-            return TOK_KEY_DEFAULT;
-        if (hash == 3794314392136692499)
-            return TOK_KEY_TYPEDEF;
-        break;
-
-    case 8:
-        if (hash == 3631951867840661473)
-            return TOK_KEY_CONTINUE;
-        if (hash == 7202289517847671133)
-            return TOK_KEY_REGISTER;
-        if (hash == 2298029417117381043)
-            return TOK_KEY_UNSIGNED;
-        if (hash == 8161154796913793944)
-            return TOK_KEY_VOLATILE;
-        break;
-    }
-
-    return TOK_IDENTIFIER;
+/* decodes a string literal. adjacent literals are separate tokens here, the
+ * preprocessor joins them once macros are expanded */
+static void
+lex_string(lexer_t *lexer, token_t *token)
+{
+    string_table_t *strings = &lexer->strings;
+    const char *    end;
+
+    strings->buffer.size = 0;
+
+    end = decode_string(lexer, lexer->curr + 1, &strings->buffer) + 1;
+
+    advance(lexer, end);
+
+    token->type         = TOK_LITERAL;
+    token->len          = offset_of(lexer, end) - token->offset;
+    token->literal.type = LITERAL_TYPE_STR;
+
+    token->literal.value.str.size = strings->buffer.size;
+    token->literal.value.str.data =
+        f_intern_string(strings, (const char *)strings->buffer.data, strings->buffer.size);
 }
 
 
-static token_type_t
-lookup_symbol(const char *str, uint32_t *symbol_len)
+/* the length of the body of a character constant, up to the closing quote */
+static uint32_t
+char_len(lexer_t *in)
 {
-    switch (*str)
+    uint32_t    i       = 0;
+    bool        escaped = false;
+    const char *str     = in->curr;
+
+    for (;;)
     {
-    case '+':
-        if (str[1] == '=')
+        if (!str[i])
         {
-            *symbol_len = 2;
-            return TOK_PLUS_ASSIGN;
+            if (!needs_refill(in, str + i))
+            {
+                break;
+            }
+
+            refill(in, str);
+            str = in->curr;
+            continue;
         }
-        else if (str[1] == '+')
+
+        if (str[i] == '\n')
+        {
+            syntax_error(loc_at(in, str + i), "missing terminating ' character");
+        }
+
+        if (str[i] == '\'' && !escaped)
+        {
+            return i;
+        }
+
+        escaped = str[i] == '\\' && !escaped;
+        ++i;
+    }
+
+    syntax_error(err_loc(in), "Unexpected end of file inside char literal");
+}
+
+
+/* the value of a character constant of 'len' bytes at 'curr', its escapes are decoded the
+ * same as those of strings. a constant of more than one char has them all, the first in
+ * the highest byte, the same as gcc */
+static int32_t
+parse_char_literal(lexer_t *lexer, uint32_t len)
+{
+    vec_uint8_t *buffer = &lexer->strings.buffer;
+    const char * ptr    = lexer->curr;
+    const char * end    = ptr + len;
+    uint32_t     value  = 0;
+    uint32_t     i;
+
+    if (len == 0)
+    {
+        syntax_error(err_loc(lexer), "empty character constant");
+    }
+
+    buffer->size = 0;
+
+    while (ptr < end)
+    {
+        if (*ptr == '\\')
+        {
+            ptr = decode_escape(lexer, ptr + 1, buffer);
+        }
+        else
+        {
+            vec_uint8_t_push(buffer, *ptr++);
+        }
+    }
+
+    if (buffer->size == 1)
+    {
+        return (signed char)buffer->data[0];
+    }
+
+    syntax_warning(err_loc(lexer), "multi-character constant");
+
+    if (buffer->size > 4)
+    {
+        syntax_warning(err_loc(lexer), "multi-character constant is too long");
+    }
+
+    for (i = 0; i < buffer->size; ++i)
+    {
+        value = value << 8 | buffer->data[i];
+    }
+
+    return (int32_t)value;
+}
+
+
+typedef struct keyword_entry
+{
+    token_type_t type;
+    uint32_t     len;
+
+    /* the spelling and a mask of the bytes used, as it is laid out in memory */
+    uint64_t word[2];
+    uint64_t mask[2];
+
+} keyword_entry_t;
+
+typedef struct punctuator_extension
+{
+    char     byte;
+    uint16_t entry;
+
+} punctuator_extension_t;
+
+/* the keyword table is a minimal perfect hash, and the punctuators are a table
+ * indexed by their first two bytes, both made by tools/gen_lexer_tables.c */
+#include "f_lexer_tables.h"
+
+
+/* the hash is computed from the first and last byte and the length, which is unique
+ * for every keyword, the spelling is then checked with a masked compare */
+static token_type_t
+lookup_keyword(const char *str, uint32_t len)
+{
+    const keyword_entry_t *entry;
+    uint64_t               words[KEYWORD_WORDS];
+    uint32_t               h;
+    uint32_t               slot;
+
+    if (len < KEYWORD_MIN_LEN || len > KEYWORD_MAX_LEN)
+    {
+        return TOK_IDENTIFIER;
+    }
+
+    h    = ((uint8_t)str[0] | (uint8_t)str[len - 1] << 8 | len << 16) * KEYWORD_SEED;
+    slot = ((uint64_t)((h << KEYWORD_BUCKET_BITS) ^ keyword_disp[h >> (32 - KEYWORD_BUCKET_BITS)]) *
+            KEYWORD_COUNT) >>
+           32;
+
+    entry = &keyword_table[slot];
+
+    /* the source is padded, so we can read past the end of the word */
+    memcpy(words, str, sizeof(words));
+
+    if (entry->len != len || (words[0] & entry->mask[0]) != entry->word[0])
+    {
+        return TOK_IDENTIFIER;
+    }
+
+#if KEYWORD_WORDS == 2
+    if ((words[1] & entry->mask[1]) != entry->word[1])
+    {
+        return TOK_IDENTIFIER;
+    }
+#endif
+
+    return entry->type;
+}
+
+
+/* the punctuator at 'str', anything else is TOK_UNKNOWN, and the sentinel
+ * is TOK_EOF. the entry holds both the type and the length */
+static token_type_t
+lookup_symbol(const char *str, uint32_t *symbol_len)
+{
+    uint16_t entry = punctuator_table[punctuator_row[(uint8_t)str[0]]
+                                      + punctuator_column[(uint8_t)str[1]]];
+
+    /* "<<=", ">>=" and "...", where the third byte gives another entry */
+    if (entry >> 10 && str[2] == punctuator_extensions[entry >> 10].byte)
+    {
+        entry = punctuator_extensions[entry >> 10].entry;
+    }
+
+    *symbol_len = (entry >> 8) & 3;
+    return entry & 0xff;
+}
+
+
+/* ================================================================================= */
+
+/* location of the current position in the source, the source is only
+ * modified when the line table is built, so the cast is fine */
+err_location_t
+err_loc(const lexer_t *lexer)
+{
+    err_location_t loc = { .source = (source_t *)&lexer->source,
+                           .offset = offset_of(lexer, lexer->curr) };
+
+    return loc;
+}
+
+
+err_location_t
+f_token_loc(const lexer_t *lexer, const token_t *token)
+{
+    const source_t *source = token->source_id ? f_pp_source(lexer->pp, token->source_id) : &lexer->source;
+    err_location_t  loc    = { .source = (source_t *)source, .offset = token->offset };
+
+    return loc;
+}
+
+
+void
+f_create_lexer(lexer_t *lexer, const char *filename)
+{
+    source_t source;
+
+    /* the source is mapped and padded with zeroes,
+     * so tokens can point directly into it */
+    source_open(&source, filename);
+
+    f_create_lexer_from_source(lexer, &source);
+}
+
+
+void
+f_create_lexer_from_source(lexer_t *lexer, const source_t *source)
+{
+    lexer->source = *source;
+    scan_init();
+
+    f_create_string_table(&lexer->strings);
+
+    lexer->curr     = lexer->source.start;
+    lexer->buffered    = false;
+    lexer->pos         = 0;
+    lexer->defer_atoms = false;
+    lexer->cache_dir   = NULL;
+    lexer->pipelined   = false;
+    lexer->ring        = NULL;
+    lexer->pp          = NULL;
+
+    memset(&lexer->last_token, 0, sizeof(token_t));
+    memset(&lexer->curr_token, 0, sizeof(token_t));
+    memset(&lexer->next_token, 0, sizeof(token_t));
+
+    /* fill both the current and the next token */
+    f_next_token(lexer);
+    f_next_token(lexer);
+}
+
+
+/* scans the token at the current position */
+static void
+lex_token(lexer_t *lexer, token_t *token)
+{
+    char           c;
+    uint32_t       token_len;
+    uint32_t       hash;
+
+    c = skip_whitespace_and_comments(lexer);
+
+    token->offset = offset_of(lexer, lexer->curr);
+    token->source_id = 0;
+
+    if (is_identifier_start(lexer->curr))
+    {
+        token_len = identifier_len(lexer->curr, &hash);
+
+        /* the identifier may go on in the next chunk of a stream */
+        while (needs_refill(lexer, lexer->curr + token_len))
+        {
+            refill(lexer, lexer->curr);
+            token_len = identifier_len(lexer->curr, &hash);
+        }
+
+        token->type = lookup_keyword(lexer->curr, token_len);
+
+        if (token->type == TOK_IDENTIFIER)
+        {
+            token->atom = lexer->defer_atoms ? hash
+                                             : atom_intern_hashed(lexer->curr, token_len, hash);
+        }
+
+        skip(lexer, token_len);
+    }
+    else if (is_digit(c) || (c == '.' && is_digit(lexer->curr[1])))
+    {
+        while (needs_refill(lexer, number_end(lexer->curr)))
+        {
+            refill(lexer, lexer->curr);
+        }
+
+        token->type = TOK_LITERAL;
+        token_len   = f_parse_number(lexer->curr, &token->literal, err_loc(lexer));
+
+        skip(lexer, token_len);
+    }
+    else if (c == '"')
+    {
+        /* sets the length itself, since it may have been refilled past the end */
+        lex_string(lexer, token);
+        return;
+    }
+    else if (c == '\'')
+    {
+        token->type = TOK_LITERAL;
+
+        next(lexer);
+        token_len = char_len(lexer);
+
+        /* get value */
+        token->literal.value._int = parse_char_literal(lexer, token_len);
+
+        token->literal.type = LITERAL_TYPE_INT;
+
+        skip(lexer, token_len + 1);
+    }
+    else
+    {
+        token->type = lookup_symbol(lexer->curr, &token_len);
+        skip(lexer, token_len);
+    }
+
+    token->len = offset_of(lexer, lexer->curr) - token->offset;
+}
+
+
+/* ================================================================================= */
+/* token buffer */
+
+static bool
+has_payload(token_type_t type)
+{
+    return type == TOK_IDENTIFIER || type == TOK_LITERAL;
+}
+
+
+void
+f_create_token_buffer(token_buffer_t *buffer, uint32_t capacity)
+{
+    buffer->types    = vec_uint8_t_create(capacity);
+    buffer->offsets  = vec_uint32_t_create(capacity);
+    buffer->payloads = vec_uint32_t_create(capacity);
+    buffer->values   = vec_token_payload_t_create(capacity / 2 + 1);
+}
+
+
+void
+f_destroy_token_buffer(token_buffer_t *buffer)
+{
+    vec_uint8_t_destroy(&buffer->types);
+    vec_uint32_t_destroy(&buffer->offsets);
+    vec_uint32_t_destroy(&buffer->payloads);
+    vec_token_payload_t_destroy(&buffer->values);
+}
+
+
+void
+f_push_token(token_buffer_t *buffer, const token_t *token)
+{
+    token_payload_t value;
+
+    vec_uint8_t_push(&buffer->types, token->type);
+    vec_uint32_t_push(&buffer->offsets, token->offset);
+
+    if (has_payload(token->type))
+    {
+        value.len = token->len;
+
+        if (token->type == TOK_IDENTIFIER)
         {
-            *symbol_len = 2;
-            return TOK_INCREASE;
+            value.atom = token->atom;
         }
-        *symbol_len = 1;
-        return TOK_PLUS;
-    case '-':
-        if (str[1] == '=')
+        else
         {
-            *symbol_len = 2;
-            return TOK_MINUS_ASSIGN;
+            value.literal = token->literal;
         }
-        else if (str[1] == '-')
+
+        vec_uint32_t_push(&buffer->payloads, buffer->values.size);
+        vec_token_payload_t_push(&buffer->values, value);
+    }
+    else
+    {
+        vec_uint32_t_push(&buffer->payloads, token->len);
+    }
+}
+
+
+/* rebuilds the token at 'index', indices before the first token gives a null token,
+ * and indices after the last gives the last token (which is always EOF) */
+token_t
+f_token_at(const token_buffer_t *buffer, int64_t index)
+{
+    token_t                token = { .type = TOK_NULL };
+    const token_payload_t *value;
+
+    if (index < 0 || buffer->types.size == 0)
+    {
+        return token;
+    }
+
+    if (index >= (int64_t)buffer->types.size)
+    {
+        index = buffer->types.size - 1;
+    }
+
+    token.type   = buffer->types.data[index];
+    token.offset = buffer->offsets.data[index];
+
+    if (has_payload(token.type))
+    {
+        value     = &buffer->values.data[buffer->payloads.data[index]];
+        token.len = value->len;
+
+        if (token.type == TOK_IDENTIFIER)
+        {
+            token.atom = value->atom;
+        }
+        else
+        {
+            token.literal = value->literal;
+        }
+    }
+    else
+    {
+        token.len = buffer->payloads.data[index];
+    }
+
+    return token;
+}
+
+
+/* ================================================================================= */
+/* pipelined lexing */
+
+/* must be a power of two */
+#define LEXER_RING_SIZE 4096
+#define CACHE_LINE_SIZE 64
+
+/*
+ * a single producer, single consumer queue of tokens. each side keeps its index on
+ * a cache line of its own, together with the last value it saw of the other index,
+ * so the other side's line is only read when the ring looks full or empty
+ */
+typedef struct token_ring
+{
+    token_t tokens[LEXER_RING_SIZE];
+
+    pthread_t thread;
+    lexer_t * lexer;
+
+    /* written by the lexer thread */
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint32_t head;
+    uint32_t                                   known_tail;
+
+    /* written by the parser */
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint32_t tail;
+    uint32_t                                   known_head;
+
+    /* tells the lexer thread to give up, when the lexer is destroyed early */
+    _Alignas(CACHE_LINE_SIZE) atomic_bool quit;
+
+} token_ring_t;
+
+
+/* returns false if the lexer thread should quit */
+static bool
+ring_push(token_ring_t *ring, const token_t *token)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    while (head - ring->known_tail == LEXER_RING_SIZE)
+    {
+        if (atomic_load_explicit(&ring->quit, memory_order_relaxed))
+        {
+            return false;
+        }
+
+        ring->known_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+        if (head - ring->known_tail == LEXER_RING_SIZE)
+        {
+            sched_yield();
+        }
+    }
+
+    ring->tokens[head & (LEXER_RING_SIZE - 1)] = *token;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    return true;
+}
+
+
+static token_t
+ring_pop(token_ring_t *ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    token_t  token;
+
+    while (tail == ring->known_head)
+    {
+        ring->known_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        if (tail == ring->known_head)
+        {
+            sched_yield();
+        }
+    }
+
+    token = ring->tokens[tail & (LEXER_RING_SIZE - 1)];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    return token;
+}
+
+
+/*
+ * lexes until EOF, or the first diagnostic. then it pushes a TOK_NULL token at the
+ * start of the token which caused it, and the parser lexes that token again itself,
+ * so the diagnostic is reported after everything the parser reports before it
+ */
+static void *
+lex_ahead(void *arg)
+{
+    token_ring_t *    ring  = arg;
+    lexer_t *         lexer = ring->lexer;
+    volatile uint32_t start = offset_of(lexer, lexer->curr);
+    err_trap_t        trap;
+    token_t           token;
+
+    trap.count = 0;
+
+    if (setjmp(trap.env))
+    {
+        err_set_trap(NULL);
+
+        memset(&token, 0, sizeof(token_t));
+        token.offset = start;
+
+        ring_push(ring, &token);
+        return NULL;
+    }
+
+    err_set_trap(&trap);
+
+    do
+    {
+        start = offset_of(lexer, lexer->curr);
+        lex_token(lexer, &token);
+
+        /* a warning */
+        if (trap.count)
+        {
+            memset(&token, 0, sizeof(token_t));
+            token.offset = start;
+        }
+
+        if (!ring_push(ring, &token))
+        {
+            break;
+        }
+
+    } while (token.type != TOK_EOF && token.type != TOK_NULL);
+
+    err_set_trap(NULL);
+
+    return NULL;
+}
+
+
+void
+f_lexer_pipeline(lexer_t *lexer)
+{
+    token_ring_t *ring;
+
+    assert(!lexer->buffered && !lexer->pipelined && !lexer->source.stream);
+
+    /* the threads would only take turns */
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2)
+    {
+        return;
+    }
+
+    ring = aligned_alloc(CACHE_LINE_SIZE, sizeof(token_ring_t));
+
+    if (!ring)
+    {
+        fatal_error("out of memory");
+    }
+
+    ring->lexer      = lexer;
+    ring->known_tail = 0;
+    ring->known_head = 0;
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->quit, false);
+
+    /* the parser interns the identifiers, since the atom table isn't shared */
+    lexer->defer_atoms = true;
+    lexer->pipelined   = true;
+    lexer->ring        = ring;
+
+    if (pthread_create(&ring->thread, NULL, lex_ahead, ring) != 0)
+    {
+        fatal_error("failed to start a lexer thread");
+    }
+}
+
+
+/* waits for the lexer thread, which 'curr' then belongs to again */
+static void
+stop_pipeline(lexer_t *lexer)
+{
+    atomic_store_explicit(&lexer->ring->quit, true, memory_order_relaxed);
+    pthread_join(lexer->ring->thread, NULL);
+
+    free(lexer->ring);
+
+    lexer->defer_atoms = false;
+    lexer->pipelined   = false;
+    lexer->ring        = NULL;
+}
+
+
+static token_t
+next_piped_token(lexer_t *lexer)
+{
+    token_t token = ring_pop(lexer->ring);
+
+    if (token.type == TOK_IDENTIFIER)
+    {
+        token.atom = atom_intern_hashed(lexer->source.start + token.offset, token.len, token.atom);
+    }
+    else if (token.type == TOK_EOF)
+    {
+        stop_pipeline(lexer);
+    }
+    else if (token.type == TOK_NULL)
+    {
+        /* lexing it here reports the diagnostic, or exits on an error */
+        stop_pipeline(lexer);
+
+        lexer->curr = lexer->source.start + token.offset;
+        lex_token(lexer, &token);
+
+        if (token.type != TOK_EOF)
+        {
+            f_lexer_pipeline(lexer);
+        }
+    }
+
+    return token;
+}
+
+
+void
+f_destroy_lexer(lexer_t *lexer)
+{
+    if (lexer->pipelined)
+    {
+        stop_pipeline(lexer);
+    }
+
+    source_close(&lexer->source);
+
+    if (lexer->buffered)
+    {
+        f_destroy_token_buffer(&lexer->tokens);
+        lexer->buffered = false;
+    }
+
+    f_destroy_string_table(&lexer->strings);
+
+    lexer->curr = NULL;
+}
+
+
+/* ================================================================================= */
+
+void
+f_lex_token(lexer_t *lexer, token_t *token)
+{
+    lex_token(lexer, token);
+}
+
+
+/* with a preprocessor, 'pos' is one less than the index of the last token read
+ * from the buffer, instead of the index of curr_token */
+token_t
+f_next_raw_token(lexer_t *lexer)
+{
+    token_t token;
+
+    if (lexer->buffered)
+    {
+        ++lexer->pos;
+        token = f_token_at(&lexer->tokens, (int64_t)lexer->pos + 1);
+    }
+    else if (lexer->pipelined)
+    {
+        token = next_piped_token(lexer);
+    }
+    else
+    {
+        lex_token(lexer, &token);
+    }
+
+    return token;
+}
+
+
+token_t
+f_next_token(lexer_t *lexer)
+{
+    lexer->last_token = lexer->curr_token;
+    lexer->curr_token = lexer->next_token;
+
+    if (lexer->pp)
+    {
+        lexer->next_token = f_pp_next_token(lexer->pp);
+    }
+    else
+    {
+        lexer->next_token = f_next_raw_token(lexer);
+    }
+
+    return lexer->curr_token;
+}
+
+
+/* ================================================================================= */
+/* parallel lexing */
+
+/* files smaller than this are lexed on one thread, and no chunk is smaller */
+#define LEXER_PARALLEL_MIN_CHUNK (1 << 20)
+#define LEXER_PARALLEL_MAX_CHUNKS 64
+
+typedef struct lex_chunk
+{
+    /* a copy of the main lexer, sharing the source */
+    lexer_t   lexer;
+    pthread_t thread;
+
+    /* the chunk starts after a newline, tokens starting in [begin, end) belong to it */
+    uint32_t begin;
+    uint32_t end;
+
+    /* offset of the first token at or after 'end', where the next chunk takes over */
+    uint32_t exit;
+
+    /* a diagnostic was hit, which may be caused by starting in a comment */
+    bool failed;
+
+} lex_chunk_t;
+
+
+/* lexes the tokens starting in [begin, end) into the lexer's token buffer, and
+ * returns the offset of the first one after, EOF is lexed by the chunk which reaches it */
+static uint32_t
+lex_range(lexer_t *lexer, uint32_t begin, uint32_t end)
+{
+    token_t token;
+
+    lexer->curr = lexer->source.start + begin;
+
+    for (;;)
+    {
+        skip_whitespace_and_comments(lexer);
+
+        if (offset_of(lexer, lexer->curr) >= end && lexer->curr < lexer->source.end)
         {
-            *symbol_len = 2;
-            return TOK_DECREASE;
+            return offset_of(lexer, lexer->curr);
         }
-        else if (str[1] == '>')
+
+        lex_token(lexer, &token);
+        f_push_token(&lexer->tokens, &token);
+
+        if (token.type == TOK_EOF)
         {
-            *symbol_len = 2;
-            return TOK_ARROW;
+            return offset_of(lexer, lexer->source.end);
         }
-        *symbol_len = 1;
-        return TOK_MINUS;
-    case '/':
-        if (str[1] == '=')
+    }
+}
+
+
+/* the same as lex_range, but returns false instead of reporting a diagnostic */
+static bool
+try_lex_range(lexer_t *lexer, uint32_t begin, uint32_t end, uint32_t *exit)
+{
+    err_trap_t trap;
+
+    trap.count = 0;
+
+    if (setjmp(trap.env))
+    {
+        err_set_trap(NULL);
+        return false;
+    }
+
+    err_set_trap(&trap);
+    *exit = lex_range(lexer, begin, end);
+    err_set_trap(NULL);
+
+    return trap.count == 0;
+}
+
+
+static void *
+lex_chunk(void *arg)
+{
+    lex_chunk_t *chunk = arg;
+
+    chunk->failed = !try_lex_range(&chunk->lexer, chunk->begin, chunk->end, &chunk->exit);
+
+    return NULL;
+}
+
+
+/* index of the first token starting at or after 'offset', searching from 'from' */
+static uint32_t
+first_token_from(const token_buffer_t *tokens, uint32_t from, uint32_t offset)
+{
+    uint32_t low  = from;
+    uint32_t high = tokens->offsets.size;
+    uint32_t mid;
+
+    while (low < high)
+    {
+        mid = low + (high - low) / 2;
+
+        if (tokens->offsets.data[mid] < offset)
         {
-            *symbol_len = 2;
-            return TOK_DIV_ASSIGN;
+            low = mid + 1;
         }
-        *symbol_len = 1;
-        return TOK_DIV;
-    case '*':
-        if (str[1] == '=')
+        else
         {
-            *symbol_len = 2;
-            return TOK_STAR_ASSIGN;
+            high = mid;
         }
-        *symbol_len = 1;
-        return TOK_STAR;
-    case '%':
-        if (str[1] == '=')
+    }
+
+    return low;
+}
+
+
+/* index of the token starting at 'offset', searching from 'from', or -1 if there is none */
+static int64_t
+find_token(const token_buffer_t *tokens, uint32_t from, uint32_t offset)
+{
+    uint32_t index = first_token_from(tokens, from, offset);
+
+    if (index < tokens->offsets.size && tokens->offsets.data[index] == offset)
+    {
+        return index;
+    }
+
+    return -1;
+}
+
+
+/* moves the tokens of a chunk from 'first' and on to the main lexer, interning the
+ * identifiers and strings, which the chunk couldn't do in the shared tables */
+static void
+append_chunk(lexer_t *lexer, const lex_chunk_t *chunk, uint32_t first)
+{
+    const token_buffer_t *tokens = &chunk->lexer.tokens;
+    token_t               token;
+    uint32_t              i;
+
+    for (i = first; i < tokens->types.size; ++i)
+    {
+        token = f_token_at(tokens, i);
+
+        if (token.type == TOK_IDENTIFIER)
         {
-            *symbol_len = 2;
-            return TOK_MOD_ASSIGN;
+            token.atom = atom_intern_hashed(lexer->source.start + token.offset, token.len, token.atom);
         }
-        *symbol_len = 1;
-        return TOK_MOD;
-    case '=':
-        if (str[1] == '=')
+        else if (token.type == TOK_LITERAL && token.literal.type == LITERAL_TYPE_STR)
         {
-            *symbol_len = 2;
-            return TOK_EQUAL;
+            token.literal.value.str.data = f_intern_string(&lexer->strings,
+                                                           token.literal.value.str.data,
+                                                           token.literal.value.str.size);
         }
-        *symbol_len = 1;
-        return TOK_ASSIGN;
-    case '&':
-        if (str[1] == '=')
+
+        f_push_token(&lexer->tokens, &token);
+    }
+}
+
+
+/*
+ * splits the file at newlines into chunks, which are lexed on a thread each, all
+ * assuming they don't start inside a comment. the chunks are then joined in order,
+ * starting each one at the token where the previous really ended, chunks which
+ * never reach that token, or hit a diagnostic, are lexed again on this thread.
+ * the tokens before 'begin' are already lexed. returns false if lexing a chunk
+ * again hits a diagnostic as well
+ */
+static bool
+lex_parallel(lexer_t *lexer, uint32_t chunk_count, uint32_t begin)
+{
+    lex_chunk_t *chunks = c_malloc(chunk_count * sizeof(lex_chunk_t));
+    uint32_t     size   = lexer->source.end - lexer->source.start;
+    uint32_t     exit   = begin;
+    bool         lexed  = true;
+    const char * newline;
+    int64_t      first;
+    uint32_t     i;
+
+    for (i = 0; i < chunk_count; ++i)
+    {
+        chunks[i].begin = 0;
+
+        if (i > 0)
         {
-            *symbol_len = 2;
-            return TOK_AMPERSAND_ASSIGN;
+            newline = memchr(lexer->source.start + (uint64_t)size * i / chunk_count, '\n',
+                             size - (uint64_t)size * i / chunk_count);
+
+            chunks[i].begin = newline ? newline - lexer->source.start + 1 : size;
+
+            if (chunks[i].begin < chunks[i - 1].begin)
+            {
+                chunks[i].begin = chunks[i - 1].begin;
+            }
+
+            chunks[i - 1].end = chunks[i].begin;
         }
-        else if (str[1] == '&')
+    }
+
+    chunks[chunk_count - 1].end = size;
+
+    for (i = 0; i < chunk_count; ++i)
+    {
+        chunks[i].lexer             = *lexer;
+        chunks[i].lexer.defer_atoms = true;
+        chunks[i].failed            = false;
+
+        f_create_string_table(&chunks[i].lexer.strings);
+        f_create_token_buffer(&chunks[i].lexer.tokens, (chunks[i].end - chunks[i].begin) / 6 + 16);
+
+        if (pthread_create(&chunks[i].thread, NULL, lex_chunk, &chunks[i]) != 0)
         {
-            *symbol_len = 2;
-            return TOK_AND;
+            fatal_error("failed to start a lexer thread");
         }
-        *symbol_len = 1;
-        return TOK_AMPERSAND;
-    case '|':
-        if (str[1] == '=')
+    }
+
+    for (i = 0; i < chunk_count; ++i)
+    {
+        pthread_join(chunks[i].thread, NULL);
+    }
+
+    for (i = 0; i < chunk_count && lexed; ++i)
+    {
+        /* swallowed by a token or comment of an earlier chunk */
+        if (exit >= chunks[i].end)
         {
-            *symbol_len = 2;
-            return TOK_OR_ASSIGN;
+            continue;
         }
-        else if (str[1] == '|')
+
+        /* the first chunk starts at the start of the file, so every token of it is real */
+        if (chunks[i].failed)
         {
-            *symbol_len = 2;
-            return TOK_OR;
+            first = -1;
         }
-        *symbol_len = 1;
-        return TOK_OR_BIT;
-    case '~':
-        if (str[1] == '=')
+        else if (i == 0)
         {
-            *symbol_len = 2;
-            return TOK_NOT_ASSIGN;
+            first = first_token_from(&chunks[i].lexer.tokens, 0, exit);
         }
-        *symbol_len = 1;
-        return TOK_NOT_BIT;
-    case '^':
-        if (str[1] == '=')
+        else
         {
-            *symbol_len = 2;
-            return TOK_EOR_ASSIGN;
+            first = find_token(&chunks[i].lexer.tokens, 0, exit);
         }
-        *symbol_len = 1;
-        return TOK_EOR;
-    case '>':
-        if (str[1] == '=')
+
+        if (first >= 0)
         {
-            *symbol_len = 2;
-            return TOK_GREATER_OR_EQUAL;
+            append_chunk(lexer, &chunks[i], first);
+            exit = chunks[i].exit;
         }
-        else if (str[1] == '>')
+        else
         {
-            if (str[2] == '=')
-            {
-                *symbol_len = 3;
-                return TOK_RIGHT_SHIFT_ASSIGN;
-            }
-            else
-            {
-                *symbol_len = 2;
-                return TOK_RIGHT_SHIFT;
-            }
+            lexed = try_lex_range(lexer, exit, chunks[i].end, &exit);
         }
-        *symbol_len = 1;
-        return TOK_GREATER;
-    case '<':
-        if (str[1] == '=')
+    }
+
+    for (i = 0; i < chunk_count; ++i)
+    {
+        f_destroy_string_table(&chunks[i].lexer.strings);
+        f_destroy_token_buffer(&chunks[i].lexer.tokens);
+    }
+
+    c_free(chunks);
+
+    return lexed;
+}
+
+
+/* lexes the rest of the file up front, so tokens are read from the buffer,
+ * which allows seeking and looking any number of tokens ahead. a file with a
+ * diagnostic is lexed as it's read instead, so the diagnostic is reported in
+ * order, and not at all if the preprocessor skips the group it's in */
+void
+f_lexer_pretokenize(lexer_t *lexer)
+{
+    const char *curr = lexer->curr;
+    token_t     token;
+    uint32_t    chunk_count;
+    uint32_t    exit;
+    long        cores;
+    bool        lexed;
+    uint64_t    hash = 0;
+
+    assert(!lexer->buffered && !lexer->pipelined && !lexer->pp);
+
+    if (lexer->cache_dir && !lexer->source.stream)
+    {
+        hash = source_hash(&lexer->source);
+
+        if (f_load_token_cache(lexer, lexer->cache_dir, hash))
         {
-            *symbol_len = 2;
-            return TOK_LESSER_OR_EQUAL;
+            lexer->buffered = true;
+
+            f_lexer_seek(lexer, 0);
+            return;
         }
-        else if (str[1] == '<')
+    }
+
+    /* a rough guess of one token per 6 bytes */
+    f_create_token_buffer(&lexer->tokens, (lexer->source.end - lexer->source.start) / 6 + 16);
+
+    if (lexer->source.stream)
+    {
+        /* a stream can't be read again, so carry on after the tokens
+         * already lexed */
+        f_push_token(&lexer->tokens, &lexer->curr_token);
+        f_push_token(&lexer->tokens, &lexer->next_token);
+
+        token = lexer->next_token;
+
+        while (token.type != TOK_EOF)
         {
-            if (str[2] == '=')
-            {
-                *symbol_len = 3;
-                return TOK_LEFT_SHIFT_ASSIGN;
-            }
-            else
-            {
-                *symbol_len = 2;
-                return TOK_LEFT_SHIFT;
-            }
+            lex_token(lexer, &token);
+            f_push_token(&lexer->tokens, &token);
         }
-        *symbol_len = 1;
-        return TOK_LESSER;
-    case '(':
-        *symbol_len = 1;
-        return TOK_PAREN_OPEN;
-    case ')':
-        *symbol_len = 1;
-        return TOK_PAREN_CLOSED;
-    case '[':
-        *symbol_len = 1;
-        return TOK_BRACKET_OPEN;
-    case ']':
-        *symbol_len = 1;
-        return TOK_BRACKET_CLOSED;
-    case '{':
-        *symbol_len = 1;
-        return TOK_BRACE_OPEN;
-    case '}':
-        *symbol_len = 1;
-        return TOK_BRACE_CLOSED;
-    case '!':
-        if (str[1] == '=')
-        {
-            *symbol_len = 2;
-            return TOK_NOT_EQUAL;
-        }
-        *symbol_len = 1;
-        return TOK_NOT;
-    case ',':
-        *symbol_len = 1;
-        return TOK_COMMA;
-    case '.':
-        if (str[1] == '.')
-        {
-            if (str[2] == '.')
-            {
-                *symbol_len = 3;
-                return TOK_ELLIPSIS;
-            }
-        }
-        *symbol_len = 1;
-        return TOK_DOT;
-    case ';':
-        *symbol_len = 1;
-        return TOK_SEMIKOLON;
-    case ':':
-        *symbol_len = 1;
-        return TOK_KOLON;
-    case '?':
-		/* @todo: add support for trigraph sequence */
-        *symbol_len = 1;
-        return TOK_QUERY;
-    case '\0':
-        *symbol_len = 0;
-        return TOK_EOF;
+
+        lexer->buffered = true;
+
+        f_lexer_seek(lexer, 0);
+        return;
+    }
+
+    chunk_count = (lexer->source.end - lexer->source.start) / LEXER_PARALLEL_MIN_CHUNK;
+    cores       = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (chunk_count > (uint32_t)cores)
+    {
+        chunk_count = cores;
+    }
+
+    if (chunk_count > LEXER_PARALLEL_MAX_CHUNKS)
+    {
+        chunk_count = LEXER_PARALLEL_MAX_CHUNKS;
+    }
+
+    /* the first two tokens were lexed when the lexer was made, and aren't lexed again */
+    f_push_token(&lexer->tokens, &lexer->curr_token);
+    f_push_token(&lexer->tokens, &lexer->next_token);
+
+    if (lexer->next_token.type == TOK_EOF)
+    {
+        lexed = true;
+    }
+    else if (chunk_count > 1)
+    {
+        lexed = lex_parallel(lexer, chunk_count, offset_of(lexer, curr));
+    }
+    else
+    {
+        lexed = try_lex_range(lexer, offset_of(lexer, curr), lexer->source.end - lexer->source.start,
+                              &exit);
+    }
+
+    if (!lexed)
+    {
+        f_destroy_token_buffer(&lexer->tokens);
+
+        lexer->curr = curr;
+        return;
+    }
+
+    /* so files with diagnostics aren't cached either */
+    if (lexer->cache_dir)
+    {
+        f_store_token_cache(lexer, lexer->cache_dir, hash);
     }
 
-    *symbol_len = 1;
-    return TOK_UNKNOWN;
+    lexer->buffered = true;
+
+    f_lexer_seek(lexer, 0);
 }
 
 
-/* ================================================================================= */
+/* returns the token 'k' tokens after the current, negative values looks back */
+token_t
+f_peek_token(const lexer_t *lexer, int32_t k)
+{
+    switch (k)
+    {
+    case -1:
+        return lexer->last_token;
+    case 0:
+        return lexer->curr_token;
+    case 1:
+        return lexer->next_token;
+    }
 
-err_location_t
-err_loc(const lexer_t *lexer)
+    assert(lexer->buffered && !lexer->pp);
+
+    return f_token_at(&lexer->tokens, (int64_t)lexer->pos + k);
+}
+
+
+/* index of the current token, only valid for pretokenized lexers */
+uint32_t
+f_lexer_tell(const lexer_t *lexer)
 {
-    err_location_t loc = { .line = lexer->line, .col = lexer->col, .filename = lexer->filename };
+    assert(lexer->buffered && !lexer->pp);
 
-    return loc;
+    return lexer->pos;
 }
 
 
+/* carries on reading the file at 'offset', which is the start of a token, the
+ * preprocessor skips the groups which aren't taken with it, without lexing them */
 void
-f_create_lexer(lexer_t *lexer, const char *filename)
+f_lexer_skip_to(lexer_t *lexer, uint32_t offset)
 {
-    size_t file_size;
-    size_t filename_size;
+    int64_t index;
 
-    FILE *file = fopen(filename, "r");
+    if (lexer->buffered)
+    {
+        index = find_token(&lexer->tokens, lexer->pos, offset);
+
+        assert(index >= (int64_t)lexer->pos + 2);
+
+        /* f_next_raw_token reads the token two after 'pos' */
+        lexer->pos = index - 2;
+    }
+    else if (lexer->pipelined)
+    {
+        stop_pipeline(lexer);
 
-    if (!file)
+        lexer->curr = lexer->source.start + offset;
+        f_lexer_pipeline(lexer);
+    }
+    else
     {
-        fatal_error("%s: No such file", filename);
+        lexer->curr = lexer->source.start + offset;
     }
+}
+
+
+/* makes the token at 'pos' the current token, used to backtrack */
+void
+f_lexer_seek(lexer_t *lexer, uint32_t pos)
+{
+    assert(lexer->buffered && !lexer->pp);
 
-    fseek(file, 0, SEEK_END);
-    file_size = ftell(file);
-    rewind(file);
+    lexer->pos        = pos;
+    lexer->last_token = f_token_at(&lexer->tokens, (int64_t)pos - 1);
+    lexer->curr_token = f_token_at(&lexer->tokens, pos);
+    lexer->next_token = f_token_at(&lexer->tokens, (int64_t)pos + 1);
+}
 
-    lexer->start = c_malloc(file_size);
-    lexer->curr  = lexer->start;
-    lexer->end   = lexer->start + file_size;
 
-    filename_size   = strlen(filename);
-    lexer->filename = c_malloc(filename_size);
-    strncpy(lexer->filename, filename, filename_size);
+/* ================================================================================= */
+/* incremental lexing */
 
-    lexer->line = 0;
-    lexer->col  = 0;
+/* index of the first token ending at or after 'offset', a token which ends right
+ * at an edit may continue into it */
+static uint32_t
+first_touched(const token_buffer_t *tokens, uint32_t offset)
+{
+    uint32_t low  = 0;
+    uint32_t high = tokens->types.size;
+    uint32_t mid;
+    token_t  token;
 
-    if (!fread(lexer->start, 1, file_size, file))
+    /* the tokens don't overlap, so their ends are sorted as well */
+    while (low < high)
     {
-        fatal_error("Failure reading %s", filename);
-    }
+        mid   = low + (high - low) / 2;
+        token = f_token_at(tokens, mid);
 
-    fclose(file);
+        if (token.offset + token.len < offset)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
 
-    /* why is this needed? */
-    f_next_token(lexer);
+    return low;
 }
 
 
-void
-f_destroy_lexer(lexer_t *lexer)
+/* index of the value of the first token at or after 'index' which has one */
+static uint32_t
+value_index(const token_buffer_t *tokens, uint32_t index)
 {
-    c_free(lexer->start);
-    c_free(lexer->filename);
+    for (; index < tokens->types.size; ++index)
+    {
+        if (has_payload(tokens->types.data[index]))
+        {
+            return tokens->payloads.data[index];
+        }
+    }
 
-    lexer->col   = 0;
-    lexer->line  = 0;
-    lexer->start = NULL;
-    lexer->curr  = NULL;
-    lexer->end   = NULL;
+    return tokens->values.size;
 }
 
 
-token_t
-f_next_token(lexer_t *lexer)
+/* replaces the tokens [first, last) with 'tokens', and moves the offsets of
+ * the tokens after them by 'delta' */
+static void
+splice_tokens(token_buffer_t *buffer, uint32_t first, uint32_t last,
+              const token_buffer_t *tokens, int64_t delta)
 {
-    char           c;
-    uint32_t       token_len;
-    suffix_flags_t suffix;
-
-    c = skip_whitespace_and_comments(lexer);
+    uint32_t count       = buffer->types.size;
+    uint32_t new_count   = count - (last - first) + tokens->types.size;
+    uint32_t value_first = value_index(buffer, first);
+    uint32_t value_last  = value_index(buffer, last);
+    uint32_t values      = buffer->values.size - (value_last - value_first) + tokens->values.size;
+    int64_t  value_delta = (int64_t)tokens->values.size - (value_last - value_first);
+    uint32_t tail        = first + tokens->types.size;
+    uint32_t i;
 
-    lexer->last_token = lexer->curr_token;
-    lexer->curr_token = lexer->next_token;
+    if (new_count > buffer->types.capacity)
+    {
+        vec_uint8_t_reserve(&buffer->types, new_count * 2);
+        vec_uint32_t_reserve(&buffer->offsets, new_count * 2);
+        vec_uint32_t_reserve(&buffer->payloads, new_count * 2);
+    }
 
-    if (isalpha(c) || c == '_')
+    if (values > buffer->values.capacity)
     {
-        token_len = word_len(lexer);
+        vec_token_payload_t_reserve(&buffer->values, values * 2);
+    }
 
-        lexer->next_token.hash = sym_hash(lexer->curr, token_len);
+    /* move the tail, and then copy the new tokens in front of it */
+    memmove(buffer->types.data + tail, buffer->types.data + last, count - last);
+    memmove(buffer->offsets.data + tail, buffer->offsets.data + last,
+            (count - last) * sizeof(uint32_t));
+    memmove(buffer->payloads.data + tail, buffer->payloads.data + last,
+            (count - last) * sizeof(uint32_t));
+    memmove(buffer->values.data + value_first + tokens->values.size,
+            buffer->values.data + value_last,
+            (buffer->values.size - value_last) * sizeof(token_payload_t));
+
+    memcpy(buffer->types.data + first, tokens->types.data, tokens->types.size);
+    memcpy(buffer->offsets.data + first, tokens->offsets.data, tokens->types.size * sizeof(uint32_t));
+    memcpy(buffer->values.data + value_first, tokens->values.data,
+           tokens->values.size * sizeof(token_payload_t));
+
+    for (i = 0; i < tokens->types.size; ++i)
+    {
+        buffer->payloads.data[first + i] = tokens->payloads.data[i];
 
-        lexer->next_token.type = lookup_keyword(lexer->next_token.hash, token_len);
-        skip(lexer, token_len);
+        if (has_payload(tokens->types.data[i]))
+        {
+            buffer->payloads.data[first + i] += value_first;
+        }
     }
-    else if (isdigit(c) || (c == '.' && isdigit(lexer->curr[1])))
+
+    for (i = tail; i < new_count; ++i)
     {
-        lexer->next_token.type = TOK_LITERAL;
+        buffer->offsets.data[i] += delta;
+
+        if (has_payload(buffer->types.data[i]))
+        {
+            buffer->payloads.data[i] += value_delta;
+        }
+    }
 
-        token_len = number_len(lexer);
+    buffer->types.size    = new_count;
+    buffer->offsets.size  = new_count;
+    buffer->payloads.size = new_count;
+    buffer->values.size   = values;
+}
 
-        lexer->next_token.literal = parse_decimal_constant(lexer->curr, token_len);
 
-        /* skip the number */
-        skip(lexer, token_len);
+token_edit_t
+f_lexer_edit(lexer_t *lexer, uint32_t offset, uint32_t len, const char *text, uint32_t text_len)
+{
+    token_buffer_t *tokens   = &lexer->tokens;
+    int64_t         delta    = (int64_t)text_len - len;
+    uint32_t        edit_end = offset + text_len;
+    token_buffer_t  relexed;
+    token_edit_t    edit;
+    token_t         token;
+    uint32_t        touched;
+    uint32_t        last;
+    int64_t         found;
+    uint32_t        pos;
 
-        /* parse suffix */
-        token_len = word_len(lexer);
+    assert(lexer->buffered && !lexer->source.stream);
 
-        if (token_len)
-        {
-            suffix = parse_suffix(lexer, token_len);
+    source_edit(&lexer->source, offset, len, text, text_len);
 
-            type_adapt_to_suffix(&lexer->next_token.literal, suffix, err_loc(lexer));
+    /* start a token earlier, since the one before the first touched can still change,
+     * like an identifier which the text is appended to */
+    touched    = first_touched(tokens, offset);
+    edit.first = touched > 0 ? touched - 1 : 0;
 
-            skip(lexer, token_len);
-        }
-    }
-    else if (c == '"')
+    lexer->curr = lexer->source.start + (edit.first > 0 ? tokens->offsets.data[edit.first] : 0);
+
+    f_create_token_buffer(&relexed, 16);
+
+    /* the text after the edit is unchanged, so once a token starts after it where
+     * an old token started, every token from there on is the same */
+    for (;;)
     {
-        /* @todo: add parsing for strings, and remember deducting the type */
-        lexer->next_token.type = TOK_LITERAL;
+        lex_token(lexer, &token);
 
-        next(lexer);
+        if (token.offset >= edit_end)
+        {
+            found = find_token(tokens, touched, token.offset - delta);
+
+            if (found >= 0)
+            {
+                last = found;
+                break;
+            }
+        }
 
-        token_len = string_len(lexer);
+        f_push_token(&relexed, &token);
 
-        skip(lexer, token_len + 1);
+        if (token.type == TOK_EOF)
+        {
+            last = tokens->types.size;
+            break;
+        }
     }
-    else if (c == '\'')
-    {
-        lexer->next_token.type = TOK_LITERAL;
 
-        next(lexer);
-        token_len = char_len(lexer);
+    edit.old_count = last - edit.first;
+    edit.new_count = relexed.types.size;
 
-        /* get value */
-        lexer->next_token.literal.value._int = parse_char_literal(lexer, token_len);
+    splice_tokens(tokens, edit.first, last, &relexed, delta);
+    f_destroy_token_buffer(&relexed);
 
-        lexer->next_token.literal.type = LITERAL_TYPE_INT;
+    /* keep the current token, unless it was replaced */
+    pos = lexer->pos;
 
-        skip(lexer, token_len + 1);
+    if (pos >= last)
+    {
+        pos = pos - edit.old_count + edit.new_count;
     }
-    else
+    else if (pos > edit.first)
     {
-        lexer->next_token.type = lookup_symbol(lexer->curr, &token_len);
-        skip(lexer, token_len);
+        pos = edit.first;
     }
 
-    lexer->next_token.err_loc = err_loc(lexer);
-    return lexer->curr_token;
+    f_lexer_seek(lexer, pos);
+
+    return edit;
 }
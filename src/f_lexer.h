@@ -5,6 +5,8 @@
 #include "type.h"
 #include "symbol.h"
 #include "err.h"
+#include "source.h"
+#include "f_string.h"
 
 #include <stdint.h>
 
@@ -76,6 +78,10 @@ typedef enum token_type
     TOK_ELLIPSIS,  // ...
     TOK_QUERY,     // ?
 
+    /* preprocessing operators, the parser never sees them */
+    TOK_HASH,      // #
+    TOK_HASH_HASH, // ##
+
     /* keywords */
     TOK_KEY_IF,
     TOK_KEY_ELSE,
@@ -119,42 +125,154 @@ typedef enum token_type
 
 typedef struct token
 {
-    token_type_t   type;
-    err_location_t err_loc;
+    token_type_t type;
+
+    /* byte offset and length of the spelling in the source,
+     * the line and column is only looked up for errors */
+    uint32_t offset;
+    uint32_t len;
+
+    /* the source the offset is into, 0 is the source of the lexer, the preprocessor
+     * numbers the others, such as included files, see f_pp_source */
+    uint32_t source_id;
 
     union
     {
         literal_t  literal;
-        sym_hash_t hash;
+        atom_t     atom;
     };
 
 } token_t;
 
 
-typedef struct lexer
+/* the data of the tokens which has any */
+typedef struct token_payload
 {
-    uint32_t line;
-    uint32_t col;
+    uint32_t len;
+
+    union
+    {
+        literal_t  literal;
+        atom_t     atom;
+    };
+
+} token_payload_t;
 
-    char* filename;
+#define VEC_TYPE uint32_t
+#include "templates/vec.h"
+#undef VEC_TYPE
 
-    char* start;
-    char* curr;
-    char* end;
+#define VEC_TYPE token_payload_t
+#include "templates/vec.h"
+#undef VEC_TYPE
+
+/* a whole file of tokens stored as a struct of arrays */
+typedef struct token_buffer
+{
+    vec_uint8_t  types;
+    vec_uint32_t offsets;
+
+    /* index into values for identifiers and literals,
+     * for every other token it's the length */
+    vec_uint32_t        payloads;
+    vec_token_payload_t values;
+
+} token_buffer_t;
+
+
+/* the tokens lexed ahead on another thread, see f_lexer_pipeline */
+struct token_ring;
+
+/* see f_preprocessor.h */
+struct preprocessor;
+
+typedef struct lexer
+{
+    source_t    source;
+    const char *curr;
 
     token_t last_token;
     token_t curr_token;
     token_t next_token;
 
+    /* set when the file is pretokenized, then tokens are read from
+     * the buffer, and 'pos' is the index of curr_token */
+    bool           buffered;
+    uint32_t       pos;
+    token_buffer_t tokens;
+
+    /* the string literals, which tokens point into */
+    string_table_t strings;
+
+    /* set for the lexers of parallel chunks, which can't share the atom table,
+     * identifiers then get their hash instead of an atom */
+    bool defer_atoms;
+
+    /* when set, pretokenized files are looked up in and stored to this directory */
+    const char *cache_dir;
+
+    /* set while a thread lexes ahead into the ring, 'curr' then belongs to that thread */
+    bool               pipelined;
+    struct token_ring *ring;
+
+    /* when set, f_next_token gives the tokens after preprocessing, and the tokens
+     * of the file itself are read by the preprocessor with f_next_raw_token */
+    struct preprocessor *pp;
+
 } lexer_t;
 
 
+/* the tokens [first, first + old_count) of a pretokenized lexer were replaced
+ * by [first, first + new_count), the offsets of the tokens after them moved */
+typedef struct token_edit
+{
+    uint32_t first;
+    uint32_t old_count;
+    uint32_t new_count;
+
+} token_edit_t;
+
+
 err_location_t err_loc(const lexer_t* lexer);
+err_location_t f_token_loc(const lexer_t* lexer, const token_t* token);
 const char*    tok_debug_str(token_type_t type);
 
 void f_create_lexer(lexer_t* lexer, const char* filename);
+
+/* lexes a source which is already open, such as one from a source_batch_t,
+ * the lexer closes it when destroyed */
+void f_create_lexer_from_source(lexer_t* lexer, const source_t* source);
 void f_destroy_lexer(lexer_t* lexer);
 
 token_t f_next_token(lexer_t* lexer);
 
+/* the token after the ones read from the file so far, without preprocessing */
+token_t f_next_raw_token(lexer_t* lexer);
+
+/* lexes one token at 'curr', used by the preprocessor to make tokens of text */
+void f_lex_token(lexer_t* lexer, token_t* token);
+
+/* the next raw token is the one starting at 'offset', the text before it isn't lexed */
+void f_lexer_skip_to(lexer_t* lexer, uint32_t offset);
+
+/* lexes the rest of the file on another thread, while the tokens are read as they
+ * are ready, diagnostics are still reported in order. does nothing on a single core,
+ * not for streams, and can't be combined with pretokenizing */
+void f_lexer_pipeline(lexer_t* lexer);
+
+void     f_lexer_pretokenize(lexer_t* lexer);
+token_t  f_peek_token(const lexer_t* lexer, int32_t k);
+uint32_t f_lexer_tell(const lexer_t* lexer);
+void     f_lexer_seek(lexer_t* lexer, uint32_t pos);
+
+/* replaces the bytes [offset, offset + len) of a pretokenized file with 'text', and
+ * lexes again from just before the edit, until the tokens are the same as before */
+token_edit_t f_lexer_edit(lexer_t* lexer, uint32_t offset, uint32_t len, const char* text,
+                          uint32_t text_len);
+
+void    f_create_token_buffer(token_buffer_t* buffer, uint32_t capacity);
+void    f_destroy_token_buffer(token_buffer_t* buffer);
+void    f_push_token(token_buffer_t* buffer, const token_t* token);
+token_t f_token_at(const token_buffer_t* buffer, int64_t index);
+
 #endif
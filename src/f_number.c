@@ -0,0 +1,576 @@
+#include "f_number.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* the 128 bit powers of five made by tools/gen_lexer_tables.c */
+#include "f_number_tables.h"
+
+/*
+ * integer constants are typed after their value and suffix like in C, where
+ * int is 32 bits and long and long long are both 64 bits.
+ *
+ * decimal floats with up to 19 significant digits are converted with the
+ * eisel-lemire algorithm, which is always correctly rounded for those. longer
+ * mantissas and hex floats are rare, and are left to strtod.
+ */
+
+/* most significant decimal digits which always fit in 64 bits */
+#define MAX_MANTISSA_DIGITS 19
+
+/* exponents are clamped to this, which is far past where everything is 0 or inf */
+#define MAX_EXPONENT 100000
+
+typedef struct float_format
+{
+    int32_t mantissa_bits;
+    int32_t min_exponent;
+    int32_t infinite_power;
+
+    /* 10^q is either 0 or inf outside of this range */
+    int32_t min_pow10;
+    int32_t max_pow10;
+
+    /* the only powers where a result can be exactly between two floats */
+    int32_t min_round_to_even;
+    int32_t max_round_to_even;
+
+} float_format_t;
+
+static const float_format_t binary64 = { 52, -1023, 0x7ff, -342, 308, -4, 23 };
+static const float_format_t binary32 = { 23, -127, 0xff, -65, 38, -17, 10 };
+
+/* the digits of a decimal float, the value is mantissa * 10^exponent */
+typedef struct decimal
+{
+    uint64_t mantissa;
+    int64_t  exponent;
+    uint32_t digits;
+
+    /* set if nonzero digits were dropped from the mantissa */
+    bool truncated;
+
+} decimal_t;
+
+
+static inline bool
+is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline bool
+is_word(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || is_digit(c) || c == '_';
+}
+
+/* returns the value of a digit in any base up to 16, or 16 if it isn't one */
+static inline uint32_t
+digit_value(char c)
+{
+    if (is_digit(c))
+    {
+        return c - '0';
+    }
+
+    if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+    {
+        return (c | 0x20) - 'a' + 10;
+    }
+
+    return 16;
+}
+
+
+/* ================================================================================= */
+/* eisel-lemire */
+
+static inline void
+mul_64(uint64_t a, uint64_t b, uint64_t *high, uint64_t *low)
+{
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 product = (unsigned __int128)a * b;
+
+    *high = product >> 64;
+    *low  = (uint64_t)product;
+#else
+    uint64_t a_lo  = (uint32_t)a;
+    uint64_t a_hi  = a >> 32;
+    uint64_t b_lo  = (uint32_t)b;
+    uint64_t b_hi  = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo;
+    uint64_t hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi;
+    uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+
+    *high = a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+    *low  = cross << 32 | (uint32_t)lo_lo;
+#endif
+}
+
+/* returns the bits of the float closest to w * 10^q, where w isn't 0 */
+static uint64_t
+eisel_lemire(int64_t q, uint64_t w, const float_format_t *format)
+{
+    const uint64_t *pow5;
+    uint64_t        high;
+    uint64_t        low;
+    uint64_t        second_high;
+    uint64_t        second_low;
+    uint64_t        precision_mask;
+    uint64_t        mantissa;
+    int32_t         leading_zeros;
+    int32_t         upper_bit;
+    int32_t         shift;
+    int32_t         power2;
+
+    if (q < format->min_pow10)
+    {
+        return 0;
+    }
+
+    if (q > format->max_pow10)
+    {
+        return (uint64_t)format->infinite_power << format->mantissa_bits;
+    }
+
+    leading_zeros = __builtin_clzll(w);
+    w <<= leading_zeros;
+
+    /* w * 5^q, the second half of the power is only needed when the
+     * bits below the mantissa might be affected by it */
+    pow5 = &pow5_table[2 * (q - POW5_MIN_EXP)];
+    mul_64(w, pow5[0], &high, &low);
+
+    precision_mask = ~0ull >> (format->mantissa_bits + 3);
+
+    if ((high & precision_mask) == precision_mask)
+    {
+        mul_64(w, pow5[1], &second_high, &second_low);
+
+        low += second_high;
+
+        if (second_high > low)
+        {
+            ++high;
+        }
+    }
+
+    upper_bit = high >> 63;
+    shift     = upper_bit + 64 - format->mantissa_bits - 3;
+    mantissa  = high >> shift;
+
+    /* floor(log2(10^q)) + 63, and the exponent bias */
+    power2 = (int32_t)(((152170 + 65536) * q) >> 16) + 63 + upper_bit - leading_zeros -
+             format->min_exponent;
+
+    if (power2 <= 0)
+    {
+        /* subnormal, or too small to be anything but 0 */
+        if (-power2 + 1 >= 64)
+        {
+            return 0;
+        }
+
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+
+        power2 = mantissa < (1ull << format->mantissa_bits) ? 0 : 1;
+
+        return (mantissa & ((1ull << format->mantissa_bits) - 1)) |
+               (uint64_t)power2 << format->mantissa_bits;
+    }
+
+    /* we round up, unless we are exactly in between two floats, and the lower is even */
+    if (low <= 1 && q >= format->min_round_to_even && q <= format->max_round_to_even &&
+        (mantissa & 3) == 1 && (mantissa << shift) == high)
+    {
+        mantissa &= ~1ull;
+    }
+
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+
+    if (mantissa >= (2ull << format->mantissa_bits))
+    {
+        mantissa = 1ull << format->mantissa_bits;
+        ++power2;
+    }
+
+    mantissa &= ~(1ull << format->mantissa_bits);
+
+    if (power2 >= format->infinite_power)
+    {
+        return (uint64_t)format->infinite_power << format->mantissa_bits;
+    }
+
+    return mantissa | (uint64_t)power2 << format->mantissa_bits;
+}
+
+/* the value of a decimal float as a double, or a float if 'single' is set */
+static double
+decimal_to_double(const decimal_t *dec, const char *str, bool single)
+{
+    uint64_t bits;
+    uint32_t bits32;
+    double   d;
+    float    f;
+
+    if (dec->truncated)
+    {
+        return single ? strtof(str, NULL) : strtod(str, NULL);
+    }
+
+    if (!dec->mantissa)
+    {
+        return 0.0;
+    }
+
+    if (single)
+    {
+        bits32 = eisel_lemire(dec->exponent, dec->mantissa, &binary32);
+        memcpy(&f, &bits32, sizeof(f));
+
+        return f;
+    }
+
+    bits = eisel_lemire(dec->exponent, dec->mantissa, &binary64);
+    memcpy(&d, &bits, sizeof(d));
+
+    return d;
+}
+
+
+/* ================================================================================= */
+/* scanning */
+
+static inline void
+add_digit(decimal_t *dec, uint32_t digit, bool fraction)
+{
+    if (dec->digits < MAX_MANTISSA_DIGITS)
+    {
+        dec->mantissa = dec->mantissa * 10 + digit;
+
+        /* leading zeros aren't significant */
+        dec->digits += dec->mantissa != 0;
+        dec->exponent -= fraction;
+    }
+    else
+    {
+        /* a dropped integer digit scales the mantissa by 10 */
+        dec->truncated |= digit != 0;
+        dec->exponent += !fraction;
+    }
+}
+
+/* scans an exponent like 'e-10', and returns the first byte after it */
+static const char *
+scan_exponent(const char *ptr, int64_t *exponent, err_location_t loc)
+{
+    int64_t value = 0;
+    bool    negative;
+
+    ++ptr;
+
+    negative = *ptr == '-';
+
+    if (*ptr == '-' || *ptr == '+')
+    {
+        ++ptr;
+    }
+
+    if (!is_digit(*ptr))
+    {
+        syntax_error(loc, "exponent has no digits");
+    }
+
+    for (; is_digit(*ptr); ++ptr)
+    {
+        if (value < MAX_EXPONENT)
+        {
+            value = value * 10 + *ptr - '0';
+        }
+    }
+
+    *exponent += negative ? -value : value;
+
+    return ptr;
+}
+
+/* scans an integer in a power of two base, and sets 'overflow' if it doesn't fit in 64 bits */
+static const char *
+scan_integer(const char *ptr, uint32_t shift, uint64_t *value, bool *overflow)
+{
+    uint32_t digit;
+
+    *value    = 0;
+    *overflow = false;
+
+    while ((digit = digit_value(*ptr)) < (1u << shift))
+    {
+        *overflow |= *value > (~0ull >> shift);
+        *value     = *value << shift | digit;
+
+        ++ptr;
+    }
+
+    return ptr;
+}
+
+static const char *
+scan_decimal(const char *ptr, uint64_t *value, bool *overflow)
+{
+    uint32_t digit;
+
+    *value    = 0;
+    *overflow = false;
+
+    for (; is_digit(*ptr); ++ptr)
+    {
+        digit = *ptr - '0';
+
+        *overflow |= *value > (~0ull - digit) / 10;
+        *value     = *value * 10 + digit;
+    }
+
+    return ptr;
+}
+
+/* hex floats have a mandatory binary exponent, like 0x1.8p3 */
+static const char *
+scan_hex_float(const char *ptr, bool has_digits, err_location_t loc)
+{
+    int64_t exponent = 0;
+
+    if (*ptr == '.')
+    {
+        ++ptr;
+    }
+
+    while (digit_value(*ptr) < 16)
+    {
+        has_digits = true;
+        ++ptr;
+    }
+
+    if (!has_digits)
+    {
+        syntax_error(loc, "no digits in hexadecimal floating constant");
+    }
+
+    if ((*ptr | 0x20) != 'p')
+    {
+        syntax_error(loc, "hexadecimal floating constant requires an exponent");
+    }
+
+    return scan_exponent(ptr, &exponent, loc);
+}
+
+
+/* ================================================================================= */
+/* suffix and typing */
+
+static suffix_flags_t
+parse_suffix(const char *str, uint32_t len, bool is_float, err_location_t loc)
+{
+    suffix_flags_t flags = 0;
+    uint32_t       i     = 0;
+    bool           valid = len <= MAX_SUFFIX_LEN;
+
+    while (valid && i < len)
+    {
+        switch (str[i])
+        {
+        case 'u':
+        case 'U':
+            valid = !is_float && !(flags & SUFFIX_UNSIGNED);
+            flags |= SUFFIX_UNSIGNED;
+            ++i;
+            break;
+
+        /* 'll' and 'LL' are the same as 'l', since long is 64 bits */
+        case 'l':
+        case 'L':
+            valid = !(flags & (SUFFIX_LONG | SUFFIX_FLOAT));
+            flags |= SUFFIX_LONG;
+
+            if (i + 1 < len && str[i + 1] == str[i])
+            {
+                valid = valid && !is_float;
+                ++i;
+            }
+
+            ++i;
+            break;
+
+        case 'f':
+        case 'F':
+            valid = is_float && !(flags & (SUFFIX_LONG | SUFFIX_FLOAT));
+            flags |= SUFFIX_FLOAT;
+            ++i;
+            break;
+
+        default:
+            valid = false;
+            break;
+        }
+    }
+
+    if (!valid)
+    {
+        syntax_error(loc, "invalid suffix \"%.*s\" on %s constant", (int)len, str,
+                     is_float ? "floating" : "integer");
+    }
+
+    return flags;
+}
+
+/* the first of int, unsigned int, long and unsigned long which can hold the value,
+ * unsigned types are only picked for decimal constants if the suffix says so */
+static void
+type_integer(literal_t *literal, uint64_t value, bool decimal, suffix_flags_t flags,
+             err_location_t loc)
+{
+    bool is_unsigned = flags & SUFFIX_UNSIGNED;
+    bool is_long     = flags & SUFFIX_LONG;
+
+    literal->value._int = value;
+
+    if (!is_long && !is_unsigned && value <= INT32_MAX)
+    {
+        literal->type = LITERAL_TYPE_INT;
+    }
+    else if (!is_long && (is_unsigned || !decimal) && value <= UINT32_MAX)
+    {
+        literal->type = LITERAL_TYPE_UINT;
+    }
+    else if (!is_unsigned && value <= INT64_MAX)
+    {
+        literal->type = LITERAL_TYPE_LONG;
+    }
+    else
+    {
+        if (!is_unsigned && decimal)
+        {
+            syntax_warning(loc, "integer constant is so large that it is unsigned");
+        }
+
+        literal->type = LITERAL_TYPE_ULONG;
+    }
+}
+
+
+/* ================================================================================= */
+
+uint32_t
+f_parse_number(const char *str, literal_t *literal, err_location_t loc)
+{
+    const char *   ptr      = str;
+    const char *   suffix;
+    decimal_t      dec      = { 0, 0, 0, false };
+    uint64_t       value    = 0;
+    bool           overflow = false;
+    bool           decimal  = false;
+    bool           is_float = false;
+    suffix_flags_t flags;
+
+    if (ptr[0] == '0' && (ptr[1] | 0x20) == 'x')
+    {
+        ptr = scan_integer(ptr + 2, 4, &value, &overflow);
+
+        if (*ptr == '.' || (*ptr | 0x20) == 'p')
+        {
+            is_float = true;
+            ptr      = scan_hex_float(ptr, ptr != str + 2, loc);
+        }
+        else if (ptr == str + 2)
+        {
+            syntax_error(loc, "invalid hexadecimal constant");
+        }
+    }
+    else if (ptr[0] == '0' && (ptr[1] | 0x20) == 'b')
+    {
+        ptr = scan_integer(ptr + 2, 1, &value, &overflow);
+
+        if (ptr == str + 2)
+        {
+            syntax_error(loc, "invalid binary constant");
+        }
+    }
+    else
+    {
+        for (; is_digit(*ptr); ++ptr)
+        {
+            add_digit(&dec, *ptr - '0', false);
+        }
+
+        if (*ptr == '.')
+        {
+            is_float = true;
+
+            for (++ptr; is_digit(*ptr); ++ptr)
+            {
+                add_digit(&dec, *ptr - '0', true);
+            }
+        }
+
+        if ((*ptr | 0x20) == 'e')
+        {
+            is_float = true;
+            ptr      = scan_exponent(ptr, &dec.exponent, loc);
+        }
+
+        if (!is_float)
+        {
+            /* octal, if it starts with a 0 */
+            if (str[0] == '0')
+            {
+                if (scan_integer(str, 3, &value, &overflow) != ptr)
+                {
+                    syntax_error(loc, "invalid digit in octal constant");
+                }
+            }
+            else
+            {
+                decimal = true;
+                scan_decimal(str, &value, &overflow);
+            }
+        }
+    }
+
+    suffix = ptr;
+
+    while (is_word(*ptr))
+    {
+        ++ptr;
+    }
+
+    flags = parse_suffix(suffix, ptr - suffix, is_float, loc);
+
+    if (is_float)
+    {
+        literal->type = flags & SUFFIX_FLOAT ? LITERAL_TYPE_FLOAT : LITERAL_TYPE_DOUBLE;
+
+        /* hex floats are always passed to strtod */
+        if (str[0] == '0' && (str[1] | 0x20) == 'x')
+        {
+            dec.truncated = true;
+        }
+
+        literal->value._float = decimal_to_double(&dec, str, flags & SUFFIX_FLOAT);
+
+        return ptr - str;
+    }
+
+    if (overflow)
+    {
+        syntax_error(loc, "integer constant is too large for its type");
+    }
+
+    type_integer(literal, value, decimal, flags, loc);
+
+    return ptr - str;
+}
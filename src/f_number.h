@@ -0,0 +1,16 @@
+#ifndef _F_NUMBER_
+#define _F_NUMBER_
+
+#include "err.h"
+#include "f_def.h"
+
+#include <stdint.h>
+
+/*
+ * parses the integer or floating constant at 'str', including the suffix, and
+ * returns the number of bytes it takes up. 'str' must start with a digit, or a
+ * '.' followed by a digit, and be padded like a source
+ */
+uint32_t f_parse_number(const char *str, literal_t *literal, err_location_t loc);
+
+#endif
@@ -6,6 +6,11 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+/* the ast is kept in an arena of this much address space, so it is contiguous, and
+ * only what is used of it is backed by memory */
+#define PARSER_ARENA_RESERVE ((size_t)1 << 30)
+#define PARSER_BLOCK_SIZE    1024
+
 /* just used by the function below to call errors */
 /* @todo: should perhaps have a loopup table with every type */
 inline static const char *
@@ -36,7 +41,7 @@ assert_token(parser_t *parser, token_type_t type)
 {
     if (parser->lexer->curr_token.type != type)
     {
-        syntax_error(parser->lexer->curr_token.err_loc, "expected '%s'", tok_err_str(type));
+        syntax_error(f_curr_loc(parser), "expected '%s'", tok_err_str(type));
     }
 }
 
@@ -56,11 +61,11 @@ static ast_node_t *parse_compound_statement(parser_t *parser);
 
 /* asserts that we doesnt set a type prim more than once */
 inline static void
-set_type_prim(type_info_t *type, type_prim_t prim, const err_location_t *err_loc)
+set_type_prim(type_info_t *type, type_prim_t prim, err_location_t err_loc)
 {
     if (type->prim != TYPE_PRIM_NONE)
     {
-        syntax_error(*err_loc, "duplicate type specifier");
+        syntax_error(err_loc, "duplicate type specifier");
     }
 
     type->prim = prim;
@@ -70,11 +75,11 @@ set_type_prim(type_info_t *type, type_prim_t prim, const err_location_t *err_loc
 /* check that we doesnt set a type spec more than once,
  * we check for conflicts such as signed and unsigned when we are done */
 inline static void
-set_type_spec(type_info_t *type, type_spec_t spec, const err_location_t *err_loc)
+set_type_spec(type_info_t *type, type_spec_t spec, err_location_t err_loc)
 {
     if (type->spec & spec)
     {
-        syntax_error(*err_loc, "duplicate type specifier");
+        syntax_error(err_loc, "duplicate type specifier");
     }
 
     type->spec |= spec;
@@ -110,56 +115,56 @@ parse_type(parser_t *parser)
         {
         /* primitives */
         case TOK_KEY_INT:
-            set_type_prim(&type, TYPE_PRIM_INT, &parser->lexer->curr_token.err_loc);
+            set_type_prim(&type, TYPE_PRIM_INT, f_curr_loc(parser));
             break;
 
         case TOK_KEY_FLOAT:
-            set_type_prim(&type, TYPE_PRIM_FLOAT, &parser->lexer->curr_token.err_loc);
+            set_type_prim(&type, TYPE_PRIM_FLOAT, f_curr_loc(parser));
             break;
 
         case TOK_KEY_CHAR:
-            set_type_prim(&type, TYPE_PRIM_CHAR, &parser->lexer->curr_token.err_loc);
+            set_type_prim(&type, TYPE_PRIM_CHAR, f_curr_loc(parser));
             break;
 
         case TOK_KEY_DOUBLE:
-            set_type_prim(&type, TYPE_PRIM_DOUBLE, &parser->lexer->curr_token.err_loc);
+            set_type_prim(&type, TYPE_PRIM_DOUBLE, f_curr_loc(parser));
             break;
 
         /* type specifiers */
         case TOK_KEY_CONST:
-            set_type_spec(&type, TYPE_SPEC_CONST, &parser->lexer->curr_token.err_loc);
+            set_type_spec(&type, TYPE_SPEC_CONST, f_curr_loc(parser));
             break;
 
         case TOK_KEY_STATIC:
-            set_type_spec(&type, TYPE_SPEC_STATIC, &parser->lexer->curr_token.err_loc);
+            set_type_spec(&type, TYPE_SPEC_STATIC, f_curr_loc(parser));
             break;
 
         case TOK_KEY_UNSIGNED:
-            set_type_spec(&type, TYPE_SPEC_UNSIGNED, &parser->lexer->curr_token.err_loc);
+            set_type_spec(&type, TYPE_SPEC_UNSIGNED, f_curr_loc(parser));
             break;
 
         case TOK_KEY_SIGNED:
-            set_type_spec(&type, TYPE_SPEC_SIGNED, &parser->lexer->curr_token.err_loc);
+            set_type_spec(&type, TYPE_SPEC_SIGNED, f_curr_loc(parser));
             break;
 
         case TOK_KEY_SHORT:
-            set_type_spec(&type, TYPE_SPEC_SHORT, &parser->lexer->curr_token.err_loc);
+            set_type_spec(&type, TYPE_SPEC_SHORT, f_curr_loc(parser));
             break;
 
         case TOK_KEY_LONG:
-            set_type_spec(&type, TYPE_SPEC_LONG, &parser->lexer->curr_token.err_loc);
+            set_type_spec(&type, TYPE_SPEC_LONG, f_curr_loc(parser));
             break;
 
         case TOK_KEY_REGISTER:
-            set_type_spec(&type, TYPE_SPEC_REGISTER, &parser->lexer->curr_token.err_loc);
+            set_type_spec(&type, TYPE_SPEC_REGISTER, f_curr_loc(parser));
             break;
 
         case TOK_KEY_VOLATILE:
-            set_type_spec(&type, TYPE_SPEC_VOLATILE, &parser->lexer->curr_token.err_loc);
+            set_type_spec(&type, TYPE_SPEC_VOLATILE, f_curr_loc(parser));
             break;
 
         case TOK_KEY_EXTERN:
-            set_type_spec(&type, TYPE_SPEC_EXTERN, &parser->lexer->curr_token.err_loc);
+            set_type_spec(&type, TYPE_SPEC_EXTERN, f_curr_loc(parser));
             break;
 
         default:
@@ -177,6 +182,7 @@ static vec_sym_param_t
 parse_parameter_list(parser_t *parser)
 {
     sym_param_t     param;
+    err_location_t  loc;
     vec_sym_param_t vec = vec_sym_param_t_create(4);
 
 
@@ -185,12 +191,12 @@ parse_parameter_list(parser_t *parser)
     for (;;)
     {
         param.type    = parse_type(parser);
-        param.err_loc = parser->lexer->curr_token.err_loc;
+        param.err_loc = f_curr_loc(parser);
 
         switch (parser->lexer->curr_token.type)
         {
         case TOK_IDENTIFIER:
-            param.hash = parser->lexer->curr_token.hash;
+            param.atom = parser->lexer->curr_token.atom;
             f_next_token(parser->lexer);
             break;
 
@@ -199,17 +205,18 @@ parse_parameter_list(parser_t *parser)
         case TOK_PAREN_CLOSED:
             /* anonomous identifiers are allowed for function
 				 * declarations, but not function definitions,
-				 * we just set a null hash, and check for that later */
-            param.hash = SYM_NULL_HASH;
+				 * we just set a null atom, and check for that later */
+            param.atom = ATOM_NULL;
             break;
 
         default:
             // printf("token type: %s\n", tok_debug_str(parser->lexer->curr_token.type));
-            syntax_error(parser->lexer->curr_token.err_loc, "parameter unexpectet");
+            syntax_error(f_curr_loc(parser), "parameter unexpectet");
             break;
         }
 
-        type_check_validity(&param.type, &parser->lexer->last_token.err_loc);
+        loc = f_last_loc(parser);
+        type_check_validity(&param.type, &loc);
         vec_sym_param_t_push(&vec, param);
 
         switch (parser->lexer->curr_token.type)
@@ -224,12 +231,14 @@ parse_parameter_list(parser_t *parser)
 
         default:
             // printf("token type: %s\n", tok_debug_str(parser->lexer->curr_token.type));
-            syntax_error(parser->lexer->curr_token.err_loc, "parameter unexpectet");
+            syntax_error(f_curr_loc(parser), "parameter unexpectet");
             break;
         } } }
 static ast_node_t *
-parse_function(parser_t *parser, sym_global_t global, sym_hash_t hash)
+parse_function(parser_t *parser, sym_global_t global, atom_t atom)
 {
+    err_location_t loc;
+
     global.function.params = parse_parameter_list(parser);
 
     /* functiom definition */
@@ -237,7 +246,8 @@ parse_function(parser_t *parser, sym_global_t global, sym_hash_t hash)
     {
         sym_check_for_anon_params(&global.function.params);
 
-        sym_define_global(parser->sym_table, global, hash, &parser->lexer->curr_token.err_loc);
+        loc = f_curr_loc(parser);
+        sym_define_global(parser->sym_table, global, atom, &loc);
 
         /* we shouldent have to check this, since there will be
 		 * a conflict if when we add the params to scope */
@@ -256,7 +266,8 @@ parse_function(parser_t *parser, sym_global_t global, sym_hash_t hash)
     {
         sym_check_for_duplicate_params(&global.function.params);
 
-        sym_declare_global(parser->sym_table, global, hash, &parser->lexer->curr_token.err_loc);
+        loc = f_curr_loc(parser);
+        sym_declare_global(parser->sym_table, global, atom, &loc);
 
         parse_token(parser, TOK_SEMIKOLON);
         return NULL;
@@ -267,15 +278,17 @@ parse_function(parser_t *parser, sym_global_t global, sym_hash_t hash)
 static ast_node_t *
 parse_global_declaration(parser_t *parser)
 {
-    sym_global_t global;
-    sym_hash_t   hash;
+    sym_global_t   global;
+    atom_t         atom;
+    err_location_t loc;
 
 
     global.type = parse_type(parser);
 
-    type_check_validity(&global.type, &parser->lexer->curr_token.err_loc);
+    loc = f_curr_loc(parser);
+    type_check_validity(&global.type, &loc);
 
-    hash = parser->lexer->curr_token.hash;
+    atom = parser->lexer->curr_token.atom;
 
     parse_token(parser, TOK_IDENTIFIER);
 
@@ -290,7 +303,8 @@ parse_global_declaration(parser_t *parser)
         global.val._int = 0;
         global.kind     = SYM_GLOBAL_KIND_VARIABLE;
 
-        sym_define_global(parser->sym_table, global, hash, &parser->lexer->curr_token.err_loc);
+        loc = f_curr_loc(parser);
+        sym_define_global(parser->sym_table, global, atom, &loc);
 
         f_next_token(parser->lexer);
         return NULL;
@@ -298,7 +312,8 @@ parse_global_declaration(parser_t *parser)
     /* decl of global var */
     case TOK_SEMIKOLON:
         global.kind = SYM_GLOBAL_KIND_VARIABLE;
-        sym_declare_global(parser->sym_table, global, hash, &parser->lexer->curr_token.err_loc);
+        loc = f_curr_loc(parser);
+        sym_declare_global(parser->sym_table, global, atom, &loc);
 
         f_next_token(parser->lexer);
         return NULL;
@@ -306,10 +321,10 @@ parse_global_declaration(parser_t *parser)
     /* def or decl of function */
     case TOK_PAREN_OPEN:
         global.kind = SYM_GLOBAL_KIND_FUNCTION;
-        return parse_function(parser, global, hash);
+        return parse_function(parser, global, atom);
 
     default:
-        syntax_error(parser->lexer->curr_token.err_loc, "missing semikolon");
+        syntax_error(f_curr_loc(parser), "missing semikolon");
         return NULL;
     }
 }
@@ -319,11 +334,12 @@ parse_global_declaration(parser_t *parser)
 static ast_node_t *
 parse_local_definition(parser_t *parser)
 {
-    sym_id_t    id;
-    sym_hash_t  hash;
-    sym_local_t local;
-    ast_node_t *right;
-    ast_node_t *left;
+    sym_id_t       id;
+    atom_t         atom;
+    sym_local_t    local;
+    err_location_t loc;
+    ast_node_t *   right;
+    ast_node_t *   left;
 
 
     /* loops through type specifiers */
@@ -331,14 +347,16 @@ parse_local_definition(parser_t *parser)
     local.kind = SYM_LOCAL_KIND_VARIABLE;
 
     /* check for conflicts */
-    type_check_validity(&local.type, &parser->lexer->curr_token.err_loc);
+    loc = f_curr_loc(parser);
+    type_check_validity(&local.type, &loc);
 
-    hash = parser->lexer->curr_token.hash;
+    atom = parser->lexer->curr_token.atom;
 
     /* the next token after specifiers must be an identifier */
     parse_token(parser, TOK_IDENTIFIER);
 
-    id = sym_define_local(parser->sym_table, local, hash, &parser->lexer->curr_token.err_loc);
+    loc = f_curr_loc(parser);
+    id = sym_define_local(parser->sym_table, local, atom, &loc);
 
     /* check for inline assignment and functions and such */
     switch (parser->lexer->curr_token.type)
@@ -371,7 +389,7 @@ parse_local_definition(parser_t *parser)
 
     /* undeclared  */
     default:
-        syntax_error(parser->lexer->curr_token.err_loc, "expected semikolon");
+        syntax_error(f_curr_loc(parser), "expected semikolon");
         return NULL;
     }
 }
@@ -517,7 +535,7 @@ parse_statement(parser_t *parser)
         return parse_while_loop(parser);
 
     case TOK_KEY_ELSE:
-        syntax_error(token.err_loc, "no maching if statement");
+        syntax_error(f_token_loc(parser->lexer, &token), "no maching if statement");
         return NULL;
 
     case TOK_BRACE_OPEN:
@@ -603,12 +621,28 @@ parse_function_body(parser_t *parser)
 }
 
 
+/* location of the current token, for errors */
+err_location_t
+f_curr_loc(const parser_t *parser)
+{
+    return f_token_loc(parser->lexer, &parser->lexer->curr_token);
+}
+
+
+/* location of the last token, for errors */
+err_location_t
+f_last_loc(const parser_t *parser)
+{
+    return f_token_loc(parser->lexer, &parser->lexer->last_token);
+}
+
+
 void
 f_create_parser(parser_t *parser, lexer_t *lexer, sym_table_t *table)
 {
     parser->lexer     = lexer;
     parser->sym_table = table;
-    parser->pool      = mem_pool_create(1024);
+    parser->pool      = mem_pool_create_arena(PARSER_ARENA_RESERVE, PARSER_BLOCK_SIZE);
 }
 
 
@@ -623,12 +657,11 @@ ast_node_t *
 f_generate_ast(parser_t *parser)
 {
     ast_node_t *func;
-    token_t     token = parser->lexer->curr_token;
 
 
     for (;;)
     {
-        switch (token.type)
+        switch (parser->lexer->curr_token.type)
         {
         case TOK_KEY_INT:
         case TOK_KEY_SHORT:
@@ -657,7 +690,7 @@ f_generate_ast(parser_t *parser)
 
         default:
             // printf("parsing token: %s\n", tok_debug_str(token.type));
-            syntax_error(parser->lexer->curr_token.err_loc, "failure parsing");
+            syntax_error(f_curr_loc(parser), "failure parsing");
         }
     }
 }
@@ -24,4 +24,7 @@ ast_node_t *parse_statement(parser_t *parser);
 
 ast_node_t *f_generate_ast(parser_t *parser);
 
+err_location_t f_curr_loc(const parser_t *parser);
+err_location_t f_last_loc(const parser_t *parser);
+
 #endif
@@ -0,0 +1,2613 @@
+#include "f_preprocessor.h"
+#include "atom.h"
+#include "err.h"
+#include "mem.h"
+#include "scan.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define PP_POOL_BLOCK_SIZE (16 * 1024)
+#define PP_SCRATCH_SIZE    (16 * 1024)
+
+/* the deepest #include, which stops a file including itself forever */
+#define PP_MAX_INCLUDE_DEPTH 200
+
+static const char *const pp_name_str[_PP_NAME_COUNT] = {
+    "define", "undef", "include", "if",     "ifdef", "ifndef",  "elif",    "else",
+    "endif",  "error", "warning", "pragma", "line",  "once",    "defined", "__VA_ARGS__",
+};
+
+typedef enum pp_macro_kind
+{
+    PP_MACRO_OBJECT,
+    PP_MACRO_FUNCTION,
+
+    /* built in, and made when expanded */
+    PP_MACRO_FILE,
+    PP_MACRO_LINE,
+
+} pp_macro_kind_t;
+
+typedef struct pp_macro
+{
+    pp_macro_kind_t kind;
+    atom_t          name;
+
+    /* the last parameter is __VA_ARGS__ */
+    bool variadic;
+
+    /* the body has a '##', so it can't be read directly */
+    bool has_paste;
+
+    /* set while the expansion is read, then the name isn't expanded again */
+    bool disabled;
+
+    atom_t * params;
+    uint32_t param_count;
+
+    pp_token_t *body;
+    uint32_t    body_len;
+
+} pp_macro_t;
+
+typedef struct pp_file_id
+{
+    dev_t device;
+    ino_t inode;
+
+} pp_file_id_t;
+
+typedef struct pp_file
+{
+    lexer_t *lexer;
+
+    /* tokens which are read, but not handed out, the last is the next.
+     * the first two tokens of a lexer start here */
+    pp_token_t pending[2];
+    uint32_t   pending_count;
+
+    /* the offset after the last token read, what comes between it and
+     * the next token gives the flags of that token */
+    uint32_t last_end;
+    bool     started;
+
+    /* the conditionals which were open when the file was included */
+    uint32_t conditional_base;
+
+    pp_file_id_t id;
+
+    /* the source_id of its tokens */
+    uint32_t source_id;
+
+} pp_file_t;
+
+typedef struct pp_context
+{
+    const pp_token_t *tokens;
+    uint32_t          pos;
+    uint32_t          count;
+
+    /* the PP_SPACE flag of the first token, which is the one before the macro name */
+    uint16_t lead;
+
+    /* the macro which is expanded, enabled again when the context is done */
+    pp_macro_t *macro;
+
+    /* freed when the context is done, the body of an object-like macro
+     * is read directly and isn't owned */
+    pp_token_t *owned;
+
+} pp_context_t;
+
+typedef struct pp_conditional
+{
+    /* a group was taken, so the rest are skipped */
+    bool taken;
+    bool else_seen;
+
+    /* the directive which opened it, for errors */
+    pp_token_t directive;
+
+} pp_conditional_t;
+
+/* text made by the preprocessor, every piece is followed by a '\0' */
+typedef struct pp_scratch
+{
+    source_t source;
+    uint32_t source_id;
+    uint32_t used;
+    uint32_t size;
+
+    struct pp_scratch *next;
+
+} pp_scratch_t;
+
+/* an argument of a function-like macro, the macro expanded tokens
+ * are only made when a parameter needs them */
+typedef struct pp_arg
+{
+    uint32_t start;
+    uint32_t count;
+
+    bool           is_expanded;
+    vec_pp_token_t expanded;
+
+} pp_arg_t;
+
+
+/* ================================================================================= */
+
+static err_location_t
+pp_loc(const preprocessor_t *pp, const pp_token_t *token)
+{
+    err_location_t loc = { .source = (source_t *)f_pp_source(pp, token->token.source_id),
+                           .offset = token->token.offset };
+
+    return loc;
+}
+
+
+/* every token the preprocessor has, has a source it's spelled in */
+static const char *
+spelling(const preprocessor_t *pp, const token_t *token)
+{
+    return f_pp_source(pp, token->source_id)->start + token->offset;
+}
+
+
+static void
+append_text(vec_uint8_t *text, const char *str, uint32_t len)
+{
+    if (text->size + len > text->capacity)
+    {
+        vec_uint8_t_reserve(text, (text->size + len) * 2);
+    }
+
+    memcpy(text->data + text->size, str, len);
+    text->size += len;
+}
+
+
+static bool
+is_string(const token_t *token)
+{
+    return token->type == TOK_LITERAL && token->literal.type == LITERAL_TYPE_STR;
+}
+
+
+/* the atom of an identifier or the spelling of a keyword, or ATOM_NULL */
+static atom_t
+token_atom(preprocessor_t *pp, const token_t *token)
+{
+    if (token->type == TOK_IDENTIFIER)
+    {
+        return token->atom;
+    }
+
+    if (token->type >= TOK_KEY_IF && token->type <= TOK_KEY_TYPEDEF)
+    {
+        if (!pp->keyword_atoms[token->type])
+        {
+            pp->keyword_atoms[token->type] = atom_intern(spelling(pp, token), token->len);
+        }
+
+        return pp->keyword_atoms[token->type];
+    }
+
+    return ATOM_NULL;
+}
+
+
+static pp_macro_t *
+macro_of(const preprocessor_t *pp, atom_t atom)
+{
+    return atom < pp->macro_capacity ? pp->macros[atom] : NULL;
+}
+
+
+static void
+set_macro(preprocessor_t *pp, atom_t atom, pp_macro_t *macro)
+{
+    uint32_t capacity;
+
+    if (atom >= pp->macro_capacity)
+    {
+        capacity = atom_count() > atom ? atom_count() : atom + 1;
+        capacity += capacity / 2;
+
+        pp->macros = c_realloc(pp->macros, capacity * sizeof(pp_macro_t *));
+        memset(pp->macros + pp->macro_capacity, 0,
+               (capacity - pp->macro_capacity) * sizeof(pp_macro_t *));
+
+        pp->macro_capacity = capacity;
+    }
+
+    pp->macros[atom] = macro;
+}
+
+
+/* ================================================================================= */
+/* reading files */
+
+/* the flags of a token which comes after the whitespace and comments in [ptr, end) */
+static uint16_t
+gap_flags(const char *ptr, const char *end)
+{
+    uint16_t flags = 0;
+
+    while (ptr < end)
+    {
+        if (ptr[0] == '/' && ptr[1] == '*')
+        {
+            ptr = scan_find_comment_end(ptr + 2);
+            ptr += *ptr ? 2 : 1;
+        }
+        else if (ptr[0] == '/' && ptr[1] == '/')
+        {
+            ptr = scan_find_line_end(ptr + 2);
+        }
+        else
+        {
+            if (*ptr == '\n')
+            {
+                flags |= PP_LINE_START;
+            }
+
+            ++ptr;
+        }
+
+        flags |= PP_SPACE;
+    }
+
+    return flags;
+}
+
+
+static inline bool
+is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r';
+}
+
+
+static inline bool
+is_ident_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'
+           || (unsigned char)c >= 0x80;
+}
+
+
+/* skips spaces and comments within a line, a block comment continues the line past
+ * its newlines, and a line comment is skipped to the newline */
+static const char *
+skip_blank(const char *ptr)
+{
+    for (;;)
+    {
+        while (is_blank(*ptr))
+        {
+            ++ptr;
+        }
+
+        if (ptr[0] == '/' && ptr[1] == '*')
+        {
+            ptr = scan_find_comment_end(ptr + 2);
+            ptr += *ptr ? 2 : 0;
+        }
+        else if (ptr[0] == '/' && ptr[1] == '/')
+        {
+            return scan_find_line_end(ptr + 2);
+        }
+        else
+        {
+            return ptr;
+        }
+    }
+}
+
+
+/* skips a string or character literal, which ends at the newline if it isn't closed */
+static const char *
+skip_quoted(const char *ptr)
+{
+    char quote = *ptr++;
+
+    while (*ptr != quote && *ptr != '\n' && *ptr != '\0')
+    {
+        ptr += ptr[0] == '\\' && ptr[1] != '\0' ? 2 : 1;
+    }
+
+    return *ptr == quote ? ptr + 1 : ptr;
+}
+
+
+static pp_token_t
+file_token_of(pp_file_t *file, const token_t *token)
+{
+    const char *start  = file->lexer->source.start;
+    pp_token_t  result = { .token = *token, .flags = 0, .param = -1 };
+
+    result.flags = gap_flags(start + file->last_end, start + token->offset);
+
+    if (!file->started)
+    {
+        result.flags |= PP_LINE_START;
+        file->started = true;
+    }
+
+    result.token.source_id = file->source_id;
+    file->last_end         = token->offset + token->len;
+
+    return result;
+}
+
+
+static pp_file_t *
+top_file(preprocessor_t *pp)
+{
+    return &pp->files[pp->file_count - 1];
+}
+
+
+/* the next token of the file, without handling directives */
+static pp_token_t
+raw_token(pp_file_t *file)
+{
+    token_t token;
+
+    if (file->pending_count > 0)
+    {
+        return file->pending[--file->pending_count];
+    }
+
+    token = f_next_raw_token(file->lexer);
+
+    return file_token_of(file, &token);
+}
+
+
+static void
+unget_raw(pp_file_t *file, const pp_token_t *token)
+{
+    assert(file->pending_count < 2);
+
+    file->pending[file->pending_count++] = *token;
+}
+
+
+/* numbers a source, the tokens spelled in it then have the number as their source_id */
+static uint32_t
+add_source(preprocessor_t *pp, const source_t *source)
+{
+    if (pp->source_count == pp->source_capacity)
+    {
+        pp->source_capacity = pp->source_capacity ? pp->source_capacity * 2 : 16;
+        pp->sources         = c_realloc(pp->sources, pp->source_capacity * sizeof(source_t *));
+    }
+
+    pp->sources[pp->source_count] = source;
+
+    return pp->source_count++;
+}
+
+
+/* starts reading the tokens of 'lexer', which has lexed its first two */
+static void
+push_file(preprocessor_t *pp, lexer_t *lexer, pp_file_id_t id)
+{
+    pp_file_t *file;
+    pp_token_t first;
+
+    if (pp->file_count == pp->file_capacity)
+    {
+        pp->file_capacity = pp->file_capacity ? pp->file_capacity * 2 : 8;
+        pp->files         = c_realloc(pp->files, pp->file_capacity * sizeof(pp_file_t));
+    }
+
+    file = &pp->files[pp->file_count++];
+
+    file->lexer            = lexer;
+    file->last_end         = 0;
+    file->started          = false;
+    file->conditional_base = pp->conditional_count;
+    file->id               = id;
+    file->source_id        = lexer == pp->lexer ? 0 : add_source(pp, &lexer->source);
+
+    first               = file_token_of(file, &lexer->curr_token);
+    file->pending[0]    = file_token_of(file, &lexer->next_token);
+    file->pending[1]    = first;
+    file->pending_count = 2;
+}
+
+
+static void
+add_lexer(preprocessor_t *pp, lexer_t *lexer)
+{
+    if (pp->lexer_count == pp->lexer_capacity)
+    {
+        pp->lexer_capacity = pp->lexer_capacity ? pp->lexer_capacity * 2 : 8;
+        pp->lexers         = c_realloc(pp->lexers, pp->lexer_capacity * sizeof(lexer_t *));
+    }
+
+    pp->lexers[pp->lexer_count++] = lexer;
+}
+
+
+/* whether only spaces and comments are left on the line of the last token read */
+static bool
+at_line_end(const pp_file_t *file)
+{
+    const char *ptr = skip_blank(file->lexer->source.start + file->last_end);
+
+    return *ptr == '\n' || *ptr == '\0';
+}
+
+
+/* reads the rest of the line of a directive, the token after it isn't lexed
+ * when it can be helped, since it may be in a group which is skipped */
+static void
+read_line(preprocessor_t *pp, vec_pp_token_t *line)
+{
+    pp_file_t *file = top_file(pp);
+    pp_token_t token;
+
+    line->size = 0;
+
+    for (;;)
+    {
+        if (file->pending_count == 0 && at_line_end(file))
+        {
+            return;
+        }
+
+        token = raw_token(file);
+
+        if (token.token.type == TOK_EOF || (token.flags & PP_LINE_START))
+        {
+            unget_raw(file, &token);
+            return;
+        }
+
+        vec_pp_token_t_push(line, token);
+    }
+}
+
+
+static void
+skip_line(preprocessor_t *pp)
+{
+    read_line(pp, &pp->line);
+}
+
+
+/* ================================================================================= */
+/* made tokens */
+
+/* lexes 'text' in the scratch source, and returns false if it isn't exactly one token */
+static bool
+lex_text(preprocessor_t *pp, const char *text, uint32_t len, pp_token_t *result)
+{
+    pp_scratch_t *chunk = pp->scratch_chunks;
+    token_t       rest;
+    uint32_t      start;
+    char *        mem;
+
+    if (!chunk || chunk->size - chunk->used < len + 1)
+    {
+        chunk       = c_malloc(sizeof(pp_scratch_t));
+        chunk->size = len + 1 > PP_SCRATCH_SIZE ? len + 1 : PP_SCRATCH_SIZE;
+        chunk->used = 0;
+        chunk->next = pp->scratch_chunks;
+
+        mem = c_malloc(chunk->size + SOURCE_PADDING);
+        memset(mem, 0, chunk->size);
+
+        source_adopt(&chunk->source, "<scratch space>", mem, chunk->size);
+        chunk->source_id = add_source(pp, &chunk->source);
+
+        /* the lexer reads its own copy, tokens point at the chunk */
+        pp->scratch_chunks = chunk;
+        pp->scratch.source = chunk->source;
+    }
+
+    start = chunk->used;
+    memcpy((char *)chunk->source.mem + start, text, len);
+    chunk->used += len + 1;
+
+    pp->scratch.curr = chunk->source.start + start;
+
+    f_lex_token(&pp->scratch, &result->token);
+    f_lex_token(&pp->scratch, &rest);
+
+    result->token.source_id = chunk->source_id;
+    result->flags           = 0;
+    result->param           = -1;
+
+    return result->token.type != TOK_EOF && result->token.offset == start && rest.type == TOK_EOF
+           && rest.offset == start + len;
+}
+
+
+/* appends the spelling of a string or character literal, as it's written inside
+ * a string, where every '"' and '\\' gets a '\\' before it */
+static void
+append_quoted(vec_uint8_t *text, const char *str, uint32_t len)
+{
+    const char *end = str + len;
+
+    for (; str < end; ++str)
+    {
+        if (*str == '"' || *str == '\\')
+        {
+            vec_uint8_t_push(text, '\\');
+        }
+
+        vec_uint8_t_push(text, *str);
+    }
+}
+
+
+/* the # operator, makes a string of the spelling of an argument */
+static pp_token_t
+stringize(preprocessor_t *pp, const pp_token_t *tokens, uint32_t count, const pp_token_t *hash)
+{
+    pp_token_t  result;
+    const char *str;
+    uint32_t    i;
+
+    pp->text.size = 0;
+    vec_uint8_t_push(&pp->text, '"');
+
+    for (i = 0; i < count; ++i)
+    {
+        if (i > 0 && (tokens[i].flags & PP_SPACE))
+        {
+            vec_uint8_t_push(&pp->text, ' ');
+        }
+
+        str = spelling(pp, &tokens[i].token);
+
+        if (tokens[i].token.type == TOK_LITERAL && (str[0] == '"' || str[0] == '\''))
+        {
+            append_quoted(&pp->text, str, tokens[i].token.len);
+        }
+        else
+        {
+            append_text(&pp->text, str, tokens[i].token.len);
+        }
+    }
+
+    vec_uint8_t_push(&pp->text, '"');
+
+    if (!lex_text(pp, (const char *)pp->text.data, pp->text.size, &result))
+    {
+        syntax_error(pp_loc(pp, hash), "'#' does not give a valid string literal");
+    }
+
+    result.flags = hash->flags & PP_SPACE;
+
+    return result;
+}
+
+
+/* the ## operator, makes one token of the spelling of two */
+static pp_token_t
+paste(preprocessor_t *pp, const pp_token_t *left, const pp_token_t *right, const pp_token_t *op)
+{
+    pp_token_t result;
+
+    pp->text.size = 0;
+    append_text(&pp->text, spelling(pp, &left->token), left->token.len);
+    append_text(&pp->text, spelling(pp, &right->token), right->token.len);
+
+    if (!lex_text(pp, (const char *)pp->text.data, pp->text.size, &result))
+    {
+        syntax_error(pp_loc(pp, op),
+                     "pasting \"%.*s\" and \"%.*s\" does not give a valid preprocessing token",
+                     left->token.len, spelling(pp, &left->token), right->token.len,
+                     spelling(pp, &right->token));
+    }
+
+    result.flags = left->flags & PP_SPACE;
+
+    return result;
+}
+
+
+/* __FILE__ and __LINE__, which are where the file being read is */
+static pp_token_t
+builtin_token(preprocessor_t *pp, const pp_macro_t *macro, const pp_token_t *name)
+{
+    pp_file_t * file = top_file(pp);
+    pp_token_t  result;
+    const char *filename;
+    char        line_str[16];
+    uint32_t    line;
+    uint32_t    col;
+
+    pp->text.size = 0;
+
+    if (macro->kind == PP_MACRO_LINE)
+    {
+        source_location(&file->lexer->source, file->last_end ? file->last_end - 1 : 0, &line,
+                        &col);
+        append_text(&pp->text, line_str, snprintf(line_str, sizeof(line_str), "%u", line));
+    }
+    else
+    {
+        vec_uint8_t_push(&pp->text, '"');
+
+        for (filename = file->lexer->source.filename; *filename; ++filename)
+        {
+            if (*filename == '"' || *filename == '\\')
+            {
+                vec_uint8_t_push(&pp->text, '\\');
+            }
+
+            vec_uint8_t_push(&pp->text, *filename);
+        }
+
+        vec_uint8_t_push(&pp->text, '"');
+    }
+
+    lex_text(pp, (const char *)pp->text.data, pp->text.size, &result);
+
+    result.flags = name->flags & PP_SPACE;
+
+    return result;
+}
+
+
+/* ================================================================================= */
+/* macro contexts */
+
+static void
+push_context(preprocessor_t *pp, const pp_token_t *tokens, uint32_t count, pp_macro_t *macro,
+             pp_token_t *owned, uint16_t lead)
+{
+    pp_context_t *context;
+
+    if (pp->context_count == pp->context_capacity)
+    {
+        pp->context_capacity = pp->context_capacity ? pp->context_capacity * 2 : 16;
+        pp->contexts = c_realloc(pp->contexts, pp->context_capacity * sizeof(pp_context_t));
+    }
+
+    context = &pp->contexts[pp->context_count++];
+
+    context->tokens = tokens;
+    context->pos    = 0;
+    context->count  = count;
+    context->lead   = lead;
+    context->macro  = macro;
+    context->owned  = owned;
+
+    if (macro)
+    {
+        macro->disabled = true;
+    }
+}
+
+
+static void
+pop_context(preprocessor_t *pp)
+{
+    pp_context_t *context = &pp->contexts[--pp->context_count];
+
+    if (context->macro)
+    {
+        context->macro->disabled = false;
+    }
+
+    c_free(context->owned);
+}
+
+
+static void
+unget_token(preprocessor_t *pp, const pp_token_t *token)
+{
+    assert(!pp->has_lookahead);
+
+    pp->lookahead     = *token;
+    pp->has_lookahead = true;
+}
+
+
+/* expands and reads the tokens until the next which isn't a macro,
+ * the expansions and the files call each other */
+static pp_token_t expand_next(preprocessor_t *pp);
+
+
+/* macro expands 'count' tokens on their own, as if nothing came after them */
+static void
+expand_tokens(preprocessor_t *pp, const pp_token_t *tokens, uint32_t count, vec_pp_token_t *out)
+{
+    pp_token_t *copy;
+    pp_token_t  token;
+
+    out->size = 0;
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    /* the sentinel is never expanded, and it stops arguments from being read past it */
+    copy = c_malloc((count + 1) * sizeof(pp_token_t));
+    memcpy(copy, tokens, count * sizeof(pp_token_t));
+
+    copy[count]            = tokens[count - 1];
+    copy[count].token.type = TOK_EOF;
+    copy[count].token.len  = 0;
+    copy[count].flags      = PP_SENTINEL;
+
+    push_context(pp, copy, count + 1, NULL, copy, tokens[0].flags & PP_SPACE);
+
+    for (;;)
+    {
+        token = expand_next(pp);
+
+        if (token.flags & PP_SENTINEL)
+        {
+            break;
+        }
+
+        vec_pp_token_t_push(out, token);
+    }
+
+    pop_context(pp);
+}
+
+
+/* ================================================================================= */
+/* #if expressions */
+
+typedef struct pp_value
+{
+    uint64_t value;
+    bool     is_unsigned;
+
+} pp_value_t;
+
+typedef struct pp_eval
+{
+    const pp_token_t *tokens;
+    uint32_t          count;
+    uint32_t          pos;
+
+    /* set inside operands which aren't evaluated, like the right of "0 && x",
+     * which then can't divide by zero */
+    uint32_t skip;
+
+    const pp_token_t *    directive;
+    const preprocessor_t *pp;
+
+} pp_eval_t;
+
+static token_type_t
+eval_peek(const pp_eval_t *ev)
+{
+    return ev->pos < ev->count ? ev->tokens[ev->pos].token.type : TOK_EOF;
+}
+
+
+static err_location_t
+eval_loc(const pp_eval_t *ev)
+{
+    return pp_loc(ev->pp, ev->pos < ev->count ? &ev->tokens[ev->pos] : ev->directive);
+}
+
+
+/* binding of a binary operator, higher binds tighter, 0 isn't one */
+static int32_t
+eval_precedence(token_type_t type)
+{
+    switch (type)
+    {
+    case TOK_STAR:
+    case TOK_DIV:
+    case TOK_MOD:
+        return 10;
+    case TOK_PLUS:
+    case TOK_MINUS:
+        return 9;
+    case TOK_LEFT_SHIFT:
+    case TOK_RIGHT_SHIFT:
+        return 8;
+    case TOK_LESSER:
+    case TOK_GREATER:
+    case TOK_LESSER_OR_EQUAL:
+    case TOK_GREATER_OR_EQUAL:
+        return 7;
+    case TOK_EQUAL:
+    case TOK_NOT_EQUAL:
+        return 6;
+    case TOK_AMPERSAND:
+        return 5;
+    case TOK_EOR:
+        return 4;
+    case TOK_OR_BIT:
+        return 3;
+    case TOK_AND:
+        return 2;
+    case TOK_OR:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+
+static pp_value_t eval_conditional(pp_eval_t *ev);
+
+static pp_value_t
+eval_unary(pp_eval_t *ev)
+{
+    const pp_token_t *token;
+    pp_value_t        result = { 0, false };
+
+    if (ev->pos == ev->count)
+    {
+        syntax_error(eval_loc(ev), "expected value in preprocessor expression");
+    }
+
+    token = &ev->tokens[ev->pos++];
+
+    switch (token->token.type)
+    {
+    case TOK_LITERAL:
+        switch (token->token.literal.type)
+        {
+        case LITERAL_TYPE_UINT:
+        case LITERAL_TYPE_ULONG:
+            result.is_unsigned = true;
+            /* fall through */
+        case LITERAL_TYPE_INT:
+        case LITERAL_TYPE_LONG:
+            result.value = token->token.literal.value._int;
+            break;
+        default:
+            syntax_error(pp_loc(ev->pp, token), "invalid literal in preprocessor expression");
+        }
+        break;
+
+    case TOK_PLUS:
+        result = eval_unary(ev);
+        break;
+
+    case TOK_MINUS:
+        result       = eval_unary(ev);
+        result.value = -result.value;
+        break;
+
+    case TOK_NOT_BIT:
+        result       = eval_unary(ev);
+        result.value = ~result.value;
+        break;
+
+    case TOK_NOT:
+        result.value = !eval_unary(ev).value;
+        break;
+
+    case TOK_PAREN_OPEN:
+        result = eval_conditional(ev);
+
+        if (eval_peek(ev) != TOK_PAREN_CLOSED)
+        {
+            syntax_error(eval_loc(ev), "expected ')' in preprocessor expression");
+        }
+
+        ++ev->pos;
+        break;
+
+    default:
+        /* identifiers which are left after expansion are 0 */
+        if (token->token.type != TOK_IDENTIFIER
+            && !(token->token.type >= TOK_KEY_IF && token->token.type <= TOK_KEY_TYPEDEF))
+        {
+            syntax_error(pp_loc(ev->pp, token), "invalid token in preprocessor expression");
+        }
+    }
+
+    return result;
+}
+
+
+static pp_value_t
+eval_operator(pp_eval_t *ev, const pp_token_t *op, pp_value_t left, pp_value_t right)
+{
+    bool       is_unsigned = left.is_unsigned || right.is_unsigned;
+    pp_value_t result      = { 0, is_unsigned };
+
+    switch (op->token.type)
+    {
+    case TOK_STAR:
+        result.value = left.value * right.value;
+        break;
+
+    case TOK_DIV:
+    case TOK_MOD:
+        if (right.value == 0)
+        {
+            if (!ev->skip)
+            {
+                syntax_error(pp_loc(ev->pp, op), "division by zero in preprocessor expression");
+            }
+        }
+        else if (is_unsigned)
+        {
+            result.value = op->token.type == TOK_DIV ? left.value / right.value
+                                                     : left.value % right.value;
+        }
+        else if ((int64_t)right.value == -1)
+        {
+            /* the smallest value divided by -1 would trap */
+            result.value = op->token.type == TOK_DIV ? -left.value : 0;
+        }
+        else
+        {
+            result.value = op->token.type == TOK_DIV
+                               ? (uint64_t)((int64_t)left.value / (int64_t)right.value)
+                               : (uint64_t)((int64_t)left.value % (int64_t)right.value);
+        }
+        break;
+
+    case TOK_PLUS:
+        result.value = left.value + right.value;
+        break;
+
+    case TOK_MINUS:
+        result.value = left.value - right.value;
+        break;
+
+    case TOK_LEFT_SHIFT:
+        result.value       = left.value << (right.value & 63);
+        result.is_unsigned = left.is_unsigned;
+        break;
+
+    case TOK_RIGHT_SHIFT:
+        result.value       = left.is_unsigned ? left.value >> (right.value & 63)
+                                              : (uint64_t)((int64_t)left.value >> (right.value & 63));
+        result.is_unsigned = left.is_unsigned;
+        break;
+
+    case TOK_LESSER:
+        result.value = is_unsigned ? left.value < right.value
+                                   : (int64_t)left.value < (int64_t)right.value;
+        result.is_unsigned = false;
+        break;
+
+    case TOK_GREATER:
+        result.value = is_unsigned ? left.value > right.value
+                                   : (int64_t)left.value > (int64_t)right.value;
+        result.is_unsigned = false;
+        break;
+
+    case TOK_LESSER_OR_EQUAL:
+        result.value = is_unsigned ? left.value <= right.value
+                                   : (int64_t)left.value <= (int64_t)right.value;
+        result.is_unsigned = false;
+        break;
+
+    case TOK_GREATER_OR_EQUAL:
+        result.value = is_unsigned ? left.value >= right.value
+                                   : (int64_t)left.value >= (int64_t)right.value;
+        result.is_unsigned = false;
+        break;
+
+    case TOK_EQUAL:
+        result.value       = left.value == right.value;
+        result.is_unsigned = false;
+        break;
+
+    case TOK_NOT_EQUAL:
+        result.value       = left.value != right.value;
+        result.is_unsigned = false;
+        break;
+
+    case TOK_AMPERSAND:
+        result.value = left.value & right.value;
+        break;
+
+    case TOK_EOR:
+        result.value = left.value ^ right.value;
+        break;
+
+    case TOK_OR_BIT:
+        result.value = left.value | right.value;
+        break;
+
+    default:
+        assert(false);
+    }
+
+    return result;
+}
+
+
+/* the operators binding at least as tight as 'min_precedence', which are all left associative */
+static pp_value_t
+eval_binary(pp_eval_t *ev, int32_t min_precedence)
+{
+    const pp_token_t *op;
+    pp_value_t        left = eval_unary(ev);
+    pp_value_t        right;
+    int32_t           precedence;
+    bool              skip;
+
+    for (;;)
+    {
+        precedence = eval_precedence(eval_peek(ev));
+
+        if (precedence == 0 || precedence < min_precedence)
+        {
+            return left;
+        }
+
+        op = &ev->tokens[ev->pos++];
+
+        if (op->token.type == TOK_AND || op->token.type == TOK_OR)
+        {
+            /* the right side isn't evaluated when the left decides it */
+            skip = (op->token.type == TOK_AND) == !left.value;
+
+            ev->skip += skip;
+            right = eval_binary(ev, precedence + 1);
+            ev->skip -= skip;
+
+            left.value = op->token.type == TOK_AND ? left.value && right.value
+                                                   : left.value || right.value;
+            left.is_unsigned = false;
+        }
+        else
+        {
+            right = eval_binary(ev, precedence + 1);
+            left  = eval_operator(ev, op, left, right);
+        }
+    }
+}
+
+
+static pp_value_t
+eval_conditional(pp_eval_t *ev)
+{
+    pp_value_t condition = eval_binary(ev, 1);
+    pp_value_t left;
+    pp_value_t right;
+
+    if (eval_peek(ev) != TOK_QUERY)
+    {
+        return condition;
+    }
+
+    ++ev->pos;
+
+    ev->skip += !condition.value;
+    left = eval_conditional(ev);
+    ev->skip -= !condition.value;
+
+    if (eval_peek(ev) != TOK_KOLON)
+    {
+        syntax_error(eval_loc(ev), "expected ':' in preprocessor expression");
+    }
+
+    ++ev->pos;
+
+    ev->skip += !!condition.value;
+    right = eval_conditional(ev);
+    ev->skip -= !!condition.value;
+
+    left = condition.value ? left : right;
+    left.is_unsigned = left.is_unsigned || right.is_unsigned;
+
+    return left;
+}
+
+
+/* replaces "defined X" and "defined(X)" with 1 or 0, which is done before the
+ * line is expanded, so X isn't */
+static void
+replace_defined(preprocessor_t *pp, vec_pp_token_t *line)
+{
+    pp_token_t *tokens = line->data;
+    uint32_t    count  = 0;
+    uint32_t    i      = 0;
+    uint32_t    name;
+    bool        paren;
+
+    while (i < line->size)
+    {
+        if (token_atom(pp, &tokens[i].token) != pp->names[PP_NAME_DEFINED])
+        {
+            tokens[count++] = tokens[i++];
+            continue;
+        }
+
+        paren = i + 1 < line->size && tokens[i + 1].token.type == TOK_PAREN_OPEN;
+        name  = i + 1 + paren;
+
+        if (name >= line->size || !token_atom(pp, &tokens[name].token)
+            || (paren && (name + 1 >= line->size
+                          || tokens[name + 1].token.type != TOK_PAREN_CLOSED)))
+        {
+            syntax_error(pp_loc(pp, &tokens[i]), "'defined' expects a macro name");
+        }
+
+        lex_text(pp, macro_of(pp, token_atom(pp, &tokens[name].token)) ? "1" : "0", 1,
+                 &tokens[count]);
+
+        tokens[count++].flags = tokens[i].flags & PP_SPACE;
+
+        i = name + 1 + paren;
+    }
+
+    line->size = count;
+}
+
+
+/* evaluates the rest of the line of an #if or #elif */
+static bool
+eval_if(preprocessor_t *pp, const pp_token_t *directive)
+{
+    pp_eval_t  ev;
+    pp_value_t result;
+
+    read_line(pp, &pp->line);
+
+    if (pp->line.size == 0)
+    {
+        syntax_error(pp_loc(pp, directive), "#%.*s with no expression", directive->token.len,
+                     spelling(pp, &directive->token));
+    }
+
+    replace_defined(pp, &pp->line);
+    expand_tokens(pp, pp->line.data, pp->line.size, &pp->expanded);
+
+    ev.tokens    = pp->expanded.data;
+    ev.count     = pp->expanded.size;
+    ev.pos       = 0;
+    ev.skip      = 0;
+    ev.directive = directive;
+    ev.pp        = pp;
+
+    result = eval_conditional(&ev);
+
+    if (ev.pos < ev.count)
+    {
+        syntax_error(eval_loc(&ev), "missing binary operator in preprocessor expression");
+    }
+
+    return result.value != 0;
+}
+
+
+/* ================================================================================= */
+/* directives */
+
+/* true if 'a' and 'b' are the same definition, which can be repeated */
+static bool
+macros_equal(const preprocessor_t *pp, const pp_macro_t *a, const pp_macro_t *b)
+{
+    uint32_t i;
+
+    if (a->kind != b->kind || a->variadic != b->variadic || a->param_count != b->param_count
+        || a->body_len != b->body_len)
+    {
+        return false;
+    }
+
+    for (i = 0; i < a->param_count; ++i)
+    {
+        if (a->params[i] != b->params[i])
+        {
+            return false;
+        }
+    }
+
+    for (i = 0; i < a->body_len; ++i)
+    {
+        if (a->body[i].token.type != b->body[i].token.type
+            || a->body[i].token.len != b->body[i].token.len
+            || memcmp(spelling(pp, &a->body[i].token), spelling(pp, &b->body[i].token),
+                      a->body[i].token.len)
+                   != 0
+            || (i > 0 && (a->body[i].flags & PP_SPACE) != (b->body[i].flags & PP_SPACE)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/* the identifier after a directive, such as the macro of #define */
+static pp_token_t
+directive_name(preprocessor_t *pp, const pp_token_t *directive)
+{
+    pp_file_t *file  = top_file(pp);
+    pp_token_t token = raw_token(file);
+
+    if (token.token.type == TOK_EOF || (token.flags & PP_LINE_START))
+    {
+        syntax_error(pp_loc(pp, directive), "macro name missing");
+    }
+
+    if (!token_atom(pp, &token.token))
+    {
+        syntax_error(pp_loc(pp, &token), "macro names must be identifiers");
+    }
+
+    return token;
+}
+
+
+/* reads the parameters of a function-like macro from the line after the '(',
+ * and returns the index of the token after the ')' */
+static uint32_t
+read_params(preprocessor_t *pp, pp_macro_t *macro, const vec_pp_token_t *line)
+{
+    const pp_token_t *tokens = line->data;
+    uint32_t          i      = 1;
+    uint32_t          j;
+    atom_t            atom;
+
+    macro->params = mem_pool_alloc(&pp->pool, line->size * sizeof(atom_t));
+
+    if (i < line->size && tokens[i].token.type == TOK_PAREN_CLOSED)
+    {
+        return i + 1;
+    }
+
+    for (;;)
+    {
+        if (i < line->size && tokens[i].token.type == TOK_ELLIPSIS)
+        {
+            macro->variadic                     = true;
+            macro->params[macro->param_count++] = pp->names[PP_NAME_VA_ARGS];
+            ++i;
+        }
+        else
+        {
+            atom = i < line->size ? token_atom(pp, &tokens[i].token) : ATOM_NULL;
+
+            if (!atom)
+            {
+                syntax_error(pp_loc(pp, &tokens[i < line->size ? i : i - 1]),
+                             "expected parameter name");
+            }
+
+            for (j = 0; j < macro->param_count; ++j)
+            {
+                if (macro->params[j] == atom)
+                {
+                    syntax_error(pp_loc(pp, &tokens[i]), "duplicate macro parameter '%s'",
+                                 atom_str(atom));
+                }
+            }
+
+            if (macro->param_count == INT16_MAX)
+            {
+                syntax_error(pp_loc(pp, &tokens[i]), "too many macro parameters");
+            }
+
+            macro->params[macro->param_count++] = atom;
+            ++i;
+        }
+
+        if (i < line->size && tokens[i].token.type == TOK_PAREN_CLOSED)
+        {
+            return i + 1;
+        }
+
+        if (macro->variadic || i == line->size || tokens[i].token.type != TOK_COMMA)
+        {
+            syntax_error(pp_loc(pp, &tokens[i < line->size ? i : i - 1]),
+                         "expected ',' or ')' in macro parameter list");
+        }
+
+        ++i;
+    }
+}
+
+
+static void
+define_directive(preprocessor_t *pp, const pp_token_t *directive)
+{
+    pp_token_t  name = directive_name(pp, directive);
+    pp_macro_t *macro;
+    pp_macro_t *old;
+    pp_token_t *body;
+    atom_t      atom = token_atom(pp, &name.token);
+    uint32_t    first;
+    uint32_t    i;
+    uint32_t    j;
+
+    if (atom == pp->names[PP_NAME_DEFINED])
+    {
+        syntax_error(pp_loc(pp, &name), "'defined' cannot be used as a macro name");
+    }
+
+    read_line(pp, &pp->line);
+
+    macro = mem_pool_alloc(&pp->pool, sizeof(pp_macro_t));
+
+    macro->kind        = PP_MACRO_OBJECT;
+    macro->name        = atom;
+    macro->variadic    = false;
+    macro->has_paste   = false;
+    macro->disabled    = false;
+    macro->params      = NULL;
+    macro->param_count = 0;
+
+    first = 0;
+
+    /* a '(' right after the name makes it function-like */
+    if (pp->line.size > 0 && pp->line.data[0].token.type == TOK_PAREN_OPEN
+        && !(pp->line.data[0].flags & PP_SPACE))
+    {
+        macro->kind = PP_MACRO_FUNCTION;
+        first       = read_params(pp, macro, &pp->line);
+    }
+
+    macro->body_len = pp->line.size - first;
+    macro->body     = mem_pool_alloc(&pp->pool, macro->body_len * sizeof(pp_token_t));
+    body            = macro->body;
+
+    memcpy(body, pp->line.data + first, macro->body_len * sizeof(pp_token_t));
+
+    for (i = 0; i < macro->body_len; ++i)
+    {
+        atom = token_atom(pp, &body[i].token);
+
+        for (j = 0; j < macro->param_count && atom; ++j)
+        {
+            if (macro->params[j] == atom)
+            {
+                body[i].param = j;
+                break;
+            }
+        }
+
+        if (body[i].token.type == TOK_HASH_HASH)
+        {
+            if (i == 0 || i == macro->body_len - 1)
+            {
+                syntax_error(pp_loc(pp, &body[i]),
+                             "'##' cannot be at either end of a macro expansion");
+            }
+
+            macro->has_paste = true;
+        }
+    }
+
+    for (i = 0; i < macro->body_len && macro->kind == PP_MACRO_FUNCTION; ++i)
+    {
+        if (body[i].token.type == TOK_HASH
+            && (i == macro->body_len - 1 || body[i + 1].param < 0))
+        {
+            syntax_error(pp_loc(pp, &body[i]), "'#' is not followed by a macro parameter");
+        }
+    }
+
+    old = macro_of(pp, macro->name);
+
+    if (old && !macros_equal(pp, old, macro))
+    {
+        syntax_warning(pp_loc(pp, &name), "'%s' redefined", atom_str(macro->name));
+    }
+
+    set_macro(pp, macro->name, macro);
+}
+
+
+static bool
+is_once(const preprocessor_t *pp, pp_file_id_t id)
+{
+    uint32_t i;
+
+    for (i = 0; i < pp->once_count; ++i)
+    {
+        if (pp->once[i].device == id.device && pp->once[i].inode == id.inode)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/* writes 'dir' and 'name' as a path to 'path', and returns true if it's a file */
+static bool
+try_path(char *path, const char *dir, uint32_t dir_len, const char *name, struct stat *st)
+{
+    const char *separator = dir_len > 0 && dir[dir_len - 1] != '/' ? "/" : "";
+
+    if (snprintf(path, PATH_MAX, "%.*s%s%s", dir_len, dir, separator, name) >= PATH_MAX)
+    {
+        return false;
+    }
+
+    return stat(path, st) == 0 && S_ISREG(st->st_mode);
+}
+
+
+/* finds the file 'name', first next to the current file for "name", and then
+ * in the include directories, and starts reading it */
+static void
+open_include(preprocessor_t *pp, const char *name, bool angled, const pp_token_t *at)
+{
+    char         path[PATH_MAX];
+    struct stat  st;
+    pp_file_id_t id;
+    lexer_t *    lexer;
+    const char * current;
+    const char * slash;
+    bool         found = false;
+    uint32_t     i;
+
+    if (pp->file_count > PP_MAX_INCLUDE_DEPTH)
+    {
+        syntax_error(pp_loc(pp, at), "#include nested too deeply");
+    }
+
+    if (name[0] == '/')
+    {
+        found = try_path(path, "", 0, name, &st);
+    }
+    else if (!angled)
+    {
+        current = top_file(pp)->lexer->source.filename;
+        slash   = strrchr(current, '/');
+
+        found = try_path(path, current, slash ? slash - current + 1 : 0, name, &st);
+    }
+
+    for (i = 0; i < pp->include_dir_count && !found && name[0] != '/'; ++i)
+    {
+        found = try_path(path, pp->include_dirs[i], strlen(pp->include_dirs[i]), name, &st);
+    }
+
+    if (!found)
+    {
+        syntax_error(pp_loc(pp, at), "'%s' file not found", name);
+    }
+
+    id.device = st.st_dev;
+    id.inode  = st.st_ino;
+
+    if (is_once(pp, id))
+    {
+        return;
+    }
+
+    lexer = c_malloc(sizeof(lexer_t));
+    f_create_lexer(lexer, path);
+
+    /* only pretokenized files are cached, otherwise lexing as it's read is as fast */
+    if (pp->cache_dir)
+    {
+        lexer->cache_dir = pp->cache_dir;
+        f_lexer_pretokenize(lexer);
+    }
+
+    add_lexer(pp, lexer);
+    push_file(pp, lexer, id);
+}
+
+
+/* the name of an #include, "name" or <name>, written to the text */
+static void
+include_directive(preprocessor_t *pp, const pp_token_t *directive)
+{
+    const pp_token_t *tokens;
+    uint32_t          count;
+    uint32_t          i;
+    bool              angled;
+
+    read_line(pp, &pp->line);
+
+    tokens = pp->line.data;
+    count  = pp->line.size;
+
+    /* the name may come from a macro */
+    if (count > 0 && !is_string(&tokens[0].token) && tokens[0].token.type != TOK_LESSER)
+    {
+        expand_tokens(pp, tokens, count, &pp->expanded);
+
+        tokens = pp->expanded.data;
+        count  = pp->expanded.size;
+    }
+
+    pp->text.size = 0;
+
+    if (count > 0 && is_string(&tokens[0].token) && spelling(pp, &tokens[0].token)[0] == '"')
+    {
+        append_text(&pp->text, spelling(pp, &tokens[0].token) + 1, tokens[0].token.len - 2);
+        angled = false;
+    }
+    else if (count > 0 && tokens[0].token.type == TOK_LESSER)
+    {
+        for (i = 1; i < count && tokens[i].token.type != TOK_GREATER; ++i)
+        {
+            if (i > 1 && (tokens[i].flags & PP_SPACE))
+            {
+                vec_uint8_t_push(&pp->text, ' ');
+            }
+
+            append_text(&pp->text, spelling(pp, &tokens[i].token), tokens[i].token.len);
+        }
+
+        if (i == count)
+        {
+            syntax_error(pp_loc(pp, &tokens[0]), "missing '>' in #include");
+        }
+
+        angled = true;
+    }
+    else
+    {
+        syntax_error(pp_loc(pp, count > 0 ? &tokens[0] : directive),
+                     "#include expects \"FILENAME\" or <FILENAME>");
+    }
+
+    if (pp->text.size == 0)
+    {
+        syntax_error(pp_loc(pp, &tokens[0]), "empty filename in #include");
+    }
+
+    vec_uint8_t_push(&pp->text, '\0');
+
+    open_include(pp, (const char *)pp->text.data, angled, &tokens[0]);
+}
+
+
+/* #error and #warning, the message is the rest of the line */
+static const char *
+message_text(preprocessor_t *pp)
+{
+    uint32_t i;
+
+    read_line(pp, &pp->line);
+
+    pp->text.size = 0;
+
+    for (i = 0; i < pp->line.size; ++i)
+    {
+        if (i > 0 && (pp->line.data[i].flags & PP_SPACE))
+        {
+            vec_uint8_t_push(&pp->text, ' ');
+        }
+
+        append_text(&pp->text, spelling(pp, &pp->line.data[i].token), pp->line.data[i].token.len);
+    }
+
+    vec_uint8_t_push(&pp->text, '\0');
+
+    return (const char *)pp->text.data;
+}
+
+
+static void
+pragma_directive(preprocessor_t *pp)
+{
+    pp_file_t *file = top_file(pp);
+
+    read_line(pp, &pp->line);
+
+    /* other pragmas are for other compilers */
+    if (pp->line.size == 1 && token_atom(pp, &pp->line.data[0].token) == pp->names[PP_NAME_ONCE]
+        && file->id.inode != 0)
+    {
+        if (pp->once_count == pp->once_capacity)
+        {
+            pp->once_capacity = pp->once_capacity ? pp->once_capacity * 2 : 16;
+            pp->once = c_realloc(pp->once, pp->once_capacity * sizeof(pp_file_id_t));
+        }
+
+        pp->once[pp->once_count++] = file->id;
+    }
+}
+
+
+/* the directives which aren't conditionals */
+static void
+other_directive(preprocessor_t *pp, const pp_token_t *directive, atom_t atom)
+{
+    pp_token_t name;
+
+    if (atom == pp->names[PP_NAME_DEFINE])
+    {
+        define_directive(pp, directive);
+    }
+    else if (atom == pp->names[PP_NAME_UNDEF])
+    {
+        name = directive_name(pp, directive);
+        set_macro(pp, token_atom(pp, &name.token), NULL);
+        skip_line(pp);
+    }
+    else if (atom == pp->names[PP_NAME_INCLUDE])
+    {
+        include_directive(pp, directive);
+    }
+    else if (atom == pp->names[PP_NAME_ERROR])
+    {
+        syntax_error(pp_loc(pp, directive), "#error %s", message_text(pp));
+    }
+    else if (atom == pp->names[PP_NAME_WARNING])
+    {
+        syntax_warning(pp_loc(pp, directive), "#warning %s", message_text(pp));
+    }
+    else if (atom == pp->names[PP_NAME_PRAGMA])
+    {
+        pragma_directive(pp);
+    }
+    else if (atom == pp->names[PP_NAME_LINE] || directive->token.type == TOK_LITERAL)
+    {
+        /* #line and the "# 1 file" markers of other preprocessors, locations
+         * are always where the tokens are in the files */
+        skip_line(pp);
+    }
+    else
+    {
+        syntax_error(pp_loc(pp, directive), "invalid preprocessing directive '#%.*s'",
+                     directive->token.len, spelling(pp, &directive->token));
+    }
+}
+
+
+static void
+push_conditional(preprocessor_t *pp, const pp_token_t *directive, bool taken)
+{
+    pp_conditional_t *conditional;
+
+    if (pp->conditional_count == pp->conditional_capacity)
+    {
+        pp->conditional_capacity = pp->conditional_capacity ? pp->conditional_capacity * 2 : 16;
+        pp->conditionals =
+            c_realloc(pp->conditionals, pp->conditional_capacity * sizeof(pp_conditional_t));
+    }
+
+    conditional = &pp->conditionals[pp->conditional_count++];
+
+    conditional->taken     = taken;
+    conditional->else_seen = false;
+    conditional->directive = *directive;
+}
+
+
+/* the innermost conditional of the file, for #elif, #else and #endif */
+static pp_conditional_t *
+current_conditional(preprocessor_t *pp, const pp_token_t *directive)
+{
+    if (pp->conditional_count == top_file(pp)->conditional_base)
+    {
+        syntax_error(pp_loc(pp, directive), "#%.*s without #if", directive->token.len,
+                     spelling(pp, &directive->token));
+    }
+
+    return &pp->conditionals[pp->conditional_count - 1];
+}
+
+
+/* whether the '#' at 'ptr' starts a directive, which it does when only spaces, or
+ * a comment ending at 'blank', come before it on its line */
+static bool
+at_line_start(const char *ptr, const char *start, const char *blank)
+{
+    while (ptr > start && is_blank(ptr[-1]))
+    {
+        --ptr;
+    }
+
+    return ptr == start || ptr[-1] == '\n' || ptr == blank;
+}
+
+
+/* the '#' of the next directive from 'ptr' on, or NULL at the end of the file.
+ * only comments and literals are followed, since a '#' in them doesn't count,
+ * and a quote which isn't closed ends at the newline, as it does in a group
+ * which is skipped */
+static const char *
+find_directive(const char *ptr, const char *start, const char *end)
+{
+    const char *blank = start;
+    const char *comment;
+
+    for (;;)
+    {
+        ptr = scan_find_directive_char(ptr);
+
+        switch (*ptr)
+        {
+        case '#':
+            if (at_line_start(ptr, start, blank))
+            {
+                return ptr;
+            }
+
+            ++ptr;
+            break;
+
+        case '/':
+            if (ptr[1] == '*')
+            {
+                comment = ptr;
+                ptr     = scan_find_comment_end(ptr + 2);
+                ptr += *ptr ? 2 : 0;
+
+                if (at_line_start(comment, start, blank))
+                {
+                    blank = ptr;
+                }
+            }
+            else if (ptr[1] == '/')
+            {
+                ptr = scan_find_line_end(ptr + 2);
+            }
+            else
+            {
+                ++ptr;
+            }
+            break;
+
+        case '"':
+        case '\'':
+            ptr = skip_quoted(ptr);
+            break;
+
+        default:
+            if (ptr >= end)
+            {
+                return NULL;
+            }
+
+            /* a '\0' in the file */
+            ++ptr;
+            break;
+        }
+    }
+}
+
+
+/*
+ * skips a group which isn't taken, and returns the name of the #elif, #else or
+ * #endif which ends it. the text of the group is only searched for directives,
+ * nothing in it is lexed, so it doesn't have to be valid tokens, and the lexer
+ * is then moved to the directive which ends it
+ */
+static pp_token_t
+skip_group(preprocessor_t *pp)
+{
+    pp_file_t * file  = top_file(pp);
+    const char *start = file->lexer->source.start;
+    const char *end   = file->lexer->source.end;
+    uint32_t    depth = 0;
+    const char *hash;
+    const char *name;
+    const char *name_end;
+    pp_token_t  token;
+    atom_t      atom;
+
+    /* a token which was read ahead may be the '#' of a directive */
+    hash = start + (file->pending_count ? file->pending[file->pending_count - 1].token.offset
+                                        : file->last_end);
+
+    for (;; hash = name_end)
+    {
+        hash = find_directive(hash, start, end);
+
+        if (!hash)
+        {
+            syntax_error(pp_loc(pp, &pp->conditionals[pp->conditional_count - 1].directive),
+                         "unterminated conditional directive");
+        }
+
+        name     = skip_blank(hash + 1);
+        name_end = name;
+
+        while (is_ident_char(*name_end))
+        {
+            ++name_end;
+        }
+
+        if (name_end == name)
+        {
+            name_end = hash + 1;
+            continue;
+        }
+
+        atom = atom_intern(name, name_end - name);
+
+        if (atom == pp->names[PP_NAME_IF] || atom == pp->names[PP_NAME_IFDEF]
+            || atom == pp->names[PP_NAME_IFNDEF])
+        {
+            ++depth;
+        }
+        else if (atom == pp->names[PP_NAME_ENDIF] && depth > 0)
+        {
+            --depth;
+        }
+        else if (depth == 0
+                 && (atom == pp->names[PP_NAME_ENDIF] || atom == pp->names[PP_NAME_ELIF]
+                     || atom == pp->names[PP_NAME_ELSE]))
+        {
+            break;
+        }
+    }
+
+    f_lexer_skip_to(file->lexer, hash - start);
+
+    file->pending_count = 0;
+    file->last_end      = hash - start;
+
+    raw_token(file);
+    token = raw_token(file);
+
+    return token;
+}
+
+
+/* handles the directive after a '#' at the start of a line */
+static void
+directive(preprocessor_t *pp)
+{
+    pp_file_t *       file = top_file(pp);
+    pp_token_t        name = raw_token(file);
+    pp_conditional_t *conditional;
+    pp_token_t        macro;
+    atom_t            atom;
+    bool              take;
+
+    /* a '#' alone on a line does nothing */
+    if (name.token.type == TOK_EOF || (name.flags & PP_LINE_START))
+    {
+        unget_raw(file, &name);
+        return;
+    }
+
+    atom = token_atom(pp, &name.token);
+
+    for (;;)
+    {
+        if (atom == pp->names[PP_NAME_IF])
+        {
+            take = eval_if(pp, &name);
+            push_conditional(pp, &name, take);
+        }
+        else if (atom == pp->names[PP_NAME_IFDEF] || atom == pp->names[PP_NAME_IFNDEF])
+        {
+            macro = directive_name(pp, &name);
+            take  = (macro_of(pp, token_atom(pp, &macro.token)) != NULL)
+                   == (atom == pp->names[PP_NAME_IFDEF]);
+
+            skip_line(pp);
+            push_conditional(pp, &name, take);
+        }
+        else if (atom == pp->names[PP_NAME_ELIF])
+        {
+            conditional = current_conditional(pp, &name);
+
+            if (conditional->else_seen)
+            {
+                syntax_error(pp_loc(pp, &name), "#elif after #else");
+            }
+
+            if (conditional->taken)
+            {
+                skip_line(pp);
+                take = false;
+            }
+            else
+            {
+                take = eval_if(pp, &name);
+                pp->conditionals[pp->conditional_count - 1].taken = take;
+            }
+        }
+        else if (atom == pp->names[PP_NAME_ELSE])
+        {
+            conditional = current_conditional(pp, &name);
+
+            if (conditional->else_seen)
+            {
+                syntax_error(pp_loc(pp, &name), "#else after #else");
+            }
+
+            take                   = !conditional->taken;
+            conditional->taken     = true;
+            conditional->else_seen = true;
+
+            skip_line(pp);
+        }
+        else if (atom == pp->names[PP_NAME_ENDIF])
+        {
+            current_conditional(pp, &name);
+            --pp->conditional_count;
+
+            skip_line(pp);
+            return;
+        }
+        else
+        {
+            other_directive(pp, &name, atom);
+            return;
+        }
+
+        if (take)
+        {
+            return;
+        }
+
+        name = skip_group(pp);
+        atom = token_atom(pp, &name.token);
+    }
+}
+
+
+/* ================================================================================= */
+/* expansion */
+
+/* the next token of the files, after the directives before it */
+static pp_token_t
+file_token(preprocessor_t *pp)
+{
+    pp_file_t *file;
+    pp_token_t token;
+
+    for (;;)
+    {
+        file  = top_file(pp);
+        token = raw_token(file);
+
+        if (token.token.type == TOK_HASH && (token.flags & PP_LINE_START))
+        {
+            directive(pp);
+            continue;
+        }
+
+        if (token.token.type != TOK_EOF)
+        {
+            return token;
+        }
+
+        if (pp->conditional_count > file->conditional_base)
+        {
+            syntax_error(pp_loc(pp, &pp->conditionals[pp->conditional_count - 1].directive),
+                         "unterminated conditional directive");
+        }
+
+        /* the main file gives EOF for ever */
+        if (pp->file_count == 1)
+        {
+            unget_raw(file, &token);
+            return token;
+        }
+
+        --pp->file_count;
+    }
+}
+
+
+/* the next token of the innermost expansion, or of the files */
+static pp_token_t
+read_token(preprocessor_t *pp)
+{
+    pp_context_t *context;
+    pp_token_t    token;
+
+    if (pp->has_lookahead)
+    {
+        pp->has_lookahead = false;
+        return pp->lookahead;
+    }
+
+    while (pp->context_count > 0)
+    {
+        context = &pp->contexts[pp->context_count - 1];
+
+        if (context->pos < context->count)
+        {
+            token = context->tokens[context->pos];
+
+            if (context->pos++ == 0)
+            {
+                token.flags = (token.flags & ~PP_SPACE) | context->lead;
+            }
+
+            return token;
+        }
+
+        pop_context(pp);
+    }
+
+    return file_token(pp);
+}
+
+
+/* reads the arguments of a function-like macro after the '(', into 'tokens'. they
+ * are read to the ')' before they are counted, so a list which isn't closed is
+ * reported as that, and not as too many arguments */
+static pp_arg_t *
+collect_args(preprocessor_t *pp, const pp_macro_t *macro, const pp_token_t *name,
+             const pp_token_t *paren, vec_pp_token_t *tokens)
+{
+    uint32_t   max   = macro->param_count > 0 ? macro->param_count : 1;
+    pp_arg_t * args  = c_malloc(max * sizeof(pp_arg_t));
+    uint32_t   count = 0;
+    uint32_t   depth = 0;
+    uint32_t   i;
+    pp_token_t token;
+
+    /* the first comma after the last argument */
+    pp_token_t extra = { .token.type = TOK_NULL };
+
+    args[0].start = 0;
+
+    for (;;)
+    {
+        token = read_token(pp);
+
+        if (token.token.type == TOK_EOF)
+        {
+            syntax_error(pp_loc(pp, paren), "unterminated argument list invoking macro '%s'",
+                         atom_str(macro->name));
+        }
+
+        if (token.token.type == TOK_PAREN_OPEN)
+        {
+            ++depth;
+        }
+        else if (token.token.type == TOK_PAREN_CLOSED)
+        {
+            if (depth == 0)
+            {
+                break;
+            }
+
+            --depth;
+        }
+        else if (token.token.type == TOK_COMMA && depth == 0
+                 && !(macro->variadic && count + 1 == macro->param_count))
+        {
+            if (count + 1 == max)
+            {
+                if (extra.token.type == TOK_NULL)
+                {
+                    extra = token;
+                }
+
+                continue;
+            }
+
+            args[count].count   = tokens->size - args[count].start;
+            args[++count].start = tokens->size;
+            continue;
+        }
+
+        vec_pp_token_t_push(tokens, token);
+    }
+
+    if (extra.token.type != TOK_NULL)
+    {
+        syntax_error(pp_loc(pp, &extra), "too many arguments given to macro '%s'",
+                     atom_str(macro->name));
+    }
+
+    args[count].count = tokens->size - args[count].start;
+    ++count;
+
+    /* a variadic macro can be given nothing for the variable arguments */
+    if (count + 1 == macro->param_count && macro->variadic)
+    {
+        args[count].start = tokens->size;
+        args[count].count = 0;
+        ++count;
+    }
+
+    if (count < macro->param_count)
+    {
+        syntax_error(pp_loc(pp, name), "macro '%s' requires %u arguments, but only %u given",
+                     atom_str(macro->name), macro->param_count, count);
+    }
+
+    if (macro->param_count == 0 && args[0].count > 0)
+    {
+        syntax_error(pp_loc(pp, name), "macro '%s' takes no arguments", atom_str(macro->name));
+    }
+
+    for (i = 0; i < max; ++i)
+    {
+        args[i].is_expanded = false;
+    }
+
+    return args;
+}
+
+
+static void
+append_tokens(vec_pp_token_t *out, const pp_token_t *tokens, uint32_t count, uint16_t lead)
+{
+    uint32_t i;
+
+    for (i = 0; i < count; ++i)
+    {
+        vec_pp_token_t_push(out, tokens[i]);
+    }
+
+    if (count > 0)
+    {
+        out->data[out->size - count].flags =
+            (out->data[out->size - count].flags & ~PP_SPACE) | lead;
+    }
+}
+
+
+/* appends the operand at body[i], which is a token, a parameter, or a '#' and
+ * its parameter, and returns the index after it. the parameters are replaced by
+ * their arguments, which are macro expanded first if 'expand' is set */
+static uint32_t
+append_operand(preprocessor_t *pp, const pp_macro_t *macro, pp_arg_t *args,
+               const vec_pp_token_t *raw, uint32_t i, bool expand, vec_pp_token_t *out)
+{
+    const pp_token_t *token = &macro->body[i];
+    pp_arg_t *        arg;
+    pp_token_t        made;
+
+    if (macro->kind == PP_MACRO_FUNCTION && token->token.type == TOK_HASH)
+    {
+        arg  = &args[macro->body[i + 1].param];
+        made = stringize(pp, raw->data + arg->start, arg->count, token);
+
+        vec_pp_token_t_push(out, made);
+        return i + 2;
+    }
+
+    if (token->param < 0)
+    {
+        vec_pp_token_t_push(out, *token);
+        return i + 1;
+    }
+
+    arg = &args[token->param];
+
+    if (!expand)
+    {
+        append_tokens(out, raw->data + arg->start, arg->count, token->flags & PP_SPACE);
+        return i + 1;
+    }
+
+    if (!arg->is_expanded)
+    {
+        arg->expanded = vec_pp_token_t_create(arg->count + 4);
+        expand_tokens(pp, raw->data + arg->start, arg->count, &arg->expanded);
+
+        arg->is_expanded = true;
+    }
+
+    append_tokens(out, arg->expanded.data, arg->expanded.size, token->flags & PP_SPACE);
+    return i + 1;
+}
+
+
+/* replaces the parameters of the body, and does the # and ## operators */
+static void
+substitute(preprocessor_t *pp, const pp_macro_t *macro, pp_arg_t *args, const vec_pp_token_t *raw,
+           vec_pp_token_t *out)
+{
+    const pp_token_t *body = macro->body;
+    pp_token_t        made;
+    uint32_t          start;
+    uint32_t          middle;
+    uint32_t          op;
+    uint32_t          i = 0;
+
+    while (i < macro->body_len)
+    {
+        /* the operands of '##' aren't expanded */
+        start = out->size;
+        i     = append_operand(pp, macro, args, raw, i,
+                           i + 1 == macro->body_len || body[i + 1].token.type != TOK_HASH_HASH,
+                           out);
+
+        while (i < macro->body_len && body[i].token.type == TOK_HASH_HASH)
+        {
+            op     = i;
+            middle = out->size;
+            i      = append_operand(pp, macro, args, raw, i + 1, false, out);
+
+            /* an empty argument is a placemarker, and the other side is left as it is */
+            if (middle == start || middle == out->size)
+            {
+                continue;
+            }
+
+            made = paste(pp, &out->data[middle - 1], &out->data[middle], &body[op]);
+
+            out->data[middle - 1] = made;
+            memmove(&out->data[middle], &out->data[middle + 1],
+                    (out->size - middle - 1) * sizeof(pp_token_t));
+            --out->size;
+        }
+    }
+}
+
+
+/* starts expanding 'macro', and returns false if it isn't, since a function-like
+ * macro isn't followed by a '(', or it was replaced by 'token' */
+static bool
+expand_macro(preprocessor_t *pp, pp_macro_t *macro, pp_token_t *token)
+{
+    vec_pp_token_t raw;
+    vec_pp_token_t out;
+    pp_arg_t *     args = NULL;
+    pp_token_t     next;
+    uint32_t       i;
+
+    switch (macro->kind)
+    {
+    case PP_MACRO_FILE:
+    case PP_MACRO_LINE:
+        *token = builtin_token(pp, macro, token);
+        return false;
+
+    case PP_MACRO_OBJECT:
+        if (!macro->has_paste)
+        {
+            if (macro->body_len > 0)
+            {
+                push_context(pp, macro->body, macro->body_len, macro, NULL,
+                             token->flags & PP_SPACE);
+            }
+
+            return true;
+        }
+        break;
+
+    case PP_MACRO_FUNCTION:
+        next = read_token(pp);
+
+        if (next.token.type != TOK_PAREN_OPEN)
+        {
+            unget_token(pp, &next);
+            return false;
+        }
+        break;
+    }
+
+    raw = vec_pp_token_t_create(16);
+    out = vec_pp_token_t_create(macro->body_len + 16);
+
+    if (macro->kind == PP_MACRO_FUNCTION)
+    {
+        args = collect_args(pp, macro, token, &next, &raw);
+    }
+
+    substitute(pp, macro, args, &raw, &out);
+
+    for (i = 0; args && i < macro->param_count; ++i)
+    {
+        if (args[i].is_expanded)
+        {
+            vec_pp_token_t_destroy(&args[i].expanded);
+        }
+    }
+
+    c_free(args);
+    vec_pp_token_t_destroy(&raw);
+
+    if (out.size == 0)
+    {
+        vec_pp_token_t_destroy(&out);
+        return true;
+    }
+
+    /* the context owns the tokens from now on */
+    push_context(pp, out.data, out.size, macro, out.data, token->flags & PP_SPACE);
+
+    return true;
+}
+
+
+static pp_token_t
+expand_next(preprocessor_t *pp)
+{
+    pp_token_t  token;
+    pp_macro_t *macro;
+
+    for (;;)
+    {
+        token = read_token(pp);
+
+        if (token.flags & PP_NO_EXPAND)
+        {
+            return token;
+        }
+
+        macro = macro_of(pp, token_atom(pp, &token.token));
+
+        if (!macro)
+        {
+            return token;
+        }
+
+        /* a macro isn't expanded inside itself, and the name is never expanded again */
+        if (macro->disabled)
+        {
+            token.flags |= PP_NO_EXPAND;
+            return token;
+        }
+
+        if (!expand_macro(pp, macro, &token))
+        {
+            return token;
+        }
+    }
+}
+
+
+/* ================================================================================= */
+
+void
+f_create_preprocessor(preprocessor_t *pp)
+{
+    static const char *const builtins[] = { "__FILE__", "__LINE__" };
+
+    pp_macro_t *macro;
+    uint32_t    i;
+
+    memset(pp, 0, sizeof(preprocessor_t));
+
+    /* the scratch source is lexed before any lexer calls it */
+    scan_init();
+
+    pp->pool       = mem_pool_create(PP_POOL_BLOCK_SIZE);
+    pp->predefined = vec_uint8_t_create(256);
+    pp->text       = vec_uint8_t_create(256);
+    pp->line       = vec_pp_token_t_create(64);
+    pp->expanded   = vec_pp_token_t_create(64);
+
+    f_create_string_table(&pp->scratch.strings);
+
+    /* 0 is the main file, which is known once it's attached */
+    add_source(pp, NULL);
+
+    for (i = 0; i < _PP_NAME_COUNT; ++i)
+    {
+        pp->names[i] = atom_intern(pp_name_str[i], strlen(pp_name_str[i]));
+    }
+
+    for (i = 0; i < 2; ++i)
+    {
+        macro = mem_pool_alloc(&pp->pool, sizeof(pp_macro_t));
+        memset(macro, 0, sizeof(pp_macro_t));
+
+        macro->kind = i == 0 ? PP_MACRO_FILE : PP_MACRO_LINE;
+        macro->name = atom_intern(builtins[i], strlen(builtins[i]));
+
+        set_macro(pp, macro->name, macro);
+    }
+}
+
+
+/* must be done after the lexer it was attached to */
+void
+f_destroy_preprocessor(preprocessor_t *pp)
+{
+    pp_scratch_t *chunk;
+    uint32_t      i;
+
+    while (pp->context_count > 0)
+    {
+        pop_context(pp);
+    }
+
+    for (i = 0; i < pp->lexer_count; ++i)
+    {
+        f_destroy_lexer(pp->lexers[i]);
+        c_free(pp->lexers[i]);
+    }
+
+    if (pp->predefined_lexer)
+    {
+        f_destroy_lexer(pp->predefined_lexer);
+        c_free(pp->predefined_lexer);
+    }
+
+    while (pp->scratch_chunks)
+    {
+        chunk              = pp->scratch_chunks;
+        pp->scratch_chunks = chunk->next;
+
+        source_close(&chunk->source);
+        c_free(chunk);
+    }
+
+    for (i = 0; i < pp->include_dir_count; ++i)
+    {
+        c_free(pp->include_dirs[i]);
+    }
+
+    f_destroy_string_table(&pp->scratch.strings);
+    mem_pool_destroy(&pp->pool);
+
+    vec_uint8_t_destroy(&pp->predefined);
+    vec_uint8_t_destroy(&pp->text);
+    vec_pp_token_t_destroy(&pp->line);
+    vec_pp_token_t_destroy(&pp->expanded);
+
+    c_free(pp->macros);
+    c_free(pp->files);
+    c_free(pp->sources);
+    c_free(pp->lexers);
+    c_free(pp->contexts);
+    c_free(pp->conditionals);
+    c_free(pp->include_dirs);
+    c_free(pp->once);
+
+    pp->lexer = NULL;
+}
+
+
+void
+f_pp_add_include_dir(preprocessor_t *pp, const char *dir)
+{
+    size_t size = strlen(dir) + 1;
+
+    pp->include_dirs = c_realloc(pp->include_dirs, (pp->include_dir_count + 1) * sizeof(char *));
+    pp->include_dirs[pp->include_dir_count] = c_malloc(size);
+
+    memcpy(pp->include_dirs[pp->include_dir_count++], dir, size);
+}
+
+
+void
+f_pp_define(preprocessor_t *pp, const char *definition)
+{
+    const char *value = strchr(definition, '=');
+
+    append_text(&pp->predefined, "#define ", 8);
+
+    if (value)
+    {
+        append_text(&pp->predefined, definition, value - definition);
+        vec_uint8_t_push(&pp->predefined, ' ');
+        append_text(&pp->predefined, value + 1, strlen(value + 1));
+    }
+    else
+    {
+        append_text(&pp->predefined, definition, strlen(definition));
+        append_text(&pp->predefined, " 1", 2);
+    }
+
+    vec_uint8_t_push(&pp->predefined, '\n');
+}
+
+
+void
+f_pp_undef(preprocessor_t *pp, const char *name)
+{
+    append_text(&pp->predefined, "#undef ", 7);
+    append_text(&pp->predefined, name, strlen(name));
+    vec_uint8_t_push(&pp->predefined, '\n');
+}
+
+
+void
+f_pp_attach(preprocessor_t *pp, lexer_t *lexer)
+{
+    pp_file_id_t id = { 0, 0 };
+    struct stat  st;
+    source_t     source;
+    char *       mem;
+
+    assert(!lexer->source.stream && !pp->lexer);
+
+    pp->lexer      = lexer;
+    pp->cache_dir  = lexer->cache_dir;
+    pp->sources[0] = &lexer->source;
+
+    if (stat(lexer->source.filename, &st) == 0)
+    {
+        id.device = st.st_dev;
+        id.inode  = st.st_ino;
+    }
+
+    push_file(pp, lexer, id);
+
+    /* the definitions are read first, as if the main file included them */
+    if (pp->predefined.size > 0)
+    {
+        mem = c_malloc(pp->predefined.size + SOURCE_PADDING);
+        memcpy(mem, pp->predefined.data, pp->predefined.size);
+
+        source_adopt(&source, "<command line>", mem, pp->predefined.size);
+
+        pp->predefined_lexer = c_malloc(sizeof(lexer_t));
+        f_create_lexer_from_source(pp->predefined_lexer, &source);
+
+        push_file(pp, pp->predefined_lexer, (pp_file_id_t){ 0, 0 });
+    }
+
+    lexer->pp = pp;
+
+    /* the tokens the lexer already had are the first of the files now */
+    f_next_token(lexer);
+    f_next_token(lexer);
+
+    memset(&lexer->last_token, 0, sizeof(token_t));
+}
+
+
+static pp_token_t
+next_output(preprocessor_t *pp)
+{
+    if (pp->has_next_output)
+    {
+        pp->has_next_output = false;
+        return pp->next_output;
+    }
+
+    return expand_next(pp);
+}
+
+
+/* adjacent string literals are joined here, once macros are expanded and the
+ * directives are gone, which is translation phase 6 */
+token_t
+f_pp_next_token(preprocessor_t *pp)
+{
+    pp_token_t token = next_output(pp);
+    pp_token_t next;
+
+    if (!is_string(&token.token))
+    {
+        return token.token;
+    }
+
+    next = next_output(pp);
+
+    if (is_string(&next.token))
+    {
+        pp->text.size = 0;
+        append_text(&pp->text, token.token.literal.value.str.data,
+                    token.token.literal.value.str.size);
+
+        while (is_string(&next.token))
+        {
+            append_text(&pp->text, next.token.literal.value.str.data,
+                        next.token.literal.value.str.size);
+
+            next = next_output(pp);
+        }
+
+        token.token.literal.value.str.size = pp->text.size;
+        token.token.literal.value.str.data =
+            f_intern_string(&pp->scratch.strings, (const char *)pp->text.data, pp->text.size);
+    }
+
+    pp->next_output     = next;
+    pp->has_next_output = true;
+
+    return token.token;
+}
+
+
+const source_t *
+f_pp_source(const preprocessor_t *pp, uint32_t id)
+{
+    return pp->sources[id];
+}
+
+
+const source_t *
+f_pp_included(const preprocessor_t *pp, uint32_t index)
+{
+    return index < pp->lexer_count ? &pp->lexers[index]->source : NULL;
+}
@@ -0,0 +1,185 @@
+#ifndef _F_PREPROCESSOR_
+#define _F_PREPROCESSOR_
+
+#include "f_lexer.h"
+#include "f_string.h"
+#include "mem.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * runs between the lexer and the parser. the tokens of the files are read with
+ * f_next_raw_token, directives are handled as they are met, and macros are
+ * expanded into tokens directly, so nothing is turned back into text. macros
+ * are found in a table indexed by the atom of their name
+ */
+
+/* the token was the first on its line */
+#define PP_LINE_START (1 << 0)
+
+/* whitespace or a comment came before the token, used by the # operator */
+#define PP_SPACE (1 << 1)
+
+/* an identifier which named a macro while it was being expanded, which is then
+ * never expanded, even if it is read again later */
+#define PP_NO_EXPAND (1 << 2)
+
+/* ends the tokens of a macro argument or an #if line, so they can be
+ * expanded on their own */
+#define PP_SENTINEL (1 << 3)
+
+typedef struct pp_token
+{
+    token_t  token;
+    uint16_t flags;
+
+    /* in the body of a function-like macro, the index of the parameter
+     * the token names, otherwise -1 */
+    int16_t param;
+
+} pp_token_t;
+
+#define VEC_TYPE pp_token_t
+#include "templates/vec.h"
+#undef VEC_TYPE
+
+/* the identifiers the preprocessor looks for, their atoms are made once */
+typedef enum pp_name
+{
+    PP_NAME_DEFINE,
+    PP_NAME_UNDEF,
+    PP_NAME_INCLUDE,
+    PP_NAME_IF,
+    PP_NAME_IFDEF,
+    PP_NAME_IFNDEF,
+    PP_NAME_ELIF,
+    PP_NAME_ELSE,
+    PP_NAME_ENDIF,
+    PP_NAME_ERROR,
+    PP_NAME_WARNING,
+    PP_NAME_PRAGMA,
+    PP_NAME_LINE,
+    PP_NAME_ONCE,
+    PP_NAME_DEFINED,
+    PP_NAME_VA_ARGS,
+
+    _PP_NAME_COUNT
+
+} pp_name_t;
+
+struct pp_macro;
+struct pp_file;
+struct pp_context;
+struct pp_conditional;
+struct pp_file_id;
+struct pp_scratch;
+
+typedef struct preprocessor
+{
+    /* the lexer of the main file, which the tokens are given to */
+    lexer_t *lexer;
+
+    /* pretokenized included files are cached here as well, taken from the lexer */
+    const char *cache_dir;
+
+    /* the macro of every atom, or NULL, grown as macros are defined */
+    struct pp_macro **macros;
+    uint32_t          macro_capacity;
+
+    /* macros are never freed before the preprocessor, since an expansion
+     * may still use one which was undefined while its arguments were read */
+    mem_pool_t pool;
+
+    /* keywords can be macros too, this is the atom of their spelling */
+    atom_t keyword_atoms[_TOK_COUNT];
+    atom_t names[_PP_NAME_COUNT];
+
+    /* the files being read, the last is the innermost #include */
+    struct pp_file *files;
+    uint32_t        file_count;
+    uint32_t        file_capacity;
+
+    /* the source of every token by its source_id, 0 is the main file */
+    const source_t **sources;
+    uint32_t         source_count;
+    uint32_t         source_capacity;
+
+    /* every lexer made for an included file, tokens point into their
+     * strings, so they are kept until the preprocessor is destroyed */
+    lexer_t **lexers;
+    uint32_t  lexer_count;
+    uint32_t  lexer_capacity;
+
+    /* the macro expansions being read, which come before the files */
+    struct pp_context *contexts;
+    uint32_t           context_count;
+    uint32_t           context_capacity;
+
+    /* a token which was read to see if it's a '(', and put back */
+    pp_token_t lookahead;
+    bool       has_lookahead;
+
+    /* the token after a string literal, read to see if it's another */
+    pp_token_t next_output;
+    bool       has_next_output;
+
+    /* the #if, #ifdef and #ifndef which are open */
+    struct pp_conditional *conditionals;
+    uint32_t               conditional_count;
+    uint32_t               conditional_capacity;
+
+    /* the directories searched by #include, in order */
+    char **  include_dirs;
+    uint32_t include_dir_count;
+
+    /* the files with a #pragma once */
+    struct pp_file_id *once;
+    uint32_t           once_count;
+    uint32_t           once_capacity;
+
+    /* the definitions of f_pp_define, which are read as a file before the main file,
+     * by a lexer of their own */
+    vec_uint8_t predefined;
+    lexer_t *   predefined_lexer;
+
+    /* the tokens made by # and ##, and built-in macros, are written to a scratch
+     * source, and lexed there with a lexer of its own */
+    lexer_t            scratch;
+    struct pp_scratch *scratch_chunks;
+
+    /* used while building the text of those tokens */
+    vec_uint8_t text;
+
+    /* the line of the directive being handled, and the line after expansion */
+    vec_pp_token_t line;
+    vec_pp_token_t expanded;
+
+} preprocessor_t;
+
+void f_create_preprocessor(preprocessor_t *pp);
+void f_destroy_preprocessor(preprocessor_t *pp);
+
+/* adds a directory to search for included files, after those added before */
+void f_pp_add_include_dir(preprocessor_t *pp, const char *dir);
+
+/* defines a macro before the main file is read, "NAME" defines it as 1, and
+ * "NAME=VALUE" as VALUE, the same as the -D option of other compilers */
+void f_pp_define(preprocessor_t *pp, const char *definition);
+void f_pp_undef(preprocessor_t *pp, const char *name);
+
+/* preprocesses the tokens of 'lexer', which f_next_token gives from then on. the
+ * lexer can be pretokenized or pipelined first, but can't be a stream, those are
+ * read whole with source_read_all before the lexer is made */
+void f_pp_attach(preprocessor_t *pp, lexer_t *lexer);
+
+token_t f_pp_next_token(preprocessor_t *pp);
+
+/* the source a token of f_pp_next_token is spelled in, by its source_id */
+const source_t *f_pp_source(const preprocessor_t *pp, uint32_t id);
+
+/* the source of the 'index'th file included so far, or NULL if there are
+ * fewer, a file included more than once is there every time */
+const source_t *f_pp_included(const preprocessor_t *pp, uint32_t index);
+
+#endif
@@ -0,0 +1,111 @@
+#include "f_string.h"
+#include "atom.h"
+#include "err.h"
+
+#include <string.h>
+
+#define STRING_POOL_BLOCK_SIZE (64 * 1024)
+#define STRING_MIN_SLOTS       256
+
+
+void
+f_create_string_table(string_table_t *table)
+{
+    table->pool = mem_pool_create(STRING_POOL_BLOCK_SIZE);
+
+    table->slots     = calloc(STRING_MIN_SLOTS, sizeof(string_entry_t));
+    table->slot_mask = STRING_MIN_SLOTS - 1;
+    table->count     = 0;
+
+    if (!table->slots)
+    {
+        fatal_error("out of memory");
+    }
+
+    table->buffer = vec_uint8_t_create(256);
+}
+
+
+void
+f_destroy_string_table(string_table_t *table)
+{
+    mem_pool_destroy(&table->pool);
+    vec_uint8_t_destroy(&table->buffer);
+    c_free(table->slots);
+
+    table->slots = NULL;
+}
+
+
+/* doubles the number of slots, and inserts every entry again */
+static void
+grow_table(string_table_t *table)
+{
+    uint32_t        slot_count = (table->slot_mask + 1) * 2;
+    string_entry_t *slots      = calloc(slot_count, sizeof(string_entry_t));
+    uint32_t        i;
+    uint32_t        slot;
+
+    if (!slots)
+    {
+        fatal_error("out of memory");
+    }
+
+    for (i = 0; i <= table->slot_mask; ++i)
+    {
+        if (!table->slots[i].data)
+        {
+            continue;
+        }
+
+        slot = table->slots[i].hash & (slot_count - 1);
+
+        while (slots[slot].data)
+        {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+
+        slots[slot] = table->slots[i];
+    }
+
+    c_free(table->slots);
+
+    table->slots     = slots;
+    table->slot_mask = slot_count - 1;
+}
+
+
+const char *
+f_intern_string(string_table_t *table, const char *data, uint32_t size)
+{
+    string_entry_t *entry;
+    uint32_t        hash = atom_hash(data, size);
+    uint32_t        slot = hash & table->slot_mask;
+    char *          copy;
+
+    for (entry = &table->slots[slot]; entry->data; entry = &table->slots[slot])
+    {
+        if (entry->hash == hash && entry->size == size && memcmp(entry->data, data, size) == 0)
+        {
+            return entry->data;
+        }
+
+        slot = (slot + 1) & table->slot_mask;
+    }
+
+    /* strings may contain '\0', but are terminated by one as well */
+    copy = mem_pool_alloc(&table->pool, size + 1);
+    memcpy(copy, data, size);
+    copy[size] = '\0';
+
+    entry->data = copy;
+    entry->size = size;
+    entry->hash = hash;
+
+    if (++table->count * 2 > table->slot_mask + 1)
+    {
+        grow_table(table);
+    }
+
+    return copy;
+}
@@ -0,0 +1,44 @@
+#ifndef _F_STRING_
+#define _F_STRING_
+
+#include "mem.h"
+
+#include <stdint.h>
+
+#define VEC_TYPE uint8_t
+#include "templates/vec.h"
+#undef VEC_TYPE
+
+typedef struct string_entry
+{
+    const char *data;
+    uint32_t    size;
+    uint32_t    hash;
+
+} string_entry_t;
+
+/*
+ * the decoded string literals of a translation unit, every distinct string is
+ * stored once in the pool, followed by a '\0', and lives as long as the table
+ */
+typedef struct string_table
+{
+    mem_pool_t pool;
+
+    /* open addressing, a slot is empty if 'data' is NULL */
+    string_entry_t *slots;
+    uint32_t        slot_mask;
+    uint32_t        count;
+
+    /* literals are decoded into this, before they are interned */
+    vec_uint8_t buffer;
+
+} string_table_t;
+
+void f_create_string_table(string_table_t *table);
+void f_destroy_string_table(string_table_t *table);
+
+/* returns the stored copy of the string, which is the same pointer for equal strings */
+const char *f_intern_string(string_table_t *table, const char *data, uint32_t size);
+
+#endif
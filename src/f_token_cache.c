@@ -0,0 +1,412 @@
+#include "f_token_cache.h"
+#include "atom.h"
+#include "mem.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * a cache file is a header followed by these sections, each starting 8 byte aligned:
+ *
+ *  types     uint8_t[token_count]
+ *  offsets   uint32_t[token_count]
+ *  payloads  uint32_t[token_count]
+ *  values    cached_value_t[value_count]
+ *  atoms     cached_atom_t[atom_count]
+ *  strings   char[string_size]
+ *
+ * the first three are copied into the token buffer as they are, only the values
+ * point at anything, which is done with indices and offsets
+ */
+
+/* must be changed whenever the lexer gives different tokens, or the layout changes */
+#define TOKEN_CACHE_VERSION 5
+
+#define CACHED_IDENTIFIER UINT32_MAX
+
+static const char cache_magic[8] = { 'C', 'b', 't', 'o', 'k', 'e', 'n', 's' };
+
+typedef struct cache_header
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t source_size;
+    uint64_t hash;
+
+    uint32_t token_count;
+    uint32_t value_count;
+    uint32_t atom_count;
+    uint32_t string_size;
+
+} cache_header_t;
+
+/* the payload of an identifier or literal, identifiers index the atoms,
+ * and strings are an offset into the string data */
+typedef struct cached_value
+{
+    uint32_t len;
+
+    /* the literal type, or CACHED_IDENTIFIER */
+    uint32_t type;
+    uint64_t bits;
+    uint32_t size;
+    uint32_t unused;
+
+} cached_value_t;
+
+/* every distinct identifier, found by its first use in the source. it's interned
+ * again from the spelling there, so nothing in the file can give it the wrong atom */
+typedef struct cached_atom
+{
+    uint32_t offset;
+    uint32_t len;
+
+} cached_atom_t;
+
+typedef struct cache_layout
+{
+    size_t offsets;
+    size_t payloads;
+    size_t values;
+    size_t atoms;
+    size_t strings;
+    size_t size;
+
+} cache_layout_t;
+
+
+static size_t
+align8(size_t size)
+{
+    return (size + 7) & ~(size_t)7;
+}
+
+
+static cache_layout_t
+cache_layout(const cache_header_t *header)
+{
+    cache_layout_t layout;
+
+    layout.offsets  = align8(sizeof(cache_header_t) + header->token_count);
+    layout.payloads = layout.offsets + align8(header->token_count * sizeof(uint32_t));
+    layout.values   = layout.payloads + align8(header->token_count * sizeof(uint32_t));
+    layout.atoms    = layout.values + header->value_count * sizeof(cached_value_t);
+    layout.strings  = layout.atoms + align8(header->atom_count * sizeof(cached_atom_t));
+    layout.size     = layout.strings + header->string_size;
+
+    return layout;
+}
+
+
+static void
+cache_path(char *path, size_t size, const char *dir, uint64_t hash)
+{
+    snprintf(path, size, "%s/%016llx.tok", dir, (unsigned long long)hash);
+}
+
+
+/* checks the payloads, the rest can't make the token buffer read out of bounds */
+static bool
+valid_tokens(const cache_header_t *header, const uint8_t *types, const uint32_t *payloads)
+{
+    uint32_t values = 0;
+    uint32_t i;
+
+    if (header->token_count == 0 || types[header->token_count - 1] != TOK_EOF)
+    {
+        return false;
+    }
+
+    for (i = 0; i < header->token_count; ++i)
+    {
+        if (types[i] >= _TOK_COUNT)
+        {
+            return false;
+        }
+
+        if ((types[i] == TOK_IDENTIFIER || types[i] == TOK_LITERAL) && payloads[i] != values++)
+        {
+            return false;
+        }
+    }
+
+    return values == header->value_count;
+}
+
+
+/* interns the identifiers and strings, and makes the payloads of the token buffer */
+static bool
+load_values(lexer_t *lexer, const cache_header_t *header, const char *mem, cache_layout_t layout)
+{
+    const cached_value_t *values      = (const cached_value_t *)(mem + layout.values);
+    const cached_atom_t * atoms       = (const cached_atom_t *)(mem + layout.atoms);
+    const char *          strings     = mem + layout.strings;
+    uint32_t              source_size = lexer->source.end - lexer->source.start;
+    atom_t *              atom_map    = c_malloc((header->atom_count + 1) * sizeof(atom_t));
+    token_payload_t       payload;
+    uint32_t              i;
+
+    for (i = 0; i < header->atom_count; ++i)
+    {
+        if (atoms[i].offset > source_size || atoms[i].len > source_size - atoms[i].offset)
+        {
+            c_free(atom_map);
+            return false;
+        }
+
+        atom_map[i] = atom_intern(lexer->source.start + atoms[i].offset, atoms[i].len);
+    }
+
+    for (i = 0; i < header->value_count; ++i)
+    {
+        payload.len = values[i].len;
+
+        if (values[i].type == CACHED_IDENTIFIER)
+        {
+            if (values[i].bits >= header->atom_count)
+            {
+                c_free(atom_map);
+                return false;
+            }
+
+            payload.atom = atom_map[values[i].bits];
+        }
+        else if (values[i].type == LITERAL_TYPE_STR)
+        {
+            if (values[i].bits > header->string_size
+                || values[i].size > header->string_size - values[i].bits)
+            {
+                c_free(atom_map);
+                return false;
+            }
+
+            payload.literal.type           = LITERAL_TYPE_STR;
+            payload.literal.value.str.size = values[i].size;
+            payload.literal.value.str.data =
+                f_intern_string(&lexer->strings, strings + values[i].bits, values[i].size);
+        }
+        else
+        {
+            payload.literal.type       = values[i].type;
+            payload.literal.value._int = values[i].bits;
+        }
+
+        vec_token_payload_t_push(&lexer->tokens.values, payload);
+    }
+
+    c_free(atom_map);
+
+    return true;
+}
+
+
+bool
+f_load_token_cache(lexer_t *lexer, const char *dir, uint64_t hash)
+{
+    char                  path[4096];
+    const cache_header_t *header;
+    cache_layout_t        layout;
+    struct stat           info;
+    const char *          mem;
+    uint32_t              count;
+    bool                  loaded = false;
+    int                   fd;
+
+    cache_path(path, sizeof(path), dir, hash);
+
+    fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    if (fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(cache_header_t))
+    {
+        close(fd);
+        return false;
+    }
+
+    mem = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mem == MAP_FAILED)
+    {
+        return false;
+    }
+
+    header = (const cache_header_t *)mem;
+    layout = cache_layout(header);
+    count  = header->token_count;
+
+    if (memcmp(header->magic, cache_magic, sizeof(cache_magic)) != 0
+        || header->version != TOKEN_CACHE_VERSION || header->hash != hash
+        || header->source_size != (uint32_t)(lexer->source.end - lexer->source.start)
+        || layout.size != (size_t)info.st_size
+        || !valid_tokens(header, (const uint8_t *)(header + 1),
+                         (const uint32_t *)(mem + layout.payloads)))
+    {
+        munmap((void *)mem, info.st_size);
+        return false;
+    }
+
+    f_create_token_buffer(&lexer->tokens, count);
+
+    memcpy(lexer->tokens.types.data, header + 1, count);
+    memcpy(lexer->tokens.offsets.data, mem + layout.offsets, count * sizeof(uint32_t));
+    memcpy(lexer->tokens.payloads.data, mem + layout.payloads, count * sizeof(uint32_t));
+
+    lexer->tokens.types.size    = count;
+    lexer->tokens.offsets.size  = count;
+    lexer->tokens.payloads.size = count;
+
+    loaded = load_values(lexer, header, mem, layout);
+
+    if (!loaded)
+    {
+        f_destroy_token_buffer(&lexer->tokens);
+    }
+
+    munmap((void *)mem, info.st_size);
+
+    return loaded;
+}
+
+
+/* writes 'size' bytes, padded with zeroes to 8 bytes */
+static bool
+write_section(FILE *file, const void *data, size_t size)
+{
+    static const char zeroes[8] = { 0 };
+    size_t            padding   = align8(size) - size;
+
+    if (size && fwrite(data, size, 1, file) != 1)
+    {
+        return false;
+    }
+
+    return !padding || fwrite(zeroes, padding, 1, file) == 1;
+}
+
+
+void
+f_store_token_cache(const lexer_t *lexer, const char *dir, uint64_t hash)
+{
+    const token_buffer_t *tokens = &lexer->tokens;
+    char                  path[4096];
+    char                  tmp_path[4096 + 32];
+    cache_header_t        header;
+    cached_value_t *      values;
+    cached_atom_t *       atoms;
+    vec_uint8_t           strings;
+    token_payload_t       payload;
+    uint32_t *            atom_index;
+    uint32_t              distinct = 0;
+    uint32_t              i;
+    FILE *                file;
+    bool                  written;
+
+    /* atom_index holds one more than the index of the atoms already seen */
+    atom_index = calloc(atom_count(), sizeof(uint32_t));
+    values     = c_malloc(tokens->values.size * sizeof(cached_value_t) + 1);
+    atoms      = c_malloc(tokens->values.size * sizeof(cached_atom_t) + 1);
+    strings    = vec_uint8_t_create(256);
+
+    if (!atom_index)
+    {
+        fatal_error("out of memory");
+    }
+
+    for (i = 0; i < tokens->types.size; ++i)
+    {
+        if (tokens->types.data[i] != TOK_IDENTIFIER && tokens->types.data[i] != TOK_LITERAL)
+        {
+            continue;
+        }
+
+        payload = tokens->values.data[tokens->payloads.data[i]];
+
+        memset(&values[tokens->payloads.data[i]], 0, sizeof(cached_value_t));
+        values[tokens->payloads.data[i]].len = payload.len;
+
+        if (tokens->types.data[i] == TOK_IDENTIFIER)
+        {
+            if (!atom_index[payload.atom])
+            {
+                atoms[distinct].offset = tokens->offsets.data[i];
+                atoms[distinct].len    = atom_len(payload.atom);
+
+                atom_index[payload.atom] = ++distinct;
+            }
+
+            values[tokens->payloads.data[i]].type = CACHED_IDENTIFIER;
+            values[tokens->payloads.data[i]].bits = atom_index[payload.atom] - 1;
+        }
+        else if (payload.literal.type == LITERAL_TYPE_STR)
+        {
+            values[tokens->payloads.data[i]].type = LITERAL_TYPE_STR;
+            values[tokens->payloads.data[i]].bits = strings.size;
+            values[tokens->payloads.data[i]].size = payload.literal.value.str.size;
+
+            if (strings.size + payload.literal.value.str.size > strings.capacity)
+            {
+                vec_uint8_t_reserve(&strings, (strings.size + payload.literal.value.str.size) * 2);
+            }
+
+            memcpy(strings.data + strings.size, payload.literal.value.str.data,
+                   payload.literal.value.str.size);
+            strings.size += payload.literal.value.str.size;
+        }
+        else
+        {
+            values[tokens->payloads.data[i]].type = payload.literal.type;
+            values[tokens->payloads.data[i]].bits = payload.literal.value._int;
+        }
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+
+    header.version     = TOKEN_CACHE_VERSION;
+    header.source_size = lexer->source.end - lexer->source.start;
+    header.hash        = hash;
+    header.token_count = tokens->types.size;
+    header.value_count = tokens->values.size;
+    header.atom_count  = distinct;
+    header.string_size = strings.size;
+
+    /* written next to the real file, and renamed over it when complete, so a
+     * reader never sees half a file */
+    cache_path(path, sizeof(path), dir, hash);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld", path, (long)getpid());
+
+    file = fopen(tmp_path, "wb");
+
+    if (file)
+    {
+        written = fwrite(&header, sizeof(header), 1, file) == 1
+                  && write_section(file, tokens->types.data, header.token_count)
+                  && write_section(file, tokens->offsets.data, header.token_count * sizeof(uint32_t))
+                  && write_section(file, tokens->payloads.data, header.token_count * sizeof(uint32_t))
+                  && write_section(file, values, header.value_count * sizeof(cached_value_t))
+                  && write_section(file, atoms, distinct * sizeof(cached_atom_t))
+                  && (!strings.size || fwrite(strings.data, strings.size, 1, file) == 1);
+
+        written = fclose(file) == 0 && written;
+
+        if (!written || rename(tmp_path, path) != 0)
+        {
+            remove(tmp_path);
+        }
+    }
+
+    c_free(atom_index);
+    c_free(values);
+    c_free(atoms);
+    vec_uint8_t_destroy(&strings);
+}
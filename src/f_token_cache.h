@@ -0,0 +1,23 @@
+#ifndef _F_TOKEN_CACHE_
+#define _F_TOKEN_CACHE_
+
+#include "f_lexer.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * the tokens of a file can be stored in a cache directory, in a file named after
+ * the hash of its contents. the file is laid out as the token buffer, so loading
+ * it is a few copies out of a mapping, and interning the identifiers and strings
+ */
+
+/* fills the token buffer of the lexer from the cache, returns false
+ * if the file isn't cached, or the cached tokens can't be used */
+bool f_load_token_cache(lexer_t *lexer, const char *dir, uint64_t hash);
+
+/* writes the token buffer of the lexer to the cache, failures are ignored
+ * since the file is just lexed again next time */
+void f_store_token_cache(const lexer_t *lexer, const char *dir, uint64_t hash);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef _F_UNICODE_
+#define _F_UNICODE_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * identifiers may contain any code point with the XID_Start and XID_Continue
+ * properties, written in utf-8. only code points above ascii are in the tables,
+ * ascii is handled by the lexer itself
+ */
+
+/* decodes the code point at 'str', and sets 'width' to the number of bytes it takes,
+ * returns UINT32_MAX for overlong, truncated or otherwise invalid sequences. reads
+ * at most 4 bytes, and stops at a '\0' */
+uint32_t f_utf8_decode(const char *str, uint32_t *width);
+
+bool f_is_xid_start(uint32_t code_point);
+bool f_is_xid_continue(uint32_t code_point);
+
+#endif
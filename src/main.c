@@ -4,6 +4,7 @@
 #include "f_expr.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 
 #if 0
@@ -112,19 +113,150 @@ run_test3()
 #endif
 
 #include "f_type.h"
+#include "f_preprocessor.h"
+#include "f_deps.h"
+#include "sym_snapshot.h"
+#include "source_batch.h"
 
-int main()
+#include <string.h>
+
+/* an -I, -D or -U option, which is given to the preprocessor of every file */
+typedef struct option
+{
+	char kind;
+	const char *value;
+}
+option_t;
+
+static void
+add_options(preprocessor_t *pp, const option_t *options, int option_count)
+{
+	for (int i = 0; i < option_count; ++i) {
+		if (options[i].kind == 'I')
+			f_pp_add_include_dir(pp, options[i].value);
+		else if (options[i].kind == 'D')
+			f_pp_define(pp, options[i].value);
+		else
+			f_pp_undef(pp, options[i].value);
+	}
+}
+
+/* a prelude which was parsed, the locations of its symbols point into the sources of
+ * the lexer and the preprocessor, so they are kept as long as the symbol table */
+typedef struct prelude
+{
+	bool parsed;
+	lexer_t lexer;
+	preprocessor_t pp;
+}
+prelude_t;
+
+/* declares the globals of the prelude file in 'table'. the prelude is parsed once,
+ * and its symbols are stored in a snapshot next to it, "prelude.sym", which is
+ * used while the prelude, the options and the files it includes are the same */
+static void
+load_prelude(prelude_t *prelude, sym_table_t *table, const char *filename,
+	const option_t *options, int option_count)
+{
+	char path[4096];
+	uint64_t hash;
+
+	source_t source;
+	parser_t parser;
+
+	lexer_t *lexer = &prelude->lexer;
+	preprocessor_t *pp = &prelude->pp;
+
+	prelude->parsed = false;
+
+	source_open(&source, filename);
+	hash = source_hash(&source);
+
+	for (int i = 0; i < option_count; ++i) {
+		hash ^= atom_hash(options[i].value, strlen(options[i].value)) + options[i].kind;
+		hash *= 0x100000001b3ull;
+	}
+
+	snprintf(path, sizeof(path), "%s.sym", filename);
+
+	if (sym_load_snapshot(table, path, hash)) {
+		source_close(&source);
+		return;
+	}
+
+	f_create_lexer_from_source(lexer, &source);
+	f_create_preprocessor(pp);
+	add_options(pp, options, option_count);
+
+	f_lexer_pretokenize(lexer);
+	f_pp_attach(pp, lexer);
+
+	f_create_parser(&parser, lexer, table);
+
+	/* only the declarations are kept */
+	while (f_generate_ast(&parser))
+		mem_pool_free_all(&parser.pool);
+
+	/* every file the preprocessor opened is checked when the snapshot is loaded */
+	uint32_t dep_count = 0;
+	while (f_pp_included(pp, dep_count))
+		++dep_count;
+
+	sym_snapshot_dep_t *deps = c_malloc(dep_count * sizeof(sym_snapshot_dep_t) + 1);
+
+	for (uint32_t i = 0; i < dep_count; ++i) {
+		deps[i].path = f_pp_included(pp, i)->filename;
+		deps[i].hash = source_hash(f_pp_included(pp, i));
+	}
+
+	sym_store_snapshot(table, path, hash, deps, dep_count);
+	c_free(deps);
+
+	f_destroy_parser(&parser);
+
+	prelude->parsed = true;
+}
+
+/* parses one file, with a symbol table of its own, which starts
+ * with the globals of the prelude if there is one */
+static void
+compile(source_t *source, const option_t *options, int option_count)
 {
 	ast_node_t *tree;
 
 	sym_table_t table;
 	lexer_t lexer;
 	parser_t parser;
+	preprocessor_t pp;
+	prelude_t prelude = { .parsed = false };
+
+	const char *prelude_file = getenv("CB_PRELUDE");
 
 	sym_create_table(&table, 32);
-	f_create_lexer(&lexer, "../test/test5.c");
-	f_create_parser(&parser, &lexer, &table);
 
+	if (prelude_file)
+		load_prelude(&prelude, &table, prelude_file, options, option_count);
+
+	/* the preprocessor looks at the text between the tokens, which streams
+	 * don't keep, so stdin and pipes are read to the end first */
+	source_read_all(source);
+
+	f_create_lexer_from_source(&lexer, source);
+	f_create_preprocessor(&pp);
+	add_options(&pp, options, option_count);
+
+	/* unchanged files are loaded from the token cache, if there is one */
+	lexer.cache_dir = getenv("CB_TOKEN_CACHE");
+
+	/* files are lexed up front, or on another thread while parsing with CB_PIPELINE */
+	if (getenv("CB_PIPELINE"))
+		f_lexer_pipeline(&lexer);
+	else
+		f_lexer_pretokenize(&lexer);
+
+	f_pp_attach(&pp, &lexer);
+
+	f_create_parser(&parser, &lexer, &table);
 	type_t left = {
 		.primitive = TYPE_CHAR,
 		.indirection = 1,
@@ -135,7 +267,9 @@ int main()
 		.indirection = 0,
 	};
 
-	type_t s = f_get_expr_type(left, right, AST_PRE_DECREMENT, &lexer.curr_token.err_loc);
+	err_location_t loc = f_token_loc(&lexer, &lexer.curr_token);
+
+	type_t s = f_get_expr_type(left, right, AST_PRE_DECREMENT, &loc);
 	f_print_type(s);
 
 	tree = f_generate_ast(&parser);
@@ -157,7 +291,107 @@ int main()
 
 	sym_destroy_table(&table);
 	f_destroy_lexer(&lexer);
+	f_destroy_preprocessor(&pp);
 	f_destroy_parser(&parser);
 
+	if (prelude.parsed) {
+		f_destroy_lexer(&prelude.lexer);
+		f_destroy_preprocessor(&prelude.pp);
+	}
+}
+
+/* --scan-deps, lists the files each file includes instead of compiling it */
+static void
+scan_deps(const char **files, int file_count, const option_t *options, int option_count,
+		  deps_format_t format)
+{
+	source_batch_t batch;
+	source_t source;
+	dep_scanner_t scanner;
+	int64_t index;
+
+	f_create_dep_scanner(&scanner);
+
+	for (int i = 0; i < option_count; ++i) {
+		if (options[i].kind == 'I')
+			f_deps_add_include_dir(&scanner, options[i].value);
+		else if (options[i].kind == 'D')
+			f_deps_define(&scanner, options[i].value);
+		else
+			f_deps_undef(&scanner, options[i].value);
+	}
+
+	source_batch_open(&batch, files, file_count);
+
+	while ((index = source_batch_next(&batch, &source)) >= 0) {
+		f_deps_scan(&scanner, &source, index);
+		source_close(&source);
+	}
+
+	/* written at the end, so the order doesn't depend on which file was read first */
+	f_deps_write(&scanner, stdout, format);
+
+	source_batch_close(&batch);
+	f_destroy_dep_scanner(&scanner);
+}
+
+int main(int argc, char **argv)
+{
+	static const char *default_file = "../test/test5.c";
+
+	source_batch_t batch;
+	source_t source;
+
+	const char **files = c_malloc(argc * sizeof(char *));
+	option_t *options = c_malloc(argc * sizeof(option_t));
+	int file_count = 0;
+	int option_count = 0;
+	int scan_mode = 0;
+	deps_format_t format = DEPS_FORMAT_MAKE;
+
+	/* "-Idir" and "-I dir" are the same, and so are -D and -U */
+	for (int i = 1; i < argc; ++i) {
+		if (argv[i][0] == '-' && argv[i][1] && strchr("IDU", argv[i][1])) {
+			options[option_count].kind = argv[i][1];
+
+			if (argv[i][2])
+				options[option_count].value = argv[i] + 2;
+			else if (i + 1 < argc)
+				options[option_count].value = argv[++i];
+			else
+				fatal_error("missing argument to '%s'", argv[i]);
+
+			++option_count;
+		} else if (strcmp(argv[i], "--scan-deps") == 0 || strcmp(argv[i], "--scan-deps=make") == 0) {
+			scan_mode = 1;
+		} else if (strcmp(argv[i], "--scan-deps=json") == 0) {
+			scan_mode = 1;
+			format = DEPS_FORMAT_JSON;
+		} else {
+			files[file_count++] = argv[i];
+		}
+	}
+
+	if (file_count == 0)
+		files[file_count++] = default_file;
+
+	/* all the files are read at once, and each is compiled as soon as it has
+	 * been read. "-" reads from stdin */
+	if (scan_mode) {
+		scan_deps(files, file_count, options, option_count, format);
+	} else {
+		source_batch_open(&batch, files, file_count);
+
+		while (source_batch_next(&batch, &source) >= 0)
+			compile(&source, options, option_count);
+
+		source_batch_close(&batch);
+	}
+
+	atom_destroy_table();
+
+	c_free(files);
+	c_free(options);
+
 	return 0;
 }
@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <sys/mman.h>
 
 #include "err.h"
 
@@ -27,12 +28,136 @@ create_block(size_t block_size)
 
     block->end   = (byte_t *)block + sizeof(mem_block_t) + block_size;
     block->start = (byte_t *)block + sizeof(mem_block_t);
-    block->top   = block->start;
-	block->next  = NULL;
+    block->top    = block->start;
+    block->before = 0;
+	block->next   = NULL;
 
     return block;
 }
 
+static size_t
+block_capacity(const mem_block_t *block)
+{
+    return block->end - block->start;
+}
+
+/* takes the first kept block with room for 'block_size' bytes, or makes a new one */
+static mem_block_t *
+take_block(mem_pool_t *pool, size_t block_size)
+{
+    mem_block_t **link;
+    mem_block_t * block;
+
+    for (link = &pool->free; *link; link = &(*link)->next)
+    {
+        if (block_capacity(*link) >= block_size)
+        {
+            block = *link;
+            *link = block->next;
+
+            pool->free_size -= block_capacity(block);
+
+            block->top  = block->start;
+            block->next = NULL;
+
+            return block;
+        }
+    }
+
+    return create_block(block_size);
+}
+
+/* keeps the blocks of the list starting at 'block' while they fit in what is
+ * retained, and frees the rest */
+static void
+release_blocks(mem_pool_t *pool, mem_block_t *block)
+{
+    mem_block_t *next;
+
+    for (; block; block = next)
+    {
+        next = block->next;
+
+        if (pool->free_size + block_capacity(block) > pool->retain)
+        {
+            c_free(block);
+            continue;
+        }
+
+        pool->free_size += block_capacity(block);
+
+        block->next = pool->free;
+        pool->free  = block;
+    }
+}
+
+/* an arena is backed by memory this many bytes at a time, a multiple of the page size */
+#define MEM_ARENA_COMMIT (64 * 1024)
+
+static size_t
+round_commit(size_t size)
+{
+    return (size + MEM_ARENA_COMMIT - 1) & ~(size_t)(MEM_ARENA_COMMIT - 1);
+}
+
+/* backs the arena with memory up to at least 'end' */
+static void
+commit_arena(mem_pool_t *pool, byte_t *end)
+{
+    mem_block_t *block = pool->first;
+    size_t       size;
+
+    if ((size_t)(end - pool->base) > pool->reserve)
+    {
+        fatal_error("arena of %zu bytes is full", pool->reserve);
+    }
+
+    size = round_commit(end - pool->base);
+
+    if (size > pool->reserve)
+    {
+        size = pool->reserve;
+    }
+
+    if (mprotect(block->end, pool->base + size - block->end, PROT_READ | PROT_WRITE) != 0)
+    {
+        fatal_error("out of memory");
+    }
+
+    block->end = pool->base + size;
+}
+
+/* gives back the memory above what is retained, but keeps the address space */
+static void
+decommit_arena(mem_pool_t *pool)
+{
+    mem_block_t *block = pool->first;
+    byte_t *     keep  = pool->base + round_commit(sizeof(mem_block_t) + pool->retain);
+
+    if (keep >= block->end)
+    {
+        return;
+    }
+
+    madvise(keep, block->end - keep, MADV_DONTNEED);
+    mprotect(keep, block->end - keep, PROT_NONE);
+
+    block->end = keep;
+}
+
+static void
+free_blocks(mem_block_t *block)
+{
+    mem_block_t *next;
+
+    while (block)
+    {
+        next = block->next;
+        c_free(block);
+        block = next;
+    }
+}
+
 /* creates a new memory pool, and allocates one chunk */
 mem_pool_t
 mem_pool_create(size_t block_size)
@@ -42,24 +167,116 @@ mem_pool_create(size_t block_size)
     pool.block_size = block_size;
     pool.first      = create_block(block_size);
 	pool.last		= pool.first;
+    pool.free       = NULL;
+    pool.free_size  = 0;
+    pool.retain     = block_size * MEM_POOL_RETAIN_BLOCKS;
+    pool.base       = NULL;
+    pool.reserve    = 0;
 
     return pool;
 }
 
+/* reserves the address space of an arena, and backs the start of it, the
+ * header of its one block is at the base, so no allocation is at offset 0 */
+mem_pool_t
+mem_pool_create_arena(size_t reserve, size_t block_size)
+{
+    mem_pool_t   pool;
+    mem_block_t *block;
+    byte_t *     base;
+
+    assert(reserve > 0 && reserve <= MEM_ARENA_MAX_RESERVE);
+
+    reserve = round_commit(reserve);
+    base    = mmap(NULL, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (base == MAP_FAILED)
+    {
+        return mem_pool_create(block_size);
+    }
+
+    if (mprotect(base, MEM_ARENA_COMMIT, PROT_READ | PROT_WRITE) != 0)
+    {
+        munmap(base, reserve);
+        return mem_pool_create(block_size);
+    }
+
+    block         = (mem_block_t *)base;
+    block->start  = base + sizeof(mem_block_t);
+    block->top    = block->start;
+    block->end    = base + MEM_ARENA_COMMIT;
+    block->before = 0;
+    block->next   = NULL;
+
+    pool.block_size = MEM_ARENA_COMMIT;
+    pool.first      = block;
+    pool.last       = block;
+    pool.free       = NULL;
+    pool.free_size  = 0;
+    pool.retain     = MEM_ARENA_COMMIT * MEM_POOL_RETAIN_BLOCKS;
+    pool.base       = base;
+    pool.reserve    = reserve;
+
+    return pool;
+}
+
+bool
+mem_pool_is_arena(const mem_pool_t *pool)
+{
+    return pool->base != NULL;
+}
+
+uint32_t
+mem_pool_offset(const mem_pool_t *pool, const void *ptr)
+{
+    assert(pool->base);
+    assert((const byte_t *)ptr >= pool->base && (const byte_t *)ptr <= pool->base + pool->reserve);
+
+    return (uint32_t)((const byte_t *)ptr - pool->base);
+}
+
+void *
+mem_pool_at(const mem_pool_t *pool, uint32_t offset)
+{
+    assert(pool->base && offset < pool->reserve);
+
+    return pool->base + offset;
+}
+
 /* deallocates all chunks in a memory pool */
 void
 mem_pool_destroy(mem_pool_t *pool)
 {
-    mem_block_t *block = pool->first;
-
-    while (block)
+    if (pool->base)
     {
-        c_free(block);
-        block = block->next;
+        munmap(pool->base, pool->reserve);
+    }
+    else
+    {
+        free_blocks(pool->first);
+        free_blocks(pool->free);
     }
 
-	pool->first = NULL;
-	pool->last  = NULL;
+	pool->first     = NULL;
+	pool->last      = NULL;
+    pool->free      = NULL;
+    pool->free_size = 0;
+    pool->base      = NULL;
+    pool->reserve   = 0;
+}
+
+/* for an arena this is how much memory is kept backing it by mem_pool_free_all */
+void
+mem_pool_set_retain(mem_pool_t *pool, size_t bytes)
+{
+    mem_block_t *kept = pool->free;
+
+    pool->retain    = bytes;
+    pool->free      = NULL;
+    pool->free_size = 0;
+
+    /* frees what no longer fits */
+    release_blocks(pool, kept);
 }
 
 /* allocates space, and allocates a new chunk id required */
@@ -70,13 +287,20 @@ mem_pool_alloc(mem_pool_t *pool, size_t size)
     mem_block_t *new_block;
 	size_t		 block_size;
 
-    assert(size <= pool->block_size);
-
     ptr = align_ptr(pool->last->top);
 
     /* if there isn't enough room in the current block */
     if (ptr + size > pool->last->end)
     {
+        /* an arena is one block, which is just backed further */
+        if (pool->base)
+        {
+            commit_arena(pool, ptr + size);
+
+            pool->last->top = ptr + size;
+            return ptr;
+        }
+
 		block_size = pool->block_size;
 		
 		/* we allocate a new block of large enough */
@@ -85,9 +309,10 @@ mem_pool_alloc(mem_pool_t *pool, size_t size)
 			block_size += pool->block_size;
 		}
 
-        new_block        = create_block(block_size);
-		pool->last->next = new_block;
-        pool->last		 = new_block;
+        new_block         = take_block(pool, block_size);
+        new_block->before = pool->last->before + block_capacity(pool->last);
+		pool->last->next  = new_block;
+        pool->last		  = new_block;
 
         ptr              = align_ptr(pool->last->top);
         pool->last->top	 = ptr + size;
@@ -103,7 +328,7 @@ mem_pool_alloc(mem_pool_t *pool, size_t size)
 static bool
 is_in_block(mem_block_t *block, byte_t *ptr)
 {
-	if (ptr > block->start && ptr < block->end)
+	if (ptr >= block->start && ptr < block->end)
 	{
 		return true;	
 	}
@@ -111,63 +336,88 @@ is_in_block(mem_block_t *block, byte_t *ptr)
 	return false;
 }
 
-#include <stdio.h>
+mem_pool_marker_t
+mem_pool_mark(const mem_pool_t *pool)
+{
+    mem_pool_marker_t marker;
+
+    marker.block = pool->last;
+    marker.top   = pool->last->top;
 
-/* free to the point of the pointer */
+    return marker;
+}
+
+/* the blocks after the mark are given back all at once, only when they don't
+ * fit in what is retained are they gone through one by one */
+void
+mem_pool_rollback(mem_pool_t *pool, mem_pool_marker_t marker)
+{
+    mem_block_t *tail = marker.block->next;
+    size_t       tail_size;
+
+    marker.block->top = marker.top;
+
+    if (!tail)
+    {
+        return;
+    }
+
+    tail_size = pool->last->before + block_capacity(pool->last) - tail->before;
+
+    marker.block->next = NULL;
+
+    if (pool->free_size + tail_size <= pool->retain)
+    {
+        pool->last->next = pool->free;
+        pool->free       = tail;
+        pool->free_size += tail_size;
+    }
+    else
+    {
+        release_blocks(pool, tail);
+    }
+
+    pool->last = marker.block;
+}
+
+/* free to the point of the pointer, which is looked for in every block,
+ * mem_pool_rollback doesn't have to look */
 void
 mem_pool_free(mem_pool_t *pool, void *ptr)
 {
-	mem_block_t *block;
-	mem_block_t *tmp;
+	mem_block_t      *block;
+	mem_pool_marker_t marker;
 
 	block = pool->first;
 
 	/* find the block the ptr is in */
-	while (block)
+	while (block && !is_in_block(block, ptr))
 	{
-		if (is_in_block(block, ptr))
-		{
-			block->top = ptr;
-			break;
-		}
-
 		block = block->next;
 	}
 
-	/* if it isnt the last block we remove all following blocks */
-	if (block->next)
-	{
-		block = block->next;
-
-		/* free the blocks after the current block */
-		while (block)
-		{
-			tmp = block->next;
+	assert(block);
 
-			c_free(block);
-
-			block = tmp;
-		}
-	}
+	marker.block = block;
+	marker.top   = ptr;
 
+	mem_pool_rollback(pool, marker);
 }
 
-/* free all chunks besides the first */
+/* free all chunks besides the first, which are kept to be used again */
 void
 mem_pool_free_all(mem_pool_t *pool)
 {
-	mem_block_t *tmp;
-	mem_block_t *block = pool->first->next;
-
-	while (block)
-	{
-		tmp = block->next;
-		c_free(block);
-		block = tmp;
-	}
+	release_blocks(pool, pool->first->next);
 
 	pool->first->next = NULL;
 	pool->first->top  = pool->first->start;
+	pool->last        = pool->first;
+
+	if (pool->base)
+	{
+		decommit_arena(pool);
+	}
 }
 
 /* prints an error if malloc fails */
@@ -2,6 +2,8 @@
 #define MEM_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
 
 /* memory */
 void *c_malloc(size_t size);
@@ -21,16 +23,33 @@ typedef struct mem_block
     byte_t *top;
     byte_t *end;
 
+    /* the size of the blocks before this one in its pool */
+    size_t before;
+
     mem_block_t *next;
 
 } mem_block_t;
 
+/* blocks given back by mem_pool_free and mem_pool_free_all are kept for
+ * mem_pool_alloc to use again, up to this many times the block size */
+#define MEM_POOL_RETAIN_BLOCKS 64
+
 typedef struct mem_pool
 {
     size_t       block_size;
     mem_block_t *first;
     mem_block_t *last;
 
+    /* the blocks which are kept, and the sum of their sizes, which
+     * never goes above 'retain' */
+    mem_block_t *free;
+    size_t       free_size;
+    size_t       retain;
+
+    /* the start and size of the address space reserved by an arena, or NULL */
+    byte_t *base;
+    size_t  reserve;
+
 } mem_pool_t;
 
 mem_pool_t mem_pool_create(size_t block_size);
@@ -39,4 +58,36 @@ void *     mem_pool_alloc(mem_pool_t *pool, size_t size);
 void       mem_pool_free(mem_pool_t *pool, void *ptr);
 void	   mem_pool_free_all(mem_pool_t *pool);
 
+/*
+ * an arena is a pool with one block, which is a range of address space reserved
+ * up front, and is only backed by memory as the top advances past it. everything
+ * in it is contiguous, and can be found by a 32 bit offset from its base, which
+ * stays the same wherever the arena is mapped. offset 0 is never allocated, so
+ * it can be used as null. if the address space can't be reserved, a pool of
+ * 'block_size' blocks is made instead, where offsets can't be used
+ */
+#define MEM_ARENA_MAX_RESERVE ((size_t)UINT32_MAX + 1)
+
+mem_pool_t mem_pool_create_arena(size_t reserve, size_t block_size);
+bool       mem_pool_is_arena(const mem_pool_t *pool);
+uint32_t   mem_pool_offset(const mem_pool_t *pool, const void *ptr);
+void *     mem_pool_at(const mem_pool_t *pool, uint32_t offset);
+
+/* sets how many bytes of blocks are kept to be used again, blocks above it are freed */
+void       mem_pool_set_retain(mem_pool_t *pool, size_t bytes);
+
+/* a point in a pool to roll back to, the fields are only for mem_pool_rollback */
+typedef struct mem_pool_marker
+{
+    mem_block_t *block;
+    byte_t *     top;
+
+} mem_pool_marker_t;
+
+/* rolling back frees everything allocated after the mark, in constant time. marks
+ * are rolled back in the reverse order they were made, and a mark can't be used after
+ * an earlier one is rolled back, or after mem_pool_free or mem_pool_free_all */
+mem_pool_marker_t mem_pool_mark(const mem_pool_t *pool);
+void              mem_pool_rollback(mem_pool_t *pool, mem_pool_marker_t marker);
+
 #endif
@@ -0,0 +1,636 @@
+#include "scan.h"
+
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * there is a scalar version of every function, and sse2 and avx2 versions
+ * on x86, the fastest is chosen at runtime by scan_init
+ */
+
+typedef struct scan_impl
+{
+    const char *name;
+
+    const char *(*skip_whitespace)(const char *str);
+    const char *(*find_line_end)(const char *str);
+    const char *(*find_comment_end)(const char *str);
+    const char *(*find_directive_char)(const char *str);
+    const char *(*find_splice)(const char *str, const char *end);
+    uint32_t (*count_newlines)(const char *str, const char *end, const char **last);
+    uint32_t (*line_starts)(const char *str, const char *end, uint32_t *starts);
+
+} scan_impl_t;
+
+
+/* ================================================================================= */
+/* scalar */
+
+static inline int
+is_whitespace(char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static const char *
+scalar_skip_whitespace(const char *str)
+{
+    while (is_whitespace(*str))
+    {
+        ++str;
+    }
+
+    return str;
+}
+
+static const char *
+scalar_find_line_end(const char *str)
+{
+    while (*str != '\n' && *str != '\0')
+    {
+        ++str;
+    }
+
+    return str;
+}
+
+static const char *
+scalar_find_comment_end(const char *str)
+{
+    while (!(str[0] == '*' && str[1] == '/') && *str != '\0')
+    {
+        ++str;
+    }
+
+    return str;
+}
+
+static const char *
+scalar_find_directive_char(const char *str)
+{
+    while (*str != '#' && *str != '/' && *str != '"' && *str != '\'' && *str != '\0')
+    {
+        ++str;
+    }
+
+    return str;
+}
+
+static const char *
+scalar_find_splice(const char *str, const char *end)
+{
+    for (; str < end; ++str)
+    {
+        if ((str[0] == '\\' && (str[1] == '\n' || str[1] == '\r')) || (str[0] == '?' && str[1] == '?'))
+        {
+            return str;
+        }
+    }
+
+    return end;
+}
+
+static uint32_t
+scalar_count_newlines(const char *str, const char *end, const char **last)
+{
+    uint32_t count = 0;
+
+    for (; str < end; ++str)
+    {
+        if (*str == '\n')
+        {
+            *last = str;
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+static uint32_t
+scalar_line_starts(const char *str, const char *end, uint32_t *starts)
+{
+    const char *ptr;
+    uint32_t    count = 0;
+
+    for (ptr = str; ptr < end; ++ptr)
+    {
+        if (*ptr == '\n')
+        {
+            starts[count++] = ptr - str + 1;
+        }
+    }
+
+    return count;
+}
+
+static const scan_impl_t scalar_impl = {
+    "scalar",
+    scalar_skip_whitespace,
+    scalar_find_line_end,
+    scalar_find_comment_end,
+    scalar_find_directive_char,
+    scalar_find_splice,
+    scalar_count_newlines,
+    scalar_line_starts,
+};
+
+
+#ifdef SCAN_X86
+
+/* ================================================================================= */
+/* sse2, 16 bytes at a time */
+
+__attribute__((target("sse2"))) static inline uint32_t
+sse2_whitespace_mask(__m128i v)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i lo    = _mm_set1_epi8('\t');
+    const __m128i hi    = _mm_set1_epi8('\r');
+
+    /* '\t' <= c <= '\r' is checked with unsigned min and max */
+    __m128i in_range = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, lo), v),
+                                     _mm_cmpeq_epi8(_mm_min_epu8(v, hi), v));
+
+    return _mm_movemask_epi8(_mm_or_si128(in_range, _mm_cmpeq_epi8(v, space)));
+}
+
+__attribute__((target("sse2"))) static const char *
+sse2_skip_whitespace(const char *str)
+{
+    uint32_t mask;
+
+    for (;; str += 16)
+    {
+        mask = ~sse2_whitespace_mask(_mm_loadu_si128((const __m128i *)str)) & 0xffff;
+
+        if (mask)
+        {
+            return str + __builtin_ctz(mask);
+        }
+    }
+}
+
+__attribute__((target("sse2"))) static const char *
+sse2_find_line_end(const char *str)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i zero    = _mm_setzero_si128();
+    __m128i       v;
+    uint32_t      mask;
+
+    for (;; str += 16)
+    {
+        v    = _mm_loadu_si128((const __m128i *)str);
+        mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, newline), _mm_cmpeq_epi8(v, zero)));
+
+        if (mask)
+        {
+            return str + __builtin_ctz(mask);
+        }
+    }
+}
+
+__attribute__((target("sse2"))) static const char *
+sse2_find_comment_end(const char *str)
+{
+    const __m128i star  = _mm_set1_epi8('*');
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i zero  = _mm_setzero_si128();
+    __m128i       v;
+    __m128i       next;
+    uint32_t      mask;
+
+    for (;; str += 16)
+    {
+        v    = _mm_loadu_si128((const __m128i *)str);
+        next = _mm_loadu_si128((const __m128i *)(str + 1));
+
+        mask = _mm_movemask_epi8(
+            _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(v, star), _mm_cmpeq_epi8(next, slash)),
+                         _mm_cmpeq_epi8(v, zero)));
+
+        if (mask)
+        {
+            return str + __builtin_ctz(mask);
+        }
+    }
+}
+
+/* '"' and '#' are 0x22 and 0x23, and '\'' and '/' are 0x27 and 0x2f, so each pair
+ * is found with one compare after setting the bit they differ in */
+__attribute__((target("sse2"))) static const char *
+sse2_find_directive_char(const char *str)
+{
+    const __m128i bit0  = _mm_set1_epi8(0x01);
+    const __m128i bit3  = _mm_set1_epi8(0x08);
+    const __m128i hash  = _mm_set1_epi8('#');
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i zero  = _mm_setzero_si128();
+    __m128i       v;
+    uint32_t      mask;
+
+    for (;; str += 16)
+    {
+        v    = _mm_loadu_si128((const __m128i *)str);
+        mask = _mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(_mm_or_si128(v, bit0), hash),
+                         _mm_cmpeq_epi8(_mm_or_si128(v, bit3), slash)),
+            _mm_cmpeq_epi8(v, zero)));
+
+        if (mask)
+        {
+            return str + __builtin_ctz(mask);
+        }
+    }
+}
+
+__attribute__((target("sse2"))) static const char *
+sse2_find_splice(const char *str, const char *end)
+{
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i newline   = _mm_set1_epi8('\n');
+    const __m128i carriage  = _mm_set1_epi8('\r');
+    const __m128i query     = _mm_set1_epi8('?');
+    __m128i       v;
+    __m128i       next;
+    uint32_t      mask;
+
+    for (; str < end; str += 16)
+    {
+        v    = _mm_loadu_si128((const __m128i *)str);
+        next = _mm_loadu_si128((const __m128i *)(str + 1));
+
+        mask = _mm_movemask_epi8(_mm_or_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(v, backslash),
+                          _mm_or_si128(_mm_cmpeq_epi8(next, newline), _mm_cmpeq_epi8(next, carriage))),
+            _mm_and_si128(_mm_cmpeq_epi8(v, query), _mm_cmpeq_epi8(next, query))));
+
+        if (mask)
+        {
+            return str + __builtin_ctz(mask) < end ? str + __builtin_ctz(mask) : end;
+        }
+    }
+
+    return end;
+}
+
+__attribute__((target("sse2"))) static uint32_t
+sse2_count_newlines(const char *str, const char *end, const char **last)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    uint32_t      count   = 0;
+    uint32_t      mask;
+
+    for (; str < end; str += 16)
+    {
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)str), newline));
+
+        /* ignore the bytes past the end */
+        if (end - str < 16)
+        {
+            mask &= (1u << (end - str)) - 1;
+        }
+
+        if (mask)
+        {
+            count += __builtin_popcount(mask);
+            *last = str + 31 - __builtin_clz(mask);
+        }
+    }
+
+    return count;
+}
+
+__attribute__((target("sse2"))) static uint32_t
+sse2_line_starts(const char *str, const char *end, uint32_t *starts)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    const char *  ptr;
+    uint32_t      count = 0;
+    uint32_t      mask;
+
+    for (ptr = str; ptr < end; ptr += 16)
+    {
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)ptr), newline));
+
+        if (end - ptr < 16)
+        {
+            mask &= (1u << (end - ptr)) - 1;
+        }
+
+        /* one store per set bit */
+        while (mask)
+        {
+            starts[count++] = ptr - str + __builtin_ctz(mask) + 1;
+            mask &= mask - 1;
+        }
+    }
+
+    return count;
+}
+
+static const scan_impl_t sse2_impl = {
+    "sse2",
+    sse2_skip_whitespace,
+    sse2_find_line_end,
+    sse2_find_comment_end,
+    sse2_find_directive_char,
+    sse2_find_splice,
+    sse2_count_newlines,
+    sse2_line_starts,
+};
+
+
+/* ================================================================================= */
+/* avx2, 32 bytes at a time */
+
+__attribute__((target("avx2"))) static inline uint32_t
+avx2_whitespace_mask(__m256i v)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i lo    = _mm256_set1_epi8('\t');
+    const __m256i hi    = _mm256_set1_epi8('\r');
+
+    __m256i in_range = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(v, lo), v),
+                                        _mm256_cmpeq_epi8(_mm256_min_epu8(v, hi), v));
+
+    return _mm256_movemask_epi8(_mm256_or_si256(in_range, _mm256_cmpeq_epi8(v, space)));
+}
+
+__attribute__((target("avx2"))) static const char *
+avx2_skip_whitespace(const char *str)
+{
+    uint32_t mask;
+
+    for (;; str += 32)
+    {
+        mask = ~avx2_whitespace_mask(_mm256_loadu_si256((const __m256i *)str));
+
+        if (mask)
+        {
+            return str + __builtin_ctz(mask);
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static const char *
+avx2_find_line_end(const char *str)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i zero    = _mm256_setzero_si256();
+    __m256i       v;
+    uint32_t      mask;
+
+    for (;; str += 32)
+    {
+        v    = _mm256_loadu_si256((const __m256i *)str);
+        mask = _mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, newline), _mm256_cmpeq_epi8(v, zero)));
+
+        if (mask)
+        {
+            return str + __builtin_ctz(mask);
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static const char *
+avx2_find_comment_end(const char *str)
+{
+    const __m256i star  = _mm256_set1_epi8('*');
+    const __m256i slash = _mm256_set1_epi8('/');
+    const __m256i zero  = _mm256_setzero_si256();
+    __m256i       v;
+    __m256i       next;
+    uint32_t      mask;
+
+    for (;; str += 32)
+    {
+        v    = _mm256_loadu_si256((const __m256i *)str);
+        next = _mm256_loadu_si256((const __m256i *)(str + 1));
+
+        mask = _mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_and_si256(_mm256_cmpeq_epi8(v, star), _mm256_cmpeq_epi8(next, slash)),
+            _mm256_cmpeq_epi8(v, zero)));
+
+        if (mask)
+        {
+            return str + __builtin_ctz(mask);
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static const char *
+avx2_find_directive_char(const char *str)
+{
+    const __m256i bit0  = _mm256_set1_epi8(0x01);
+    const __m256i bit3  = _mm256_set1_epi8(0x08);
+    const __m256i hash  = _mm256_set1_epi8('#');
+    const __m256i slash = _mm256_set1_epi8('/');
+    const __m256i zero  = _mm256_setzero_si256();
+    __m256i       v;
+    uint32_t      mask;
+
+    for (;; str += 32)
+    {
+        v    = _mm256_loadu_si256((const __m256i *)str);
+        mask = _mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_or_si256(v, bit0), hash),
+                            _mm256_cmpeq_epi8(_mm256_or_si256(v, bit3), slash)),
+            _mm256_cmpeq_epi8(v, zero)));
+
+        if (mask)
+        {
+            return str + __builtin_ctz(mask);
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static const char *
+avx2_find_splice(const char *str, const char *end)
+{
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i newline   = _mm256_set1_epi8('\n');
+    const __m256i carriage  = _mm256_set1_epi8('\r');
+    const __m256i query     = _mm256_set1_epi8('?');
+    __m256i       v;
+    __m256i       next;
+    uint32_t      mask;
+
+    for (; str < end; str += 32)
+    {
+        v    = _mm256_loadu_si256((const __m256i *)str);
+        next = _mm256_loadu_si256((const __m256i *)(str + 1));
+
+        mask = _mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_and_si256(_mm256_cmpeq_epi8(v, backslash),
+                             _mm256_or_si256(_mm256_cmpeq_epi8(next, newline),
+                                             _mm256_cmpeq_epi8(next, carriage))),
+            _mm256_and_si256(_mm256_cmpeq_epi8(v, query), _mm256_cmpeq_epi8(next, query))));
+
+        if (mask)
+        {
+            return str + __builtin_ctz(mask) < end ? str + __builtin_ctz(mask) : end;
+        }
+    }
+
+    return end;
+}
+
+__attribute__((target("avx2"))) static uint32_t
+avx2_count_newlines(const char *str, const char *end, const char **last)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    uint32_t      count   = 0;
+    uint32_t      mask;
+
+    for (; str < end; str += 32)
+    {
+        mask = _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)str), newline));
+
+        if (end - str < 32)
+        {
+            mask &= (1u << (end - str)) - 1;
+        }
+
+        if (mask)
+        {
+            count += __builtin_popcount(mask);
+            *last = str + 31 - __builtin_clz(mask);
+        }
+    }
+
+    return count;
+}
+
+__attribute__((target("avx2"))) static uint32_t
+avx2_line_starts(const char *str, const char *end, uint32_t *starts)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const char *  ptr;
+    uint32_t      count = 0;
+    uint32_t      mask;
+
+    for (ptr = str; ptr < end; ptr += 32)
+    {
+        mask = _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)ptr), newline));
+
+        if (end - ptr < 32)
+        {
+            mask &= (1u << (end - ptr)) - 1;
+        }
+
+        while (mask)
+        {
+            starts[count++] = ptr - str + __builtin_ctz(mask) + 1;
+            mask &= mask - 1;
+        }
+    }
+
+    return count;
+}
+
+static const scan_impl_t avx2_impl = {
+    "avx2",
+    avx2_skip_whitespace,
+    avx2_find_line_end,
+    avx2_find_comment_end,
+    avx2_find_directive_char,
+    avx2_find_splice,
+    avx2_count_newlines,
+    avx2_line_starts,
+};
+
+#endif
+
+
+/* ================================================================================= */
+
+static const scan_impl_t *impl = &scalar_impl;
+
+
+void
+scan_init(void)
+{
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        impl = &avx2_impl;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        impl = &sse2_impl;
+    }
+#endif
+}
+
+
+const char *
+scan_backend(void)
+{
+    return impl->name;
+}
+
+
+const char *
+scan_skip_whitespace(const char *str)
+{
+    /* most whitespace runs are a single space */
+    if (!is_whitespace(str[0]) || !is_whitespace(str[1]))
+    {
+        return is_whitespace(str[0]) ? str + 1 : str;
+    }
+
+    return impl->skip_whitespace(str + 2);
+}
+
+
+const char *
+scan_find_line_end(const char *str)
+{
+    return impl->find_line_end(str);
+}
+
+
+const char *
+scan_find_comment_end(const char *str)
+{
+    return impl->find_comment_end(str);
+}
+
+
+const char *
+scan_find_directive_char(const char *str)
+{
+    return impl->find_directive_char(str);
+}
+
+
+const char *
+scan_find_splice(const char *str, const char *end)
+{
+    return impl->find_splice(str, end);
+}
+
+
+uint32_t
+scan_count_newlines(const char *str, const char *end, const char **last)
+{
+    return impl->count_newlines(str, end, last);
+}
+
+
+uint32_t
+scan_line_starts(const char *str, const char *end, uint32_t *starts)
+{
+    return impl->line_starts(str, end, starts);
+}
@@ -0,0 +1,40 @@
+#ifndef _SCAN_
+#define _SCAN_
+
+#include <stdint.h>
+
+/*
+ * vectorized scanning primitives used by the lexer, every function may read
+ * up to 32 bytes past where it stops, so the input must be padded
+ * (see SOURCE_PADDING)
+ */
+
+/* picks the fastest implementation the cpu supports, safe to call more than once */
+void        scan_init(void);
+const char *scan_backend(void);
+
+/* returns the first byte which isn't a space, tab, newline, '\v', '\f' or '\r' */
+const char *scan_skip_whitespace(const char *str);
+
+/* returns the first '\n' or '\0' */
+const char *scan_find_line_end(const char *str);
+
+/* returns the first "*" followed by a "/", or the first '\0' */
+const char *scan_find_comment_end(const char *str);
+
+/* returns the first '#', '/', '"', '\'' or '\0', the bytes which can start a directive,
+ * a comment or a literal, used to find directives without lexing */
+const char *scan_find_directive_char(const char *str);
+
+/* returns the first backslash followed by '\n' or '\r', or the first "??", in
+ * [str, end), or 'end' if there is none. these start line splices and trigraphs */
+const char *scan_find_splice(const char *str, const char *end);
+
+/* counts the newlines in [str, end), and sets 'last' to the last one found */
+uint32_t scan_count_newlines(const char *str, const char *end, const char **last);
+
+/* writes the offset of the byte after every newline in [str, end) to 'starts',
+ * which must have room for all of them, and returns how many were written */
+uint32_t scan_line_starts(const char *str, const char *end, uint32_t *starts);
+
+#endif
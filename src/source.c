@@ -0,0 +1,710 @@
+#include "source.h"
+#include "err.h"
+#include "mem.h"
+#include "scan.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * loads source files into memory, regular files are mapped directly,
+ * so no bytes are copied before lexing
+ */
+
+static size_t
+round_to_page(size_t size, size_t page_size)
+{
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+
+/* maps the file privately, followed by at least one zeroed page,
+ * which works as both sentinel and padding */
+static void
+map_file(source_t *source, int fd, size_t file_size)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    char * mem;
+
+    source->mem_size = round_to_page(file_size, page_size) + page_size;
+
+    /* reserve the whole range as zero pages first */
+    mem = mmap(NULL, source->mem_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mem == MAP_FAILED)
+    {
+        fatal_error("%s: Failure mapping file", source->filename);
+    }
+
+    /* and then place the file on top of them, the tail of the last file
+     * page is zero filled by the kernel */
+    if (file_size)
+    {
+        if (mmap(mem, file_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+        {
+            fatal_error("%s: Failure mapping file", source->filename);
+        }
+
+        madvise(mem, file_size, MADV_SEQUENTIAL);
+    }
+
+    source->mem    = mem;
+    source->mapped = true;
+    source->start  = mem;
+    source->end    = mem + file_size;
+}
+
+/* pipes and such can't be mapped, so they are read a chunk at a time,
+ * which keeps the memory use independent of the size of the input */
+static void
+open_stream(source_t *source, int fd)
+{
+    source->mem_size = 2 * SOURCE_CHUNK_SIZE + SOURCE_PADDING;
+    source->mem      = c_malloc(source->mem_size);
+    source->mapped   = false;
+    source->stream   = true;
+    source->eof      = false;
+    source->fd       = fd;
+    source->start    = source->mem;
+    source->end      = source->mem;
+
+    /* the lines are kept up to date as the stream is read */
+    source->line_capacity = 64;
+    source->lines         = c_malloc(source->line_capacity * sizeof(uint32_t));
+    source->lines[0]      = 0;
+    source->line_count    = 1;
+
+    memset(source->mem, 0, SOURCE_PADDING);
+
+    source_refill(source, source->start, 0);
+}
+
+/* the character a trigraph "??x" stands for, or 0 if it isn't one */
+static char
+trigraph(char c)
+{
+    switch (c)
+    {
+    case '=':
+        return '#';
+    case '(':
+        return '[';
+    case '/':
+        return '\\';
+    case ')':
+        return ']';
+    case '\'':
+        return '^';
+    case '<':
+        return '{';
+    case '!':
+        return '|';
+    case '>':
+        return '}';
+    case '-':
+        return '~';
+    }
+
+    return 0;
+}
+
+/* the character at 'ptr' after trigraphs are replaced, and how many bytes it takes */
+static char
+phase1_char(const char *ptr, uint32_t *width)
+{
+    char c = ptr[0] == '?' && ptr[1] == '?' ? trigraph(ptr[2]) : 0;
+
+    *width = c ? 3 : 1;
+
+    return c ? c : ptr[0];
+}
+
+static void
+add_splice(source_t *source, uint32_t *capacity, uint32_t offset, uint32_t shift)
+{
+    if (source->splice_count == *capacity)
+    {
+        *capacity       = *capacity ? *capacity * 2 : 16;
+        source->splices = c_realloc(source->splices, *capacity * sizeof(source_splice_t));
+    }
+
+    source->splices[source->splice_count].offset = offset;
+    source->splices[source->splice_count].shift  = shift;
+
+    ++source->splice_count;
+}
+
+/*
+ * translation phases 1 and 2, trigraphs are replaced and backslash newlines are
+ * removed, into a copy of the file. 'ptr' is the first place the pre-scan found,
+ * the text between the places it finds is copied as it is
+ */
+static void
+translate(source_t *source, const char *ptr)
+{
+    const char *end      = source->end;
+    char *      text     = c_malloc((end - source->start) + SOURCE_PADDING);
+    char *      out      = text;
+    uint32_t    capacity = 0;
+    uint32_t    shift    = 0;
+    uint32_t    width;
+    uint32_t    newline;
+    const char *run      = source->start;
+    char        c;
+
+    while (ptr < end)
+    {
+        memcpy(out, run, ptr - run);
+        out += ptr - run;
+
+        c = phase1_char(ptr, &width);
+
+        /* a backslash, which may be a trigraph itself, and a newline */
+        newline = ptr[width] == '\n' ? 1 : ptr[width] == '\r' && ptr[width + 1] == '\n' ? 2 : 0;
+
+        if (c == '\\' && newline && ptr + width < end)
+        {
+            shift += width + newline;
+            ptr   += width + newline;
+
+            add_splice(source, &capacity, out - text, shift);
+        }
+        else if (width == 3)
+        {
+            *out++ = c;
+            shift += 2;
+            ptr   += 3;
+
+            add_splice(source, &capacity, out - text, shift);
+        }
+        else
+        {
+            /* a "??" which isn't a trigraph, or a backslash and a lone '\r' */
+            *out++ = *ptr++;
+        }
+
+        run = ptr;
+        ptr = scan_find_splice(ptr, end);
+    }
+
+    memcpy(out, run, end - run);
+    out += end - run;
+
+    if (!source->splice_count)
+    {
+        c_free(text);
+        return;
+    }
+
+    memset(out, 0, SOURCE_PADDING);
+
+    source->text  = text;
+    source->start = text;
+    source->end   = out;
+}
+
+static void
+init_source(source_t *source, const char *filename)
+{
+    size_t filename_size = strlen(filename) + 1;
+
+    source->file_start    = NULL;
+    source->file_end      = NULL;
+    source->text          = NULL;
+    source->splices       = NULL;
+    source->splice_count  = 0;
+    source->lines         = NULL;
+    source->line_count    = 0;
+    source->line_capacity = 0;
+    source->first_line    = 1;
+    source->stream        = false;
+    source->eof           = true;
+    source->fd            = -1;
+    source->base          = 0;
+
+    source->filename = c_malloc(filename_size);
+    memcpy(source->filename, filename, filename_size);
+}
+
+/* called once the whole file is in memory */
+static void
+load_text(source_t *source)
+{
+    const char *ptr;
+
+    source->file_start = source->start;
+    source->file_end   = source->end;
+
+    /* most files have neither line splices nor trigraphs, and are lexed as they are */
+    ptr = scan_find_splice(source->start, source->end);
+
+    if (ptr != source->end)
+    {
+        translate(source, ptr);
+    }
+}
+
+void
+source_open(source_t *source, const char *filename)
+{
+    int fd = strcmp(filename, "-") == 0 ? STDIN_FILENO : open(filename, O_RDONLY);
+
+    if (fd < 0)
+    {
+        fatal_error("%s: No such file", filename);
+    }
+
+    source_open_fd(source, filename, fd);
+}
+
+void
+source_open_fd(source_t *source, const char *filename, int fd)
+{
+    struct stat st;
+
+    init_source(source, filename);
+
+    if (fstat(fd, &st) < 0)
+    {
+        fatal_error("Failure reading %s", filename);
+    }
+
+    if (S_ISREG(st.st_mode))
+    {
+        map_file(source, fd, st.st_size);
+
+        scan_init();
+        load_text(source);
+    }
+    else
+    {
+        /* the descriptor is closed with the source */
+        open_stream(source, fd);
+        return;
+    }
+
+    if (fd != STDIN_FILENO)
+    {
+        close(fd);
+    }
+}
+
+void
+source_adopt(source_t *source, const char *filename, char *mem, size_t size)
+{
+    init_source(source, filename);
+
+    memset(mem + size, 0, SOURCE_PADDING);
+
+    source->mem      = mem;
+    source->mem_size = size + SOURCE_PADDING;
+    source->mapped   = false;
+    source->start    = mem;
+    source->end      = mem + size;
+
+    load_text(source);
+}
+
+void
+source_close(source_t *source)
+{
+    if (source->mapped)
+    {
+        munmap(source->mem, source->mem_size);
+    }
+    else
+    {
+        c_free(source->mem);
+    }
+
+    if (source->stream && source->fd != STDIN_FILENO)
+    {
+        close(source->fd);
+    }
+
+    c_free(source->filename);
+    c_free(source->lines);
+    c_free(source->text);
+    c_free(source->splices);
+
+    source->filename   = NULL;
+    source->lines      = NULL;
+    source->line_count = 0;
+    source->mem        = NULL;
+    source->start      = NULL;
+    source->end        = NULL;
+}
+
+
+void
+source_edit(source_t *source, uint32_t offset, uint32_t len, const char *text, uint32_t text_len)
+{
+    size_t size     = source->end - source->start;
+    size_t new_size = size - len + text_len;
+    size_t mem_size;
+    char * mem;
+
+    assert(!source->stream && offset + len <= size);
+
+    if (new_size > UINT32_MAX)
+    {
+        fatal_error("%s: source is larger than 4 GB", source->filename);
+    }
+
+    /* mapped files are read only, and leave some room for the next edits */
+    if (source->mapped || source->text || new_size + SOURCE_PADDING > source->mem_size)
+    {
+        mem_size = new_size + new_size / 2 + SOURCE_PADDING;
+        mem      = c_malloc(mem_size);
+
+        memcpy(mem, source->start, size);
+
+        if (source->mapped)
+        {
+            munmap(source->mem, source->mem_size);
+        }
+        else
+        {
+            c_free(source->mem);
+        }
+
+        /* the translated text is the file from now on */
+        c_free(source->text);
+        c_free(source->splices);
+
+        source->text         = NULL;
+        source->splices      = NULL;
+        source->splice_count = 0;
+
+        source->mem      = mem;
+        source->mem_size = mem_size;
+        source->mapped   = false;
+        source->start    = mem;
+    }
+
+    /* files always start at the beginning of their memory */
+    mem = source->mem;
+
+    memmove(mem + offset + text_len, mem + offset + len, size - offset - len);
+    memcpy(mem + offset, text, text_len);
+    memset(mem + new_size, 0, SOURCE_PADDING);
+
+    source->end        = mem + new_size;
+    source->file_start = source->start;
+    source->file_end   = source->end;
+
+    c_free(source->lines);
+
+    source->lines         = NULL;
+    source->line_count    = 0;
+    source->line_capacity = 0;
+}
+
+
+/* drops the lines before the one containing 'floor', and adds the lines starting
+ * in [from, end) */
+static void
+update_lines(source_t *source, const char *from, uint32_t floor)
+{
+    const char *last;
+    uint32_t    offset = source->base + (from - source->start);
+    uint32_t    drop   = 0;
+    uint32_t    count;
+    uint32_t    i;
+
+    while (drop + 1 < source->line_count && source->lines[drop + 1] <= floor)
+    {
+        ++drop;
+    }
+
+    memmove(source->lines, source->lines + drop, (source->line_count - drop) * sizeof(uint32_t));
+
+    source->line_count -= drop;
+    source->first_line += drop;
+
+    count = scan_count_newlines(from, source->end, &last);
+
+    if (source->line_count + count > source->line_capacity)
+    {
+        source->line_capacity = (source->line_count + count) * 2;
+        source->lines = c_realloc(source->lines, source->line_capacity * sizeof(uint32_t));
+    }
+
+    count = scan_line_starts(from, source->end, source->lines + source->line_count);
+
+    for (i = source->line_count; i < source->line_count + count; ++i)
+    {
+        source->lines[i] += offset;
+    }
+
+    source->line_count += count;
+}
+
+const char *
+source_refill(source_t *source, const char *keep, uint32_t floor)
+{
+    size_t  kept = source->end - keep;
+    size_t  size = kept;
+    ssize_t n;
+
+    if (!source->stream || source->eof)
+    {
+        return keep;
+    }
+
+    /* move what is kept to the front, and make room for another chunk */
+    memmove(source->mem, keep, kept);
+
+    source->base += keep - source->start;
+
+    if (kept + SOURCE_CHUNK_SIZE + SOURCE_PADDING > source->mem_size)
+    {
+        source->mem_size = kept + SOURCE_CHUNK_SIZE + SOURCE_PADDING;
+        source->mem      = c_realloc(source->mem, source->mem_size);
+    }
+
+    while (size < kept + SOURCE_CHUNK_SIZE)
+    {
+        n = read(source->fd, (char *)source->mem + size, kept + SOURCE_CHUNK_SIZE - size);
+
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (n < 0)
+        {
+            fatal_error("Failure reading %s", source->filename);
+        }
+
+        if (n == 0)
+        {
+            source->eof = true;
+            break;
+        }
+
+        size += n;
+    }
+
+    if ((uint64_t)source->base + size > UINT32_MAX)
+    {
+        fatal_error("%s: input is larger than 4 GB", source->filename);
+    }
+
+    source->start = source->mem;
+    source->end   = source->start + size;
+
+    memset((char *)source->mem + size, 0, SOURCE_PADDING);
+
+    update_lines(source, source->start + kept, floor);
+
+    return source->start;
+}
+
+
+void
+source_read_all(source_t *source)
+{
+    size_t  size = source->end - source->start;
+    ssize_t n;
+
+    if (!source->stream)
+    {
+        return;
+    }
+
+    /* nothing can have been dropped yet, or the text wouldn't be whole */
+    assert(source->base == 0);
+
+    while (!source->eof)
+    {
+        if (size + SOURCE_CHUNK_SIZE + SOURCE_PADDING > source->mem_size)
+        {
+            source->mem_size = (size + SOURCE_CHUNK_SIZE + SOURCE_PADDING) * 2;
+            source->mem      = c_realloc(source->mem, source->mem_size);
+        }
+
+        n = read(source->fd, (char *)source->mem + size, source->mem_size - SOURCE_PADDING - size);
+
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (n < 0)
+        {
+            fatal_error("Failure reading %s", source->filename);
+        }
+
+        if (n == 0)
+        {
+            source->eof = true;
+        }
+
+        size += n;
+    }
+
+    if (size > UINT32_MAX)
+    {
+        fatal_error("%s: input is larger than 4 GB", source->filename);
+    }
+
+    if (source->fd != STDIN_FILENO)
+    {
+        close(source->fd);
+    }
+
+    /* the lines are found again when needed, the same as for a file */
+    c_free(source->lines);
+
+    source->lines         = NULL;
+    source->line_count    = 0;
+    source->line_capacity = 0;
+    source->first_line    = 1;
+
+    source->stream = false;
+    source->fd     = -1;
+    source->start  = source->mem;
+    source->end    = source->start + size;
+
+    memset((char *)source->mem + size, 0, SOURCE_PADDING);
+
+    scan_init();
+    load_text(source);
+}
+
+/* finds the start of every line with one vectorized pass */
+static void
+build_lines(source_t *source)
+{
+    const char *last;
+    uint32_t    count;
+
+    scan_init();
+
+    /* the lines of the file, not of the translated text */
+    count = scan_count_newlines(source->file_start, source->file_end, &last);
+
+    source->lines         = c_malloc((count + 1) * sizeof(uint32_t));
+    source->lines[0]      = 0;
+    source->line_capacity = count + 1;
+
+    source->line_count =
+        scan_line_starts(source->file_start, source->file_end, source->lines + 1) + 1;
+}
+
+/* the offset in the file of an offset in the translated text */
+static uint32_t
+file_offset(const source_t *source, uint32_t offset)
+{
+    uint32_t low  = 0;
+    uint32_t high = source->splice_count;
+    uint32_t mid;
+
+    /* find the number of splices at or before the offset */
+    while (low < high)
+    {
+        mid = low + (high - low) / 2;
+
+        if (source->splices[mid].offset <= offset)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return low ? offset + source->splices[low - 1].shift : offset;
+}
+
+/* converts a byte offset to a line and column, both starting from 1 */
+void
+source_location(source_t *source, uint32_t offset, uint32_t *line, uint32_t *col)
+{
+    uint32_t low;
+    uint32_t high;
+    uint32_t mid;
+
+    if (!source->lines)
+    {
+        build_lines(source);
+    }
+
+    offset = file_offset(source, offset);
+
+    /* a stream has forgotten lines this far back, which is never asked for */
+    if (offset < source->lines[0])
+    {
+        *line = source->first_line;
+        *col  = 0;
+        return;
+    }
+
+    /* find the last line starting at or before the offset */
+    low  = 0;
+    high = source->line_count;
+
+    while (high - low > 1)
+    {
+        mid = low + (high - low) / 2;
+
+        if (source->lines[mid] <= offset)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    *line = source->first_line + low;
+    *col  = offset - source->lines[low] + 1;
+}
+
+
+static inline uint64_t
+mix(uint64_t h, uint64_t word)
+{
+    h = (h ^ word) * 0x5bd1e9955bd1e995ull;
+    return h ^ (h >> 47);
+}
+
+uint64_t
+source_hash(const source_t *source)
+{
+    const char *ptr  = source->start;
+    uint64_t    size = source->end - source->start;
+    uint64_t    lanes[4] = { 1, 2, 3, 4 };
+    uint64_t    word;
+    uint64_t    h;
+    int         i;
+
+    assert(!source->stream);
+
+    /* four independent lanes, so the multiplies overlap. the last block may
+     * read into the padding, which is zero, and the size is mixed in at the end */
+    for (; ptr < source->end; ptr += 32)
+    {
+        for (i = 0; i < 4; ++i)
+        {
+            memcpy(&word, ptr + i * 8, 8);
+            lanes[i] = mix(lanes[i], word);
+        }
+    }
+
+    h = size;
+
+    for (i = 0; i < 4; ++i)
+    {
+        h = mix(h, lanes[i]);
+    }
+
+    return h;
+}
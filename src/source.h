@@ -0,0 +1,96 @@
+#ifndef _SOURCE_
+#define _SOURCE_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* number of zeroed bytes which are always readable after the end of a source,
+ * so the lexer can look past the end without checking bounds */
+#define SOURCE_PADDING 64
+
+/* streams are read this many bytes at a time */
+#define SOURCE_CHUNK_SIZE (64 * 1024)
+
+/* from 'offset' in the translated text and on, 'shift' bytes of the file were
+ * removed before it, by line splices and trigraphs */
+typedef struct source_splice
+{
+    uint32_t offset;
+    uint32_t shift;
+
+} source_splice_t;
+
+typedef struct source
+{
+    char *filename;
+
+    /* the text of the file, 'end' points at a '\0' sentinel */
+    const char *start;
+    const char *end;
+
+    /* the underlying memory, either mapped or malloc'ed */
+    void * mem;
+    size_t mem_size;
+    bool   mapped;
+
+    /* pipes and stdin are read in chunks, only [start, end) is in memory, and
+     * 'base' is the offset of 'start' in the input. 'eof' is always set for files */
+    bool     stream;
+    bool     eof;
+    int      fd;
+    uint32_t base;
+
+    /* files with line splices or trigraphs are translated into 'text', which [start, end)
+     * is then, and [file_start, file_end) is the file as it was read, which locations
+     * refer to. 'splices' maps offsets in the text back to the file */
+    const char *     file_start;
+    const char *     file_end;
+    char *           text;
+    source_splice_t *splices;
+    uint32_t         splice_count;
+
+    /* offset of the first byte of every line from 'first_line' and on, for files
+     * it's built the first time a location is needed, streams add to it as they
+     * are read, and drop the lines which can't be asked for anymore */
+    uint32_t *lines;
+    uint32_t  line_count;
+    uint32_t  line_capacity;
+    uint32_t  first_line;
+
+} source_t;
+
+/* "-" opens stdin */
+void source_open(source_t *source, const char *filename);
+
+/* the same, but of a file which is already open as 'fd', which the source takes over */
+void source_open_fd(source_t *source, const char *filename, int fd);
+void source_close(source_t *source);
+
+/* makes a source of the 'size' bytes read from a file into 'mem', which must be
+ * c_malloc'ed with room for SOURCE_PADDING bytes more, and is freed with the source.
+ * scan_init must have been called */
+void source_adopt(source_t *source, const char *filename, char *mem, size_t size);
+
+/* reads the next chunk of a stream, everything before 'keep' is dropped, and lines
+ * before the one containing the offset 'floor' are forgotten. returns where 'keep'
+ * was moved to, and sets 'eof' if there is nothing more to read */
+const char *source_refill(source_t *source, const char *keep, uint32_t floor);
+
+/* reads the rest of a stream into memory, after which it's the same as a file, for
+ * what needs the whole text at once. does nothing for files */
+void source_read_all(source_t *source);
+
+/* replaces the bytes [offset, offset + len) with 'text', a mapped file is copied into
+ * memory the first time, and the lines are found again when next needed. the offsets
+ * are into the translated text, which becomes the file from then on */
+void source_edit(source_t *source, uint32_t offset, uint32_t len, const char *text,
+                 uint32_t text_len);
+
+void source_location(source_t *source, uint32_t offset, uint32_t *line, uint32_t *col);
+
+/* a 64 bit hash of the whole contents, used to recognize unchanged files,
+ * only for sources which aren't streams */
+uint64_t source_hash(const source_t *source);
+
+#endif
@@ -0,0 +1,789 @@
+#include "source_batch.h"
+#include "err.h"
+#include "mem.h"
+#include "scan.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* the most reads in flight at once */
+#define SOURCE_BATCH_ENTRIES 64
+
+/* the reads may wait on the network, so there are more threads than cores */
+#define SOURCE_BATCH_THREADS 8
+
+/* no more files are read while this many bytes are read, but not handed out */
+#define SOURCE_BATCH_MAX_BUFFERED ((size_t)256 << 20)
+
+/* io_uring reads are split into pieces no bigger than this */
+#define SOURCE_BATCH_MAX_READ (1u << 30)
+
+/* the low bit of the user data of an operation */
+#define OP_OPEN 0
+#define OP_READ 1
+
+typedef struct batch_file
+{
+    char *filename;
+    int   fd;
+
+    /* the contents, until the file is handed out */
+    char * mem;
+    size_t size;
+    size_t read;
+
+    /* not a regular file, which is read by the source it's handed to. it stays
+     * open as 'fd' since what was written to a pipe is gone if it's opened again,
+     * except for stdin, which is opened by source_open */
+    bool stream;
+
+} batch_file_t;
+
+/* the rings shared with the kernel, without liburing */
+typedef struct uring
+{
+    int      fd;
+    uint32_t entries;
+
+    uint32_t *           sq_head;
+    uint32_t *           sq_tail;
+    uint32_t *           sq_mask;
+    uint32_t *           sq_array;
+    struct io_uring_sqe *sqes;
+    uint32_t             sq_local_tail;
+    uint32_t             to_submit;
+
+    uint32_t *           cq_head;
+    uint32_t *           cq_tail;
+    uint32_t *           cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void * sq_mem;
+    size_t sq_size;
+    void * cq_mem;
+    size_t cq_size;
+    size_t sqes_size;
+
+    /* files which are open, and wait for room to be read */
+    uint32_t *parked;
+    uint32_t  parked_count;
+    uint32_t  parked_capacity;
+
+} uring_t;
+
+
+/* ================================================================================= */
+/* io_uring */
+
+static void
+uring_destroy(uring_t *ring)
+{
+    if (ring->sqes != MAP_FAILED)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+
+    if (ring->cq_mem != MAP_FAILED && ring->cq_mem != ring->sq_mem)
+    {
+        munmap(ring->cq_mem, ring->cq_size);
+    }
+
+    if (ring->sq_mem != MAP_FAILED)
+    {
+        munmap(ring->sq_mem, ring->sq_size);
+    }
+
+    c_free(ring->parked);
+    close(ring->fd);
+}
+
+
+/* returns false if the kernel can't open and read files through io_uring */
+static bool
+uring_create(uring_t *ring, uint32_t entries)
+{
+    struct io_uring_params params;
+    struct io_uring_probe *probe;
+    size_t                 probe_size;
+    bool                   supported;
+
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+
+    if (ring->fd < 0)
+    {
+        return false;
+    }
+
+    /* IORING_OP_OPENAT and IORING_OP_READ came with linux 5.6, as did probing */
+    probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    probe      = c_malloc(probe_size);
+
+    memset(probe, 0, probe_size);
+
+    supported = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0
+                && probe->last_op >= IORING_OP_READ
+                && (probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED)
+                && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+
+    c_free(probe);
+
+    ring->sq_mem          = MAP_FAILED;
+    ring->cq_mem          = MAP_FAILED;
+    ring->sqes            = MAP_FAILED;
+    ring->parked          = NULL;
+    ring->parked_count    = 0;
+    ring->parked_capacity = 0;
+
+    if (!supported)
+    {
+        uring_destroy(ring);
+        return false;
+    }
+
+    ring->entries   = params.sq_entries;
+    ring->sq_size   = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    ring->cq_size   = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    /* both rings may be in one mapping */
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->sq_size = ring->sq_size > ring->cq_size ? ring->sq_size : ring->cq_size;
+        ring->cq_size = ring->sq_size;
+    }
+
+    ring->sq_mem = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+
+    if (ring->sq_mem != MAP_FAILED && (params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        ring->cq_mem = ring->sq_mem;
+    }
+    else if (ring->sq_mem != MAP_FAILED)
+    {
+        ring->cq_mem = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->fd, IORING_OFF_CQ_RING);
+    }
+
+    if (ring->cq_mem != MAP_FAILED)
+    {
+        ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring->fd, IORING_OFF_SQES);
+    }
+
+    if (ring->sqes == MAP_FAILED)
+    {
+        uring_destroy(ring);
+        return false;
+    }
+
+    ring->sq_head       = (uint32_t *)((char *)ring->sq_mem + params.sq_off.head);
+    ring->sq_tail       = (uint32_t *)((char *)ring->sq_mem + params.sq_off.tail);
+    ring->sq_mask       = (uint32_t *)((char *)ring->sq_mem + params.sq_off.ring_mask);
+    ring->sq_array      = (uint32_t *)((char *)ring->sq_mem + params.sq_off.array);
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->to_submit     = 0;
+
+    ring->cq_head = (uint32_t *)((char *)ring->cq_mem + params.cq_off.head);
+    ring->cq_tail = (uint32_t *)((char *)ring->cq_mem + params.cq_off.tail);
+    ring->cq_mask = (uint32_t *)((char *)ring->cq_mem + params.cq_off.ring_mask);
+    ring->cqes    = (struct io_uring_cqe *)((char *)ring->cq_mem + params.cq_off.cqes);
+
+    return true;
+}
+
+
+/* the next free submission entry, there is always one, since no more
+ * operations than there are entries are ever in flight */
+static struct io_uring_sqe *
+uring_sqe(uring_t *ring)
+{
+    uint32_t             index = ring->sq_local_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe   = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+    ring->sq_array[index] = index;
+    ++ring->sq_local_tail;
+    ++ring->to_submit;
+
+    return sqe;
+}
+
+
+/* submits the new entries, and waits for at least one completion if 'wait' is set */
+static void
+uring_submit(uring_t *ring, bool wait)
+{
+    int ret;
+
+    atomic_store_explicit((_Atomic uint32_t *)ring->sq_tail, ring->sq_local_tail,
+                          memory_order_release);
+
+    while (ring->to_submit || wait)
+    {
+        ret = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait ? 1 : 0,
+                      wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            fatal_error("Failure reading files");
+        }
+
+        if (ret >= 0)
+        {
+            ring->to_submit -= ret;
+            wait = false;
+        }
+    }
+}
+
+
+/* ================================================================================= */
+/* reading */
+
+static void
+push_done(source_batch_t *batch, uint32_t index)
+{
+    batch->done[batch->done_tail++] = index;
+}
+
+
+/* the contents count as buffered from when they are allocated, until they are handed out */
+static void
+allocate_contents(source_batch_t *batch, batch_file_t *file)
+{
+    file->read = 0;
+    file->mem  = c_malloc(file->size + SOURCE_PADDING);
+
+    batch->buffered += file->size;
+}
+
+
+static void
+submit_read(source_batch_t *batch, uint32_t index)
+{
+    batch_file_t *       file = &batch->files[index];
+    struct io_uring_sqe *sqe  = uring_sqe(batch->ring);
+    size_t               len  = file->size - file->read;
+
+    sqe->opcode    = IORING_OP_READ;
+    sqe->fd        = file->fd;
+    sqe->addr      = (uintptr_t)(file->mem + file->read);
+    sqe->len       = len < SOURCE_BATCH_MAX_READ ? len : SOURCE_BATCH_MAX_READ;
+    sqe->off       = file->read;
+    sqe->user_data = (uint64_t)index << 1 | OP_READ;
+
+    ++batch->in_flight;
+}
+
+
+/* the file is closed when it's read, but isn't given to a source until it's handed
+ * out, streams are kept open for the source to read */
+static void
+finish_read(source_batch_t *batch, uint32_t index)
+{
+    batch_file_t *file = &batch->files[index];
+
+    if (file->stream)
+    {
+        push_done(batch, index);
+        return;
+    }
+
+    if (file->read < file->size)
+    {
+        submit_read(batch, index);
+        return;
+    }
+
+    close(file->fd);
+    file->fd = -1;
+
+    push_done(batch, index);
+}
+
+
+static void
+park(uring_t *ring, uint32_t index)
+{
+    if (ring->parked_count == ring->parked_capacity)
+    {
+        ring->parked_capacity = ring->parked_capacity ? ring->parked_capacity * 2 : 16;
+        ring->parked = c_realloc(ring->parked, ring->parked_capacity * sizeof(uint32_t));
+    }
+
+    ring->parked[ring->parked_count++] = index;
+}
+
+
+/* reads the files which were opened while too much was buffered, and opens
+ * the queued files, as long as there is room in the ring */
+static void
+submit_opens(source_batch_t *batch)
+{
+    uring_t *            ring = batch->ring;
+    struct io_uring_sqe *sqe;
+    batch_file_t *       file;
+    uint32_t             index;
+
+    while (ring->parked_count && batch->in_flight < ring->entries
+           && batch->buffered < SOURCE_BATCH_MAX_BUFFERED)
+    {
+        index = ring->parked[--ring->parked_count];
+
+        allocate_contents(batch, &batch->files[index]);
+        finish_read(batch, index);
+    }
+
+    while (batch->next_queued < batch->count && batch->in_flight < batch->ring->entries
+           && batch->buffered < SOURCE_BATCH_MAX_BUFFERED)
+    {
+        file = &batch->files[batch->next_queued];
+
+        if (file->stream)
+        {
+            push_done(batch, batch->next_queued++);
+            continue;
+        }
+
+        sqe = uring_sqe(batch->ring);
+
+        sqe->opcode     = IORING_OP_OPENAT;
+        sqe->fd         = AT_FDCWD;
+        sqe->addr       = (uintptr_t)file->filename;
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->user_data  = (uint64_t)batch->next_queued << 1;
+
+        ++batch->in_flight;
+        ++batch->next_queued;
+    }
+}
+
+
+static void
+complete(source_batch_t *batch, uint64_t user_data, int32_t res)
+{
+    uint32_t      index = user_data >> 1;
+    batch_file_t *file  = &batch->files[index];
+    struct stat   st;
+
+    --batch->in_flight;
+
+    /* the buffers just have to outlive the reads */
+    if (batch->closing)
+    {
+        if (res >= 0 && (user_data & 1) == OP_OPEN)
+        {
+            close(res);
+        }
+
+        return;
+    }
+
+    if ((user_data & 1) == OP_OPEN)
+    {
+        if (res < 0)
+        {
+            fatal_error("%s: No such file", file->filename);
+        }
+
+        file->fd = res;
+
+        if (fstat(file->fd, &st) < 0)
+        {
+            fatal_error("Failure reading %s", file->filename);
+        }
+
+        if (!S_ISREG(st.st_mode))
+        {
+            file->stream = true;
+        }
+        else
+        {
+            file->size = st.st_size;
+
+            /* so a burst of big files isn't all read at once */
+            if (batch->buffered >= SOURCE_BATCH_MAX_BUFFERED)
+            {
+                park(batch->ring, index);
+                return;
+            }
+
+            allocate_contents(batch, file);
+        }
+    }
+    else if (res == -EINTR || res == -EAGAIN)
+    {
+        submit_read(batch, index);
+        return;
+    }
+    else if (res < 0)
+    {
+        fatal_error("Failure reading %s", file->filename);
+    }
+    else if (res == 0)
+    {
+        /* it got shorter since it was opened */
+        batch->buffered -= file->size - file->read;
+        file->size = file->read;
+    }
+    else
+    {
+        file->read += res;
+    }
+
+    finish_read(batch, index);
+}
+
+
+static void
+reap_completions(source_batch_t *batch)
+{
+    uring_t *            ring = batch->ring;
+    uint32_t             head = *ring->cq_head;
+    uint32_t             tail;
+    struct io_uring_cqe *cqe;
+
+    tail = atomic_load_explicit((_Atomic uint32_t *)ring->cq_tail, memory_order_acquire);
+
+    for (; head != tail; ++head)
+    {
+        cqe = &ring->cqes[head & *ring->cq_mask];
+        complete(batch, cqe->user_data, cqe->res);
+    }
+
+    atomic_store_explicit((_Atomic uint32_t *)ring->cq_head, head, memory_order_release);
+}
+
+
+/* reads a whole file with pread, on one of the threads */
+static void
+read_file(batch_file_t *file)
+{
+    struct stat st;
+    ssize_t     n;
+    int         fd;
+
+    if (file->stream)
+    {
+        return;
+    }
+
+    fd = open(file->filename, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+    {
+        fatal_error("%s: No such file", file->filename);
+    }
+
+    if (fstat(fd, &st) < 0)
+    {
+        fatal_error("Failure reading %s", file->filename);
+    }
+
+    if (!S_ISREG(st.st_mode))
+    {
+        file->stream = true;
+        file->fd     = fd;
+        return;
+    }
+
+    file->size = st.st_size;
+    file->read = 0;
+    file->mem  = c_malloc(file->size + SOURCE_PADDING);
+
+    while (file->read < file->size)
+    {
+        n = pread(fd, file->mem + file->read, file->size - file->read, file->read);
+
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (n < 0)
+        {
+            fatal_error("Failure reading %s", file->filename);
+        }
+
+        if (n == 0)
+        {
+            file->size = file->read;
+            break;
+        }
+
+        file->read += n;
+    }
+
+    close(fd);
+}
+
+
+static void *
+read_files(void *arg)
+{
+    source_batch_t *batch = arg;
+    batch_file_t    file;
+    uint32_t        index;
+
+    pthread_mutex_lock(&batch->lock);
+
+    for (;;)
+    {
+        while ((batch->next_queued == batch->count || batch->buffered >= SOURCE_BATCH_MAX_BUFFERED)
+               && !batch->closing)
+        {
+            pthread_cond_wait(&batch->work, &batch->lock);
+        }
+
+        if (batch->closing)
+        {
+            break;
+        }
+
+        /* the array may be moved by source_batch_add while this reads */
+        index = batch->next_queued++;
+        file  = batch->files[index];
+
+        pthread_mutex_unlock(&batch->lock);
+        read_file(&file);
+        pthread_mutex_lock(&batch->lock);
+
+        batch->files[index] = file;
+        batch->buffered += file.size;
+
+        push_done(batch, index);
+
+        pthread_cond_signal(&batch->ready);
+    }
+
+    pthread_mutex_unlock(&batch->lock);
+
+    return NULL;
+}
+
+
+/* ================================================================================= */
+
+static uint32_t
+add_file(source_batch_t *batch, const char *filename)
+{
+    size_t        filename_size = strlen(filename) + 1;
+    batch_file_t *file;
+
+    if (batch->count == batch->capacity)
+    {
+        batch->capacity = batch->capacity ? batch->capacity * 2 : 16;
+        batch->files    = c_realloc(batch->files, batch->capacity * sizeof(batch_file_t));
+        batch->done     = c_realloc(batch->done, batch->capacity * sizeof(uint32_t));
+    }
+
+    file = &batch->files[batch->count];
+
+    file->filename = c_malloc(filename_size);
+    file->fd       = -1;
+    file->mem      = NULL;
+    file->size     = 0;
+    file->read     = 0;
+    file->stream   = strcmp(filename, "-") == 0;
+
+    memcpy(file->filename, filename, filename_size);
+
+    return batch->count++;
+}
+
+
+void
+source_batch_open(source_batch_t *batch, const char *const *filenames, uint32_t count)
+{
+    uint32_t i;
+
+    batch->files        = NULL;
+    batch->count        = 0;
+    batch->capacity     = 0;
+    batch->done         = NULL;
+    batch->done_head    = 0;
+    batch->done_tail    = 0;
+    batch->next_queued  = 0;
+    batch->in_flight    = 0;
+    batch->buffered     = 0;
+    batch->threads      = NULL;
+    batch->thread_count = 0;
+    batch->closing      = false;
+
+    /* source_adopt needs it */
+    scan_init();
+
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->work, NULL);
+    pthread_cond_init(&batch->ready, NULL);
+
+    for (i = 0; i < count; ++i)
+    {
+        add_file(batch, filenames[i]);
+    }
+
+    batch->ring = c_malloc(sizeof(uring_t));
+
+    if (uring_create(batch->ring, SOURCE_BATCH_ENTRIES))
+    {
+        submit_opens(batch);
+        uring_submit(batch->ring, false);
+        return;
+    }
+
+    c_free(batch->ring);
+    batch->ring = NULL;
+
+    batch->threads = c_malloc(SOURCE_BATCH_THREADS * sizeof(pthread_t));
+
+    for (i = 0; i < SOURCE_BATCH_THREADS; ++i)
+    {
+        if (pthread_create(&batch->threads[i], NULL, read_files, batch) != 0)
+        {
+            fatal_error("failed to start a reader thread");
+        }
+
+        ++batch->thread_count;
+    }
+}
+
+
+void
+source_batch_close(source_batch_t *batch)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&batch->lock);
+    batch->closing = true;
+    pthread_cond_broadcast(&batch->work);
+    pthread_mutex_unlock(&batch->lock);
+
+    for (i = 0; i < batch->thread_count; ++i)
+    {
+        pthread_join(batch->threads[i], NULL);
+    }
+
+    if (batch->ring)
+    {
+        while (batch->in_flight)
+        {
+            uring_submit(batch->ring, true);
+            reap_completions(batch);
+        }
+
+        uring_destroy(batch->ring);
+        c_free(batch->ring);
+    }
+
+    for (i = 0; i < batch->count; ++i)
+    {
+        if (batch->files[i].fd >= 0)
+        {
+            close(batch->files[i].fd);
+        }
+
+        c_free(batch->files[i].mem);
+        c_free(batch->files[i].filename);
+    }
+
+    pthread_mutex_destroy(&batch->lock);
+    pthread_cond_destroy(&batch->work);
+    pthread_cond_destroy(&batch->ready);
+
+    c_free(batch->threads);
+    c_free(batch->files);
+    c_free(batch->done);
+
+    batch->files = NULL;
+    batch->done  = NULL;
+    batch->count = 0;
+}
+
+
+uint32_t
+source_batch_add(source_batch_t *batch, const char *filename)
+{
+    uint32_t index;
+
+    pthread_mutex_lock(&batch->lock);
+
+    index = add_file(batch, filename);
+
+    pthread_cond_signal(&batch->work);
+    pthread_mutex_unlock(&batch->lock);
+
+    if (batch->ring)
+    {
+        submit_opens(batch);
+        uring_submit(batch->ring, false);
+    }
+
+    return index;
+}
+
+
+int64_t
+source_batch_next(source_batch_t *batch, source_t *source)
+{
+    batch_file_t file;
+    uint32_t     index;
+
+    pthread_mutex_lock(&batch->lock);
+
+    while (batch->done_head == batch->done_tail && batch->done_head < batch->count)
+    {
+        if (batch->ring)
+        {
+            submit_opens(batch);
+            uring_submit(batch->ring, batch->done_head == batch->done_tail);
+            reap_completions(batch);
+        }
+        else
+        {
+            pthread_cond_wait(&batch->ready, &batch->lock);
+        }
+    }
+
+    if (batch->done_head == batch->count)
+    {
+        pthread_mutex_unlock(&batch->lock);
+        return -1;
+    }
+
+    /* the contents are the source's from now on */
+    index = batch->done[batch->done_head++];
+    file  = batch->files[index];
+
+    batch->files[index].mem = NULL;
+    batch->files[index].fd  = -1;
+    batch->buffered -= file.size;
+
+    pthread_cond_signal(&batch->work);
+    pthread_mutex_unlock(&batch->lock);
+
+    if (file.stream && file.fd >= 0)
+    {
+        source_open_fd(source, file.filename, file.fd);
+    }
+    else if (file.stream)
+    {
+        source_open(source, file.filename);
+    }
+    else
+    {
+        source_adopt(source, file.filename, file.mem, file.size);
+    }
+
+    return index;
+}
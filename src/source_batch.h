@@ -0,0 +1,65 @@
+#ifndef _SOURCE_BATCH_
+#define _SOURCE_BATCH_
+
+#include "source.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * reads many files at once, instead of one after the other. the reads are submitted
+ * together through io_uring, or spread over a few threads calling pread where the
+ * kernel doesn't have it, and the files are handed out in the order they complete,
+ * so lexing one can start while the others are still being read
+ */
+
+struct batch_file;
+struct uring;
+
+typedef struct source_batch
+{
+    /* every file added, in that order */
+    struct batch_file *files;
+    uint32_t           count;
+    uint32_t           capacity;
+
+    /* indices of the files which are read, in the order they completed,
+     * [done_head, done_tail) have not been handed out yet */
+    uint32_t *done;
+    uint32_t  done_head;
+    uint32_t  done_tail;
+
+    /* the first file which isn't being read yet */
+    uint32_t next_queued;
+
+    /* the size of the files which are read, but not handed out */
+    size_t buffered;
+
+    /* set when reading through io_uring, or else the threads are */
+    struct uring *ring;
+    uint32_t      in_flight;
+
+    pthread_t *     threads;
+    uint32_t        thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t  work;
+    pthread_cond_t  ready;
+    bool            closing;
+
+} source_batch_t;
+
+void source_batch_open(source_batch_t *batch, const char *const *filenames, uint32_t count);
+void source_batch_close(source_batch_t *batch);
+
+/* starts reading one more file, such as a header found while lexing,
+ * and returns the index it's handed out with */
+uint32_t source_batch_add(source_batch_t *batch, const char *filename);
+
+/* waits for the next file to be read, makes 'source' of it and returns its index,
+ * or returns -1 if every file has been handed out. the source is the caller's, and
+ * is closed with source_close. files which aren't regular files are opened as streams */
+int64_t source_batch_next(source_batch_t *batch, source_t *source);
+
+#endif
@@ -0,0 +1,554 @@
+#include "sym_snapshot.h"
+#include "atom.h"
+#include "err.h"
+#include "mem.h"
+#include "source.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * a snapshot is a header followed by these sections, each starting 8 byte aligned:
+ *
+ *  globals   snapshot_global_t[global_count]
+ *  params    snapshot_param_t[param_count]
+ *  atoms     snapshot_atom_t[atom_count]
+ *  deps      snapshot_dep_t[dep_count]
+ *  strings   char[string_size]
+ *
+ * globals and params name their atom by its index in the atoms, which give
+ * the spelling as an offset into the strings. the deps are the files the
+ * prelude included, with their path in the strings as well
+ */
+
+/* must be changed whenever the layout, or what the parser declares, changes */
+#define SNAPSHOT_VERSION 3
+
+/* the atom index of an anonymous parameter */
+#define SNAPSHOT_NO_ATOM UINT32_MAX
+
+static const char snapshot_magic[8] = { 'C', 'b', 's', 'y', 'm', 'b', 'o', 'l' };
+
+typedef struct snapshot_header
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t global_count;
+    uint64_t hash;
+
+    uint32_t param_count;
+    uint32_t atom_count;
+    uint32_t string_size;
+    uint32_t dep_count;
+
+} snapshot_header_t;
+
+typedef struct snapshot_type
+{
+    uint32_t spec;
+    uint32_t prim;
+    uint32_t indirection;
+
+} snapshot_type_t;
+
+typedef struct snapshot_global
+{
+    snapshot_type_t type;
+    uint32_t        kind;
+    uint32_t        defined;
+    uint32_t        atom;
+
+    /* functions have the params [param_start, param_start + param_count),
+     * variables have their value */
+    uint32_t param_start;
+    uint32_t param_count;
+    uint32_t unused;
+    uint64_t value;
+
+} snapshot_global_t;
+
+typedef struct snapshot_param
+{
+    snapshot_type_t type;
+    uint32_t        atom;
+
+} snapshot_param_t;
+
+/* interned again from the spelling, so nothing in the file can give it the wrong atom */
+typedef struct snapshot_atom
+{
+    uint32_t offset;
+    uint32_t len;
+
+} snapshot_atom_t;
+
+typedef struct snapshot_dep
+{
+    uint64_t hash;
+    uint32_t offset;
+    uint32_t len;
+
+} snapshot_dep_t;
+
+typedef struct snapshot_layout
+{
+    size_t globals;
+    size_t params;
+    size_t atoms;
+    size_t deps;
+    size_t strings;
+    size_t size;
+
+} snapshot_layout_t;
+
+
+static size_t
+align8(size_t size)
+{
+    return (size + 7) & ~(size_t)7;
+}
+
+
+static snapshot_layout_t
+snapshot_layout(const snapshot_header_t *header)
+{
+    snapshot_layout_t layout;
+
+    layout.globals = align8(sizeof(snapshot_header_t));
+    layout.params  = layout.globals + align8(header->global_count * sizeof(snapshot_global_t));
+    layout.atoms   = layout.params + align8(header->param_count * sizeof(snapshot_param_t));
+    layout.deps    = layout.atoms + align8(header->atom_count * sizeof(snapshot_atom_t));
+    layout.strings = layout.deps + align8(header->dep_count * sizeof(snapshot_dep_t));
+    layout.size    = layout.strings + header->string_size;
+
+    return layout;
+}
+
+
+static bool
+valid_type(snapshot_type_t type)
+{
+    return type.prim < _TYPE_PRIM_COUNT && type.spec < (TYPE_SPEC_SHORT << 1);
+}
+
+
+/* checks every index and range, so nothing read while restoring is out of bounds */
+static bool
+valid_snapshot(const snapshot_header_t *header, const char *mem, snapshot_layout_t layout)
+{
+    const snapshot_global_t *globals = (const snapshot_global_t *)(mem + layout.globals);
+    const snapshot_param_t * params  = (const snapshot_param_t *)(mem + layout.params);
+    const snapshot_atom_t *  atoms   = (const snapshot_atom_t *)(mem + layout.atoms);
+    const snapshot_dep_t *   deps    = (const snapshot_dep_t *)(mem + layout.deps);
+    uint32_t                 i;
+
+    for (i = 0; i < header->atom_count; ++i)
+    {
+        if (atoms[i].len == 0 || atoms[i].offset > header->string_size
+            || atoms[i].len > header->string_size - atoms[i].offset)
+        {
+            return false;
+        }
+    }
+
+    /* the paths are copied out to be opened, so they must fit in PATH_MAX */
+    for (i = 0; i < header->dep_count; ++i)
+    {
+        if (deps[i].len == 0 || deps[i].len >= 4096 || deps[i].offset > header->string_size
+            || deps[i].len > header->string_size - deps[i].offset)
+        {
+            return false;
+        }
+    }
+
+    for (i = 0; i < header->param_count; ++i)
+    {
+        if (!valid_type(params[i].type)
+            || (params[i].atom != SNAPSHOT_NO_ATOM && params[i].atom >= header->atom_count))
+        {
+            return false;
+        }
+    }
+
+    for (i = 0; i < header->global_count; ++i)
+    {
+        if (!valid_type(globals[i].type) || globals[i].kind > SYM_GLOBAL_KIND_FUNCTION
+            || globals[i].atom >= header->atom_count || globals[i].param_start > header->param_count
+            || globals[i].param_count > header->param_count - globals[i].param_start)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static type_info_t
+load_type(snapshot_type_t type)
+{
+    type_info_t info;
+
+    info.spec        = type.spec;
+    info.prim        = type.prim;
+    info.indirection = type.indirection;
+
+    return info;
+}
+
+
+static snapshot_type_t
+store_type(type_info_t info)
+{
+    snapshot_type_t type;
+
+    type.spec        = info.spec;
+    type.prim        = info.prim;
+    type.indirection = info.indirection;
+
+    return type;
+}
+
+
+/* interns the names, and declares the globals in the order they were stored,
+ * so they get the same ids as when the prelude was parsed */
+static void
+load_globals(sym_table_t *table, const snapshot_header_t *header, const char *mem,
+             snapshot_layout_t layout)
+{
+    const snapshot_global_t *globals  = (const snapshot_global_t *)(mem + layout.globals);
+    const snapshot_param_t * params   = (const snapshot_param_t *)(mem + layout.params);
+    const snapshot_atom_t *  atoms    = (const snapshot_atom_t *)(mem + layout.atoms);
+    const char *             strings  = mem + layout.strings;
+    atom_t *                 atom_map = c_malloc((header->atom_count + 1) * sizeof(atom_t));
+    sym_global_t             global;
+    sym_param_t              param;
+    uint32_t                 i;
+    uint32_t                 j;
+
+    for (i = 0; i < header->atom_count; ++i)
+    {
+        atom_map[i] = atom_intern(strings + atoms[i].offset, atoms[i].len);
+    }
+
+    /* the parameters of earlier declarations are never reported, so they don't
+     * need a location */
+    memset(&param.err_loc, 0, sizeof(err_location_t));
+
+    for (i = 0; i < header->global_count; ++i)
+    {
+        memset(&global, 0, sizeof(sym_global_t));
+
+        global.type    = load_type(globals[i].type);
+        global.kind    = globals[i].kind;
+        global.defined = globals[i].defined != 0;
+
+        if (global.kind == SYM_GLOBAL_KIND_FUNCTION)
+        {
+            global.function.params = vec_sym_param_t_create(globals[i].param_count + 1);
+
+            for (j = globals[i].param_start; j < globals[i].param_start + globals[i].param_count; ++j)
+            {
+                param.type = load_type(params[j].type);
+                param.atom = params[j].atom == SNAPSHOT_NO_ATOM ? ATOM_NULL : atom_map[params[j].atom];
+
+                vec_sym_param_t_push(&global.function.params, param);
+            }
+        }
+        else
+        {
+            global.val._int = globals[i].value;
+        }
+
+        vec_sym_global_t_push(&table->globals, global);
+        vec_atom_t_push(&table->global_atoms, atom_map[globals[i].atom]);
+    }
+
+    c_free(atom_map);
+}
+
+
+/* whether every file the prelude included is the same as when the snapshot was made */
+static bool
+deps_unchanged(const snapshot_header_t *header, const char *mem, snapshot_layout_t layout)
+{
+    const snapshot_dep_t *deps    = (const snapshot_dep_t *)(mem + layout.deps);
+    const char *          strings = mem + layout.strings;
+    char                  dep_path[4096];
+    struct stat           info;
+    source_t              source;
+    uint64_t              hash;
+    uint32_t              i;
+    int                   fd;
+
+    for (i = 0; i < header->dep_count; ++i)
+    {
+        memcpy(dep_path, strings + deps[i].offset, deps[i].len);
+        dep_path[deps[i].len] = '\0';
+
+        /* source_open would stop on a file which is gone */
+        fd = open(dep_path, O_RDONLY);
+
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        if (fstat(fd, &info) < 0 || !S_ISREG(info.st_mode))
+        {
+            close(fd);
+            return false;
+        }
+
+        source_open_fd(&source, dep_path, fd);
+        hash = source_hash(&source);
+        source_close(&source);
+
+        if (hash != deps[i].hash)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool
+sym_load_snapshot(sym_table_t *table, const char *path, uint64_t hash)
+{
+    const snapshot_header_t *header;
+    snapshot_layout_t        layout;
+    struct stat              info;
+    const char *             mem;
+    int                      fd;
+
+    assert(table->globals.size == 0);
+
+    fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    if (fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(snapshot_header_t))
+    {
+        close(fd);
+        return false;
+    }
+
+    mem = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mem == MAP_FAILED)
+    {
+        return false;
+    }
+
+    header = (const snapshot_header_t *)mem;
+    layout = snapshot_layout(header);
+
+    if (memcmp(header->magic, snapshot_magic, sizeof(snapshot_magic)) != 0
+        || header->version != SNAPSHOT_VERSION || header->hash != hash
+        || layout.size != (size_t)info.st_size || !valid_snapshot(header, mem, layout)
+        || !deps_unchanged(header, mem, layout))
+    {
+        munmap((void *)mem, info.st_size);
+        return false;
+    }
+
+    load_globals(table, header, mem, layout);
+
+    munmap((void *)mem, info.st_size);
+
+    return true;
+}
+
+
+/* writes 'size' bytes, padded with zeroes to 8 bytes */
+static bool
+write_section(FILE *file, const void *data, size_t size)
+{
+    static const char zeroes[8] = { 0 };
+    size_t            padding   = align8(size) - size;
+
+    if (size && fwrite(data, size, 1, file) != 1)
+    {
+        return false;
+    }
+
+    return !padding || fwrite(zeroes, padding, 1, file) == 1;
+}
+
+
+/* the index of 'atom' in the snapshot, which is added the first time it's seen */
+static uint32_t
+store_atom(atom_t atom, uint32_t *atom_index, snapshot_atom_t *atoms, uint32_t *count,
+           char *strings, uint32_t *string_size)
+{
+    if (atom == ATOM_NULL)
+    {
+        return SNAPSHOT_NO_ATOM;
+    }
+
+    if (!atom_index[atom])
+    {
+        atoms[*count].offset = *string_size;
+        atoms[*count].len    = atom_len(atom);
+
+        memcpy(strings + *string_size, atom_str(atom), atom_len(atom));
+        *string_size += atom_len(atom);
+
+        atom_index[atom] = ++*count;
+    }
+
+    return atom_index[atom] - 1;
+}
+
+
+void
+sym_store_snapshot(const sym_table_t *table, const char *path, uint64_t hash,
+                   const sym_snapshot_dep_t *deps, uint32_t dep_count)
+{
+    char                tmp_path[4096 + 32];
+    snapshot_header_t   header;
+    snapshot_global_t * globals;
+    snapshot_param_t *  params;
+    snapshot_atom_t *   atoms;
+    snapshot_dep_t *    stored_deps;
+    char *              strings;
+    const sym_global_t *global;
+    uint32_t *          atom_index;
+    uint32_t            param_count = 0;
+    uint32_t            string_size = 0;
+    uint32_t            distinct    = 0;
+    uint32_t            i;
+    uint32_t            j;
+    FILE *              file;
+    bool                written;
+
+    /* the strings are at most every name once, and the paths of the deps */
+    for (i = 0; i < table->globals.size; ++i)
+    {
+        string_size += atom_len(table->global_atoms.data[i]);
+
+        if (table->globals.data[i].kind != SYM_GLOBAL_KIND_FUNCTION)
+        {
+            continue;
+        }
+
+        for (j = 0; j < table->globals.data[i].function.params.size; ++j, ++param_count)
+        {
+            string_size += atom_len(table->globals.data[i].function.params.data[j].atom);
+        }
+    }
+
+    for (i = 0; i < dep_count; ++i)
+    {
+        string_size += strlen(deps[i].path);
+    }
+
+    /* atom_index holds one more than the index of the atoms already stored */
+    atom_index = calloc(atom_count(), sizeof(uint32_t));
+    globals    = c_malloc(table->globals.size * sizeof(snapshot_global_t) + 1);
+    params     = c_malloc(param_count * sizeof(snapshot_param_t) + 1);
+    atoms       = c_malloc((table->globals.size + param_count) * sizeof(snapshot_atom_t) + 1);
+    stored_deps = c_malloc(dep_count * sizeof(snapshot_dep_t) + 1);
+    strings     = c_malloc(string_size + 1);
+
+    if (!atom_index)
+    {
+        fatal_error("out of memory");
+    }
+
+    param_count = 0;
+    string_size = 0;
+
+    for (i = 0; i < table->globals.size; ++i)
+    {
+        global = &table->globals.data[i];
+
+        memset(&globals[i], 0, sizeof(snapshot_global_t));
+
+        globals[i].type    = store_type(global->type);
+        globals[i].kind    = global->kind;
+        globals[i].defined = global->defined;
+        globals[i].atom    = store_atom(table->global_atoms.data[i], atom_index, atoms, &distinct,
+                                        strings, &string_size);
+
+        /* the value of a declaration is never set */
+        if (global->kind != SYM_GLOBAL_KIND_FUNCTION)
+        {
+            globals[i].value = global->defined ? global->val._int : 0;
+            continue;
+        }
+
+        globals[i].param_start = param_count;
+        globals[i].param_count = global->function.params.size;
+
+        for (j = 0; j < global->function.params.size; ++j, ++param_count)
+        {
+            params[param_count].type = store_type(global->function.params.data[j].type);
+            params[param_count].atom = store_atom(global->function.params.data[j].atom, atom_index,
+                                                  atoms, &distinct, strings, &string_size);
+        }
+    }
+
+    for (i = 0; i < dep_count; ++i)
+    {
+        stored_deps[i].hash   = deps[i].hash;
+        stored_deps[i].offset = string_size;
+        stored_deps[i].len    = strlen(deps[i].path);
+
+        memcpy(strings + string_size, deps[i].path, stored_deps[i].len);
+        string_size += stored_deps[i].len;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+
+    header.version      = SNAPSHOT_VERSION;
+    header.global_count = table->globals.size;
+    header.hash         = hash;
+    header.param_count  = param_count;
+    header.atom_count   = distinct;
+    header.string_size  = string_size;
+    header.dep_count    = dep_count;
+
+    /* written next to the real file, and renamed over it when complete, so a
+     * reader never sees half a file */
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld", path, (long)getpid());
+
+    file = fopen(tmp_path, "wb");
+
+    if (file)
+    {
+        written = write_section(file, &header, sizeof(header))
+                  && write_section(file, globals, header.global_count * sizeof(snapshot_global_t))
+                  && write_section(file, params, param_count * sizeof(snapshot_param_t))
+                  && write_section(file, atoms, distinct * sizeof(snapshot_atom_t))
+                  && write_section(file, stored_deps, dep_count * sizeof(snapshot_dep_t))
+                  && (!string_size || fwrite(strings, string_size, 1, file) == 1);
+
+        written = fclose(file) == 0 && written;
+
+        if (!written || rename(tmp_path, path) != 0)
+        {
+            remove(tmp_path);
+        }
+    }
+
+    c_free(atom_index);
+    c_free(globals);
+    c_free(params);
+    c_free(atoms);
+    c_free(stored_deps);
+    c_free(strings);
+}
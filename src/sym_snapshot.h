@@ -0,0 +1,36 @@
+#ifndef _SYM_SNAPSHOT_
+#define _SYM_SNAPSHOT_
+
+#include "symbol.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * the globals of a symbol table can be stored in a snapshot, so a prelude of
+ * declarations which every file shares is only parsed once. the snapshot has
+ * no pointers, names are stored as their spelling, and parameters as a range
+ * of one array, so restoring it is mapping the file, interning the names and
+ * copying the globals out
+ */
+
+/* a file the prelude included, and the source_hash of it when the snapshot was made */
+typedef struct sym_snapshot_dep
+{
+    const char *path;
+    uint64_t    hash;
+
+} sym_snapshot_dep_t;
+
+/* declares the globals of the snapshot at 'path' in 'table', which must not have
+ * any yet. returns false if there is no snapshot, it wasn't made from a prelude
+ * with the hash 'hash', or a file the prelude included has changed since, and
+ * the prelude has to be parsed */
+bool sym_load_snapshot(sym_table_t *table, const char *path, uint64_t hash);
+
+/* writes the globals of 'table' to 'path', with the files the prelude included.
+ * failures are ignored since the prelude is just parsed again next time */
+void sym_store_snapshot(const sym_table_t *table, const char *path, uint64_t hash,
+                        const sym_snapshot_dep_t *deps, uint32_t dep_count);
+
+#endif
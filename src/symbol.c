@@ -5,23 +5,6 @@
 #include <stdio.h>
 #include <assert.h>
 
-/* 64-bit murmur hash */
-sym_hash_t
-sym_hash(const char *key, uint32_t len)
-{
-    uint32_t i;
-    int64_t  h = 525201411107845655;
-
-    for (i = 0; i < len; ++i)
-    {
-        h ^= key[i];
-        h *= 0x5bd1e9955bd1e995;
-        h ^= h >> 47;
-    }
-
-    return h;
-}
-
 /* allocates a new symbol table */
 void
 sym_create_table(sym_table_t *table, uint32_t count)
@@ -29,8 +12,8 @@ sym_create_table(sym_table_t *table, uint32_t count)
     table->locals  = vec_sym_local_t_create(count);
     table->globals = vec_sym_global_t_create(count);
 
-    table->global_hashes = vec_sym_hash_t_create(count);
-    table->local_hashes  = vec_sym_hash_t_create(count);
+    table->global_atoms = vec_atom_t_create(count);
+    table->local_atoms  = vec_atom_t_create(count);
 
     /* create global scope */
     table->scopes = vec_sym_scope_t_create(5);
@@ -56,15 +39,15 @@ sym_pop_scope(sym_table_t *table)
 {
     uint32_t new_top = vec_sym_scope_t_top(&table->scopes).start;
 
-    printf("pop scope count before %lu\n", table->local_hashes.size);
+    printf("pop scope count before %lu\n", table->local_atoms.size);
 
     printf("new top: %u\n", new_top);
 
     /* resize the entries */
     vec_sym_local_t_resize(&table->locals, new_top);
-    vec_sym_hash_t_resize(&table->local_hashes, new_top);
+    vec_atom_t_resize(&table->local_atoms, new_top);
 
-    printf("pop scope count after %lu\n", table->local_hashes.size);
+    printf("pop scope count after %lu\n", table->local_atoms.size);
 
     /* pop the current scope */
     vec_sym_scope_t_pop(&table->scopes);
@@ -101,19 +84,19 @@ check_for_redeclaration(sym_global_t *new, sym_global_t *old, err_location_t *er
 }
 
 sym_id_t
-sym_find_global(const sym_table_t *table, sym_hash_t hash)
+sym_find_global(const sym_table_t *table, atom_t atom)
 {
-    sym_hash_t *current;
-    sym_hash_t *start;
-    sym_hash_t *end;
+    atom_t *current;
+    atom_t *start;
+    atom_t *end;
 
-    start = table->global_hashes.data;
-    end   = table->global_hashes.data + table->global_hashes.size + 1;
+    start = table->global_atoms.data;
+    end   = table->global_atoms.data + table->global_atoms.size;
 
     /* @todo: perhaps there should be some kind of foreach? */
     for (current = start; current != end; ++current)
     {
-        if (*current == hash)
+        if (*current == atom)
         {
             return (current - start + 1) * -1;
         }
@@ -123,12 +106,12 @@ sym_find_global(const sym_table_t *table, sym_hash_t hash)
 }
 
 static sym_id_t
-add_global(sym_table_t *table, sym_global_t global, sym_hash_t hash)
+add_global(sym_table_t *table, sym_global_t global, atom_t atom)
 {
     vec_sym_global_t_push(&table->globals, global);
-    vec_sym_hash_t_push(&table->global_hashes, hash);
+    vec_atom_t_push(&table->global_atoms, atom);
 
-    assert(table->globals.size == table->global_hashes.size);
+    assert(table->globals.size == table->global_atoms.size);
 
     return -(table->globals.size);
 }
@@ -142,7 +125,7 @@ sym_get_global(sym_table_t *table, sym_id_t id)
 }
 
 sym_id_t
-sym_declare_global(sym_table_t *table, sym_global_t global, sym_hash_t hash,
+sym_declare_global(sym_table_t *table, sym_global_t global, atom_t atom,
                    err_location_t *err_loc)
 {
     sym_id_t      id;
@@ -150,13 +133,13 @@ sym_declare_global(sym_table_t *table, sym_global_t global, sym_hash_t hash,
 
     assert(table->scopes.size == 0);
 
-    id = sym_find_global(table, hash);
+    id = sym_find_global(table, atom);
 
 
     if (id == SYM_ID_GLOBAL_NULL)
     {
         global.defined = false;
-        return add_global(table, global, hash);
+        return add_global(table, global, atom);
     }
 
     sym = sym_get_global(table, id);
@@ -168,7 +151,7 @@ sym_declare_global(sym_table_t *table, sym_global_t global, sym_hash_t hash,
 }
 
 sym_id_t
-sym_define_global(sym_table_t *table, sym_global_t global, sym_hash_t hash, err_location_t *err_loc)
+sym_define_global(sym_table_t *table, sym_global_t global, atom_t atom, err_location_t *err_loc)
 {
     sym_id_t      id;
     sym_global_t *sym;
@@ -176,12 +159,12 @@ sym_define_global(sym_table_t *table, sym_global_t global, sym_hash_t hash, err_
 
     assert(table->scopes.size == 0);
 
-    id = sym_find_global(table, hash);
+    id = sym_find_global(table, atom);
 
     if (id == SYM_ID_GLOBAL_NULL)
     {
         global.defined = true;
-        return add_global(table, global, hash);
+        return add_global(table, global, atom);
     }
 
     assert(id < 0);
@@ -200,22 +183,22 @@ sym_define_global(sym_table_t *table, sym_global_t global, sym_hash_t hash, err_
 }
 
 sym_id_t
-sym_find_local(const sym_table_t *table, sym_hash_t hash)
+sym_find_local(const sym_table_t *table, atom_t atom)
 {
-    sym_hash_t *current;
-    sym_hash_t *start;
-    sym_hash_t *end;
+    atom_t *current;
+    atom_t *start;
+    atom_t *end;
 
     /* loop through in reverse */
-    start = table->local_hashes.data + table->local_hashes.size - 1;
-    end   = table->local_hashes.data - 1;
+    start = table->local_atoms.data + table->local_atoms.size - 1;
+    end   = table->local_atoms.data - 1;
 
 
     for (current = start; current != end; --current)
     {
-        if (*current == hash)
+        if (*current == atom)
         {
-            return (current - table->local_hashes.data) + 1;
+            return (current - table->local_atoms.data) + 1;
         }
     }
 
@@ -223,12 +206,12 @@ sym_find_local(const sym_table_t *table, sym_hash_t hash)
 }
 
 static sym_id_t
-add_local(sym_table_t *table, sym_local_t local, sym_hash_t hash)
+add_local(sym_table_t *table, sym_local_t local, atom_t atom)
 {
     vec_sym_local_t_push(&table->locals, local);
-    vec_sym_hash_t_push(&table->local_hashes, hash);
+    vec_atom_t_push(&table->local_atoms, atom);
 
-    assert(table->locals.size == table->local_hashes.size);
+    assert(table->locals.size == table->local_atoms.size);
 
     /* update current scope */
     ++vec_sym_scope_t_top_ptr(&table->scopes)->end;
@@ -246,21 +229,21 @@ sym_get_local(sym_table_t *table, sym_id_t id)
 }
 
 static sym_id_t
-find_in_scope(sym_table_t *table, sym_hash_t hash, sym_scope_t scope)
+find_in_scope(sym_table_t *table, atom_t atom, sym_scope_t scope)
 {
-    sym_hash_t *current;
-    sym_hash_t *start;
-    sym_hash_t *end;
+    atom_t *current;
+    atom_t *start;
+    atom_t *end;
 
 
-    start = table->local_hashes.data + scope.start;
-    end   = table->local_hashes.data + scope.end;
+    start = table->local_atoms.data + scope.start;
+    end   = table->local_atoms.data + scope.end;
 
     for (current = start; current != end; ++current)
     {
-        if (*current == hash)
+        if (*current == atom)
         {
-            return (current - table->local_hashes.data) + 1;
+            return (current - table->local_atoms.data) + 1;
         }
     }
 
@@ -271,16 +254,16 @@ find_in_scope(sym_table_t *table, sym_hash_t hash, sym_scope_t scope)
 /* @todo: you should be able to define a new variable by
  * same name in a deeper scope */
 sym_id_t
-sym_define_local(sym_table_t *table, sym_local_t local, sym_hash_t hash, err_location_t *err_loc)
+sym_define_local(sym_table_t *table, sym_local_t local, atom_t atom, err_location_t *err_loc)
 {
-    sym_id_t id = find_in_scope(table, hash, vec_sym_scope_t_top(&table->scopes));
+    sym_id_t id = find_in_scope(table, atom, vec_sym_scope_t_top(&table->scopes));
 
     if (id != SYM_ID_LOCAL_NULL)
     {
         syntax_error(*err_loc, "redefinition of variable");
     }
 
-    return add_local(table, local, hash);
+    return add_local(table, local, atom);
 }
 
 void
@@ -291,7 +274,7 @@ sym_check_for_anon_params(const vec_sym_param_t *params)
 
     for (i = 0; i < params->size; ++i)
     {
-        if (params->data[i].hash == SYM_NULL_HASH)
+        if (params->data[i].atom == ATOM_NULL)
         {
             syntax_error(params->data[i].err_loc, "anon parameter");
         }
@@ -303,16 +286,16 @@ sym_check_for_duplicate_params(const vec_sym_param_t *params)
 {
     uint32_t   i;
     uint32_t   j;
-    sym_hash_t hash;
+    atom_t     atom;
 
 
     for (i = 0; i < params->size; ++i)
     {
-        hash = params->data[i].hash;
+        atom = params->data[i].atom;
         for (j = 0; j < i; ++j)
         {
             /* we allow anon params */
-            if (hash == params->data[j].hash && hash != SYM_NULL_HASH)
+            if (atom == params->data[j].atom && atom != ATOM_NULL)
             {
                 syntax_error(params->data[i].err_loc, "redefinition of parameter");
             }
@@ -335,7 +318,7 @@ sym_add_params_to_scope(sym_table_t *table, const vec_sym_param_t *params)
     for (i = 0; i < params->size; ++i)
     {
         local.type = params->data[i].type;
-        add_local(table, local, params->data[i].hash);
+        add_local(table, local, params->data[i].atom);
     }
 }
 
@@ -358,19 +341,19 @@ sym_get_type_info(sym_table_t *table, sym_id_t id)
 
 /* looks through both locals and globals */
 sym_id_t
-sym_find_id(const sym_table_t *table, sym_hash_t hash)
+sym_find_id(const sym_table_t *table, atom_t atom)
 {
     sym_id_t id;
 
 
-    id = sym_find_local(table, hash);
+    id = sym_find_local(table, atom);
 
     if (id != SYM_ID_LOCAL_NULL)
     {
         return id;
     }
 
-    id = sym_find_global(table, hash);
+    id = sym_find_global(table, atom);
 
     if (id != SYM_ID_GLOBAL_NULL)
     {
@@ -388,8 +371,8 @@ sym_destroy_table(sym_table_t *table)
     vec_sym_local_t_destroy(&table->locals);
     vec_sym_global_t_destroy(&table->globals);
 
-    vec_sym_hash_t_destroy(&table->local_hashes);
-    vec_sym_hash_t_destroy(&table->global_hashes);
+    vec_atom_t_destroy(&table->local_atoms);
+    vec_atom_t_destroy(&table->global_atoms);
 
     vec_sym_scope_t_destroy(&table->scopes);
 }
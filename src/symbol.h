@@ -2,6 +2,7 @@
 #define _SYMBOL_
 
 #include "type.h"
+#include "atom.h"
 
 #include <limits.h>
 #include <stdint.h>
@@ -10,9 +11,7 @@
 #define SYM_ID_GLOBAL_NULL	INT32_MIN
 #define SYM_ID_LOCAL_NULL	INT32_MAX
 #define SYM_ID_NULL			0
-#define SYM_NULL_HASH		0
 
-typedef int64_t sym_hash_t;
 typedef int32_t	sym_id_t;
 
 typedef enum sym_local_kind
@@ -32,7 +31,7 @@ typedef enum sym_global_kind
 typedef struct sym_param
 {
 	type_info_t				type;
-	sym_hash_t				hash;
+	atom_t					atom;
 
 	/* ugh, we have to store an error loc, since it might be an error later */
 	err_location_t			err_loc;
@@ -93,7 +92,7 @@ typedef struct sym_scope
 #include "templates/vec.h"
 #undef VEC_TYPE
 
-#define VEC_TYPE sym_hash_t
+#define VEC_TYPE atom_t
 #include "templates/vec.h"
 #undef VEC_TYPE
 
@@ -102,29 +101,28 @@ typedef struct sym_table
 	vec_sym_global_t		globals;
 	vec_sym_local_t			locals;
 
-	vec_sym_hash_t			global_hashes;
-	vec_sym_hash_t			local_hashes;	
+	/* the name of every symbol */
+	vec_atom_t				global_atoms;
+	vec_atom_t				local_atoms;
 
 	vec_sym_scope_t			scopes;
 
 } sym_table_t;
 
-sym_hash_t			sym_hash(const char *key, uint32_t len);
-
 void				sym_create_table(sym_table_t *table, uint32_t count);
 void				sym_destroy_table(sym_table_t *table);
 
-sym_id_t			sym_find_global(const sym_table_t *table, sym_hash_t hash);
+sym_id_t			sym_find_global(const sym_table_t *table, atom_t atom);
 sym_global_t*		sym_get_global(sym_table_t *table, sym_id_t id);
-sym_id_t			sym_declare_global(sym_table_t *table, sym_global_t global, sym_hash_t hash, err_location_t *err_loc);
-sym_id_t			sym_define_global(sym_table_t *table, sym_global_t global, sym_hash_t hash, err_location_t *err_loc);
+sym_id_t			sym_declare_global(sym_table_t *table, sym_global_t global, atom_t atom, err_location_t *err_loc);
+sym_id_t			sym_define_global(sym_table_t *table, sym_global_t global, atom_t atom, err_location_t *err_loc);
 
 
-sym_id_t			sym_find_local(const sym_table_t *table, sym_hash_t hash);
+sym_id_t			sym_find_local(const sym_table_t *table, atom_t atom);
 sym_local_t*		sym_get_local(sym_table_t *table, sym_id_t id);
-sym_id_t			sym_define_local(sym_table_t *table, sym_local_t local, sym_hash_t hash, err_location_t *err_loc);
+sym_id_t			sym_define_local(sym_table_t *table, sym_local_t local, atom_t atom, err_location_t *err_loc);
 
-sym_id_t			sym_find_id(const sym_table_t *table, sym_hash_t hash);
+sym_id_t			sym_find_id(const sym_table_t *table, atom_t atom);
 type_info_t			sym_get_type_info(sym_table_t *table, sym_id_t id);
 
 void				sym_push_scope(sym_table_t *table);
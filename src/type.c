@@ -181,60 +181,6 @@ type_compat(type_info_t left, type_info_t right)
     return TYPE_COMPAT_COMPAT;
 }
 
-/* should already be checked that the suffix and literal are compat, 
- * we just change the type of the literal so it matches the suffix */
-void
-type_adapt_to_suffix(literal_t *literal, suffix_flags_t flags, err_location_t err_loc)
-{
-    switch (literal->type)
-    {
-    /* we always set a literal as double if it's a floating point */
-    case LITERAL_TYPE_DOUBLE:
-
-        if (flags & SUFFIX_UNSIGNED)
-        {
-            syntax_error(err_loc, "invalid suffix 'unsigned' for "
-                                  "floating point literal");
-        }
-
-        if (flags & SUFFIX_LONG)
-        {
-            syntax_error(err_loc, "invalid suffix 'long' for "
-                                  "floating point literal");
-        }
-
-        break;
-
-    case LITERAL_TYPE_INT:
-        /* should always be unsigned */
-
-        if (flags & SUFFIX_FLOAT)
-        {
-            syntax_error(err_loc, "invalid suffix 'float' for "
-                                  "integer literal");
-        }
-
-        if (flags & SUFFIX_LONG)
-        {
-            literal->type = LITERAL_TYPE_LONG;
-        }
-
-        break;
-
-    case LITERAL_TYPE_LONG:
-        if (flags & SUFFIX_FLOAT)
-        {
-            syntax_error(err_loc, "invalid suffix 'float' for "
-                                  "integer literal");
-        }
-        break;
-
-
-    default:
-        assert(false);
-    }
-}
-
 bool
 type_compare(type_info_t a, type_info_t b)
 {
@@ -255,16 +201,29 @@ type_from_literal(literal_t literal)
 
     switch (literal.type)
     {
+    case LITERAL_TYPE_FLOAT:
+        type.prim = TYPE_PRIM_FLOAT;
+        return type;
+
     case LITERAL_TYPE_DOUBLE:
         type.prim = TYPE_PRIM_DOUBLE;
         return type;
 
     case LITERAL_TYPE_INT:
+        type.prim = TYPE_PRIM_INT;
+        return type;
+
+    case LITERAL_TYPE_UINT:
         type.prim = TYPE_PRIM_INT;
         type.spec |= TYPE_SPEC_UNSIGNED;
         return type;
 
     case LITERAL_TYPE_LONG:
+        type.prim = TYPE_PRIM_INT;
+        type.spec |= TYPE_SPEC_LONG;
+        return type;
+
+    case LITERAL_TYPE_ULONG:
         type.prim = TYPE_PRIM_INT;
         type.spec |= TYPE_SPEC_UNSIGNED;
         type.spec |= TYPE_SPEC_LONG;
@@ -60,7 +60,6 @@ static const type_info_t NULL_TYPE_INFO = { .prim = TYPE_PRIM_NONE, .spec = 0, .
 void          type_check_validity(type_info_t *type, struct err_location *err_loc);
 size_t        type_get_width(const type_info_t type);
 type_compat_t type_compat(type_info_t left, type_info_t right);
-void        type_adapt_to_suffix(literal_t *literal, suffix_flags_t flags, err_location_t err_loc);
 bool        type_compare(type_info_t a, type_info_t b);
 type_info_t type_from_literal(literal_t literal);
 
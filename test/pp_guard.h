@@ -0,0 +1,14 @@
+/* a header with an include guard, which is read once */
+
+#ifndef PP_GUARD_H
+#define PP_GUARD_H
+
+#ifdef PP_GUARD_READ
+#error "pp_guard.h was read twice"
+#endif
+
+#define PP_GUARD_READ
+
+int guarded;
+
+#endif
@@ -0,0 +1,19 @@
+/* every header is included twice, the second time is skipped */
+
+#include "pp_guard.h"
+#include "pp_once.h"
+
+#include "pp_guard.h"
+#include "../test/pp_once.h"
+
+#define ONCE_HEADER "pp_once.h"
+#include ONCE_HEADER
+
+#if !defined(PP_GUARD_READ) || !defined(PP_ONCE_READ)
+#error "header not read"
+#endif
+
+int main(int argc, char **argv)
+{
+	guarded = once;
+}
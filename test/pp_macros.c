@@ -0,0 +1,151 @@
+/* the macro examples of C11 6.10.3.5, integer results are checked with #if,
+ * the rest is made into a string with show(), since the parser can't take
+ * function calls yet, the expected expansion is written above it */
+
+#define show(...) show_(__VA_ARGS__)
+#define show_(...) #__VA_ARGS__
+
+char *s;
+
+/* example 3, rescanning */
+#define x 3
+#define f(a) f(x * (a))
+#undef x
+#define x 2
+#define g f
+#define z z[0]
+#define h g(~
+#define m(a) a(w)
+#define w 0,1
+#define t(a) a
+#define p() int
+#define q(x) x
+#define r(x,y) x ## y
+#define str(x) # x
+
+/* the ')' which ends h is outside of the arguments of show */
+#define example_3b g(x+(3,4)-w) | h 5) & m(f)^m(m);
+
+#if q(1) != 1 || r(2,3) != 23 || r(4,) != 4 || r(,5) != 5 || r(,) 1 != 1
+#error "## with empty arguments"
+#endif
+
+#if t(t(x)) != 2 || q(t)(3) != 3
+#error "rescanning"
+#endif
+
+p() i;
+
+int main(int argc, char **argv)
+{
+	/* f(2 * (y+1)) + f(2 * (f(2 * (z[0])))) % f(2 * (0)) + t(1); */
+	s = show(f(y+1) + f(f(z)) % t(t(g)(0) + t)(1););
+
+	/* f(2 * (2+(3,4)-0,1)) | f(2 * (~ 5)) & f(2 * (0,1))^m(0,1); */
+	s = show(example_3b);
+
+	/* "hello", "" */
+	s = str(hello);
+	s = str();
+}
+
+#undef x
+#undef f
+#undef g
+#undef h
+#undef m
+#undef t
+#undef str
+
+/* example 4, # and ## */
+#define str(s) # s
+#define xstr(s) str(s)
+#define debug(s, t) printf("x" # s "= %d, x" # t "= %s", \
+	x ## s, x ## t)
+#define INCFILE(n) vers ## n
+#define glue(a, b) a ## b
+#define xglue(a, b) glue(a, b)
+#define HIGHLOW "hello"
+#define LOW LOW ", world"
+
+/* #include "vers2.h" */
+#include xstr(INCFILE(2).h)
+
+#if vers2_included != 1
+#error "computed #include"
+#endif
+
+#if glue(1, 2) != 12 || xglue(glue(1, 2), 3) != 123
+#error "##"
+#endif
+
+int test_4(int argc, char **argv)
+{
+	/* printf("x" "1" "= %d, x" "2" "= %s", x1, x2); */
+	s = show(debug(1, 2););
+
+	/* fputs("strncmp(\"abc\\0d\", \"abc\", '\\4') == 0" ": @\n", s); */
+	s = show(fputs(str(strncmp("abc\0d", "abc", '\4') // this goes away
+		== 0) str(: @\n), s););
+
+	/* "hello"; */
+	s = glue(HIGH, LOW);
+
+	/* "hello" ", world" */
+	s = xglue(HIGH, LOW);
+}
+
+#undef t
+
+/* example 5, placemarkers */
+#define t(x,y,z) x ## y ## z
+
+#if t(1,2,3) != 123 || t(,4,5) != 45 || t(6,,7) != 67 || t(8,9,) != 89
+#error "placemarker"
+#endif
+
+#if t(10,,) != 10 || t(,11,) != 11 || t(,,12) != 12 || t(,,) 1 != 1
+#error "placemarker"
+#endif
+
+/* example 6, redefinitions which are the same */
+#define OBJ_LIKE (1-1)
+#define OBJ_LIKE /* white space */ (1-1) /* other */
+#define FUNC_LIKE(a) ( a )
+#define FUNC_LIKE( a )( /* note the white space */ \
+	a /* other stuff on this line
+	*/ )
+
+#if OBJ_LIKE != 0 || FUNC_LIKE(3) != 3
+#error "redefinition"
+#endif
+
+#undef debug
+
+/* example 7, variable arguments */
+#define debug(...) fprintf(stderr, __VA_ARGS__)
+#define showlist(...) puts(#__VA_ARGS__)
+#define report(test, ...) ((test)?puts(#test):\
+	printf(__VA_ARGS__))
+
+#define count(...) count_(__VA_ARGS__, 3, 2, 1, 0)
+#define count_(a, b, c, n, ...) n
+
+#if count(a) != 1 || count(a, b) != 2 || count(a, (b, c), d) != 3
+#error "__VA_ARGS__"
+#endif
+
+int test_7(int argc, char **argv)
+{
+	/* fprintf(stderr, "Flag"); */
+	s = show(debug("Flag"););
+
+	/* fprintf(stderr, "X = %d\n", x); */
+	s = show(debug("X = %d\n", x););
+
+	/* puts("The first, second, and third items."); */
+	s = show(showlist(The first, second, and third items.););
+
+	/* ((x>y)?puts("x>y"): printf("x is %d but y is %d", x, y)); */
+	s = show(report(x>y, "x is %d but y is %d", x, y););
+}
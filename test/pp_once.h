@@ -0,0 +1,11 @@
+/* a header with #pragma once, which is read once */
+
+#pragma once
+
+#ifdef PP_ONCE_READ
+#error "pp_once.h was read twice"
+#endif
+
+#define PP_ONCE_READ
+
+int once;
@@ -0,0 +1,78 @@
+/* groups which aren't taken are only scanned for directives, so nothing
+ * in them is an error, every group which is taken defines its name */
+
+#if 0
+it's a stray quote
+"and an unterminated string
+09 1e+ 0x 1.2.3 @ ` \
+#endif continued on the next line
+'
+#else
+#define ELSE_TAKEN
+#endif
+
+#ifndef ELSE_TAKEN
+#error "#else after a group with stray quotes"
+#endif
+
+#ifdef NOT_DEFINED
+/* a comment with a directive in it
+#endif
+#else
+*/
+#error "directive in a comment"
+# /* */ elif 0
+#error "#elif 0"
+#elif defined(ELSE_TAKEN) && !defined NOT_DEFINED
+#define ELIF_TAKEN
+#else
+#error "#else after a taken #elif"
+#endif
+
+#ifndef ELIF_TAKEN
+#error "#elif after a comment"
+#endif
+
+#if 1
+#define NESTED_TAKEN
+#elif 1 / 0
+#error "#elif after a taken group"
+#else
+#if 1 / 0
+#error "nested in a group which isn't taken"
+#else
+don't
+#endif
+#endif
+
+#ifndef NESTED_TAKEN
+#error "nested group"
+#endif
+
+#if 0
+#if "the condition isn't evaluated"
+#unknown directive
+#include <no/such/file.h>
+#error "not taken"
+#endif
+#elif 0
+#else
+#define LAST_TAKEN
+#endif
+
+#ifndef LAST_TAKEN
+#error "#else after #elif 0"
+#endif
+
+/* directives can be split over lines */
+#if 0
+#el\
+se
+#define SPLICED_TAKEN
+#endif
+
+#ifndef SPLICED_TAKEN
+#error "#else split over two lines"
+#endif
+
+int taken;
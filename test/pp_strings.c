@@ -0,0 +1,26 @@
+/* adjacent string literals are joined after the directives are handled and
+ * macros are expanded, a directive ends at its newline even when the next
+ * line starts with a string literal */
+
+char *s;
+
+int main(int argc, char **argv)
+{
+	s =
+#define GREETING "hello, "
+	"world";
+
+	s =
+#include "vers2.h"
+	"world";
+
+	/* "hello, world" */
+	s = GREETING
+	"world";
+
+	/* "hello, world!" */
+	s = GREETING
+#undef GREETING
+#define GREETING "world"
+	GREETING "!";
+}
@@ -0,0 +1,3 @@
+/* included by pp_macros.c with a computed #include */
+
+#define vers2_included 1
@@ -0,0 +1,498 @@
+/*
+ * measures the throughput of the lexer on synthetic corpora, or on the given files
+ *
+ * usage: cb_bench_lexer [-r runs] [-s size in MB] [-j json file] [file...]
+ *
+ * every corpus is lexed 'runs' times from f_create_lexer to TOK_EOF, and the
+ * fastest and the median run are reported. the numbers only mean something
+ * in a build configured with -DCMAKE_BUILD_TYPE=Release
+ */
+
+#include "atom.h"
+#include "f_lexer.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+#define MAX_RUNS 1000
+
+typedef struct corpus
+{
+    const char *name;
+    const char *path;
+    bool        generated;
+
+    /* where a generated corpus is written, which 'path' then points to */
+    char temp_path[64];
+
+} corpus_t;
+
+typedef struct result
+{
+    uint64_t bytes;
+    uint64_t tokens;
+
+    /* per run, sorted */
+    double   seconds[MAX_RUNS];
+    uint64_t cycles[MAX_RUNS];
+
+} result_t;
+
+/* ================================================================================= */
+/* corpora */
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+/* xorshift, so the corpora are the same on every machine */
+static uint32_t
+rng(uint32_t n)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+
+    return rng_state % n;
+}
+
+static const char *const keywords[] = {
+    "int", "char", "return", "if", "else", "while", "for", "struct",
+    "unsigned", "static", "const", "void", "sizeof", "typedef",
+};
+
+static const char *const operators[] = {
+    "+", "-", "*", "/", "%", "+=", "-=", "*=", "++", "--", "=", "==", "!=",
+    "<", ">", "<=", ">=", "<<", ">>", "<<=", ">>=", "&&", "||", "&", "|", "^",
+    "~", "!", "(", ")", "[", "]", "{", "}", ".", "->", ";", ":", ",", "?", "...",
+};
+
+#define COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+static void
+write_identifier(FILE *file)
+{
+    static const char first[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_";
+    static const char rest[]  = "abcdefghijklmnopqrstuvwxyz_0123456789";
+    uint32_t          len     = 1 + rng(4) + (rng(4) == 0 ? rng(24) : 0);
+    uint32_t          i;
+
+    fputc(first[rng(sizeof(first) - 1)], file);
+
+    for (i = 1; i < len; ++i)
+    {
+        fputc(rest[rng(sizeof(rest) - 1)], file);
+    }
+}
+
+/* mostly block and line comments, with a statement now and then */
+static void
+write_comments(FILE *file)
+{
+    uint32_t i;
+    uint32_t len;
+
+    switch (rng(3))
+    {
+    case 0:
+        fputs("/* ", file);
+
+        for (len = rng(6), i = 0; i <= len; ++i)
+        {
+            fputs("the quick brown fox jumps over the lazy dog\n * ", file);
+        }
+
+        fputs("*/\n", file);
+        break;
+
+    case 1:
+        fputs("// ", file);
+
+        for (len = rng(8), i = 0; i <= len; ++i)
+        {
+            fputs("some words ", file);
+        }
+
+        fputc('\n', file);
+        break;
+
+    default:
+        write_identifier(file);
+        fputs(" = ", file);
+        write_identifier(file);
+        fputs(";\n", file);
+        break;
+    }
+}
+
+/* identifiers and keywords, separated by commas and spaces */
+static void
+write_identifiers(FILE *file)
+{
+    if (rng(5) == 0)
+    {
+        fputs(keywords[rng(COUNT(keywords))], file);
+    }
+    else
+    {
+        write_identifier(file);
+    }
+
+    fputs(rng(8) == 0 ? ",\n" : ", ", file);
+}
+
+/* every kind of constant */
+static void
+write_literals(FILE *file)
+{
+    static const char *const escapes[] = { "\\n", "\\t", "\\\\", "\\\"", "\\x41", "\\101" };
+    uint32_t                 i;
+    uint32_t                 len;
+
+    switch (rng(6))
+    {
+    case 0:
+        fprintf(file, "%u", rng(1000000));
+        break;
+
+    case 1:
+        fprintf(file, "0x%xul", rng(UINT32_MAX));
+        break;
+
+    case 2:
+        fprintf(file, "%u.%ue%d", rng(1000), rng(100000), (int)rng(40) - 20);
+        break;
+
+    case 3:
+        fprintf(file, "%u.%uf", rng(100), rng(1000));
+        break;
+
+    case 4:
+        fputc('"', file);
+
+        for (len = rng(24), i = 0; i < len; ++i)
+        {
+            if (rng(6) == 0)
+            {
+                fputs(escapes[rng(COUNT(escapes))], file);
+            }
+            else
+            {
+                /* no hex digits, which would join a hex escape before them */
+                fputc('g' + rng(20), file);
+            }
+        }
+
+        fputc('"', file);
+        break;
+
+    default:
+        fprintf(file, "'%c'", 'a' + rng(26));
+        break;
+    }
+
+    fputs(rng(8) == 0 ? ",\n" : ", ", file);
+}
+
+/* punctuators, with few spaces */
+static void
+write_operators(FILE *file)
+{
+    fputs(operators[rng(COUNT(operators))], file);
+
+    /* keeps neighbours from joining into other operators, or comments */
+    fputc(rng(16) == 0 ? '\n' : ' ', file);
+}
+
+static void
+generate(corpus_t *corpus, void (*write)(FILE *), uint64_t size)
+{
+    FILE *file;
+    int   fd;
+
+    snprintf(corpus->temp_path, sizeof(corpus->temp_path), "/tmp/cb_bench_%s_XXXXXX", corpus->name);
+
+    corpus->path = corpus->temp_path;
+    fd           = mkstemp(corpus->temp_path);
+
+    if (fd < 0 || !(file = fdopen(fd, "w")))
+    {
+        fprintf(stderr, "can't create %s\n", corpus->path);
+        exit(1);
+    }
+
+    while ((uint64_t)ftell(file) < size)
+    {
+        write(file);
+    }
+
+    fputc('\n', file);
+    fclose(file);
+
+    corpus->generated = true;
+}
+
+/* ================================================================================= */
+/* measuring */
+
+static double
+now(void)
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static uint64_t
+cycles(void)
+{
+#if HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static int
+compare_double(const void *a, const void *b)
+{
+    return (*(const double *)a > *(const double *)b) - (*(const double *)a < *(const double *)b);
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+    return (*(const uint64_t *)a > *(const uint64_t *)b) - (*(const uint64_t *)a < *(const uint64_t *)b);
+}
+
+static void
+run(const corpus_t *corpus, result_t *result, int runs)
+{
+    lexer_t  lexer;
+    double   start;
+    uint64_t start_cycles;
+    uint64_t tokens;
+    int      i;
+
+    for (i = 0; i < runs; ++i)
+    {
+        /* a fresh atom table, as a compiler run would have */
+        atom_destroy_table();
+
+        start        = now();
+        start_cycles = cycles();
+
+        f_create_lexer(&lexer, corpus->path);
+
+        for (tokens = 1; lexer.curr_token.type != TOK_EOF; ++tokens)
+        {
+            f_next_token(&lexer);
+        }
+
+        result->cycles[i]  = cycles() - start_cycles;
+        result->seconds[i] = now() - start;
+        result->bytes      = lexer.source.end - lexer.source.start;
+        result->tokens     = tokens;
+
+        f_destroy_lexer(&lexer);
+    }
+
+    qsort(result->seconds, runs, sizeof(double), compare_double);
+    qsort(result->cycles, runs, sizeof(uint64_t), compare_u64);
+}
+
+/* a file name can have any byte but '\0' */
+static void
+write_json_string(FILE *file, const char *str)
+{
+    fputc('"', file);
+
+    for (; *str; ++str)
+    {
+        if (*str == '"' || *str == '\\')
+        {
+            fputc('\\', file);
+            fputc(*str, file);
+        }
+        else if ((unsigned char)*str < 0x20)
+        {
+            fprintf(file, "\\u%04x", (unsigned char)*str);
+        }
+        else
+        {
+            fputc(*str, file);
+        }
+    }
+
+    fputc('"', file);
+}
+
+static void
+print_result(FILE *file, const corpus_t *corpus, const result_t *result, int runs, bool json)
+{
+    double best   = result->seconds[0];
+    double median = result->seconds[runs / 2];
+    double mb     = result->bytes / (1024.0 * 1024.0);
+
+    if (json)
+    {
+        fprintf(file, "    { \"corpus\": ");
+        write_json_string(file, corpus->name);
+        fprintf(file,
+                ", \"bytes\": %llu, \"tokens\": %llu, \"runs\": %d, "
+                "\"best_seconds\": %.6f, \"median_seconds\": %.6f, \"mb_per_second\": %.2f, "
+                "\"tokens_per_second\": %.0f, ",
+                (unsigned long long)result->bytes,
+                (unsigned long long)result->tokens, runs, best, median, mb / best,
+                result->tokens / best);
+
+        if (HAVE_TSC)
+        {
+            fprintf(file, "\"cycles_per_token\": %.2f }", (double)result->cycles[0] / result->tokens);
+        }
+        else
+        {
+            fprintf(file, "\"cycles_per_token\": null }");
+        }
+
+        return;
+    }
+
+    fprintf(file, "%-12s %8.1f MB %10llu tokens %9.1f MB/s %12.0f tokens/s", corpus->name, mb,
+            (unsigned long long)result->tokens, mb / best, result->tokens / best);
+
+    /* the time stamp counter, which ticks at the nominal frequency */
+    if (HAVE_TSC)
+    {
+        fprintf(file, " %7.2f cycles/token", (double)result->cycles[0] / result->tokens);
+    }
+
+    fprintf(file, "  (median %.1f MB/s)\n", mb / median);
+}
+
+int
+main(int argc, char **argv)
+{
+    static void (*const writers[])(FILE *) = {
+        write_comments,
+        write_identifiers,
+        write_literals,
+        write_operators,
+    };
+
+    static const char *const names[] = { "comments", "identifiers", "literals", "operators" };
+
+    corpus_t *  corpora;
+    result_t *  result = malloc(sizeof(result_t));
+    int         corpus_count;
+    int         runs      = 5;
+    uint64_t    size      = 16;
+    const char *json_path = NULL;
+    FILE *      json      = NULL;
+    int         opt;
+    int         i;
+
+    while ((opt = getopt(argc, argv, "r:s:j:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            runs = atoi(optarg);
+            break;
+
+        case 's':
+            size = strtoull(optarg, NULL, 10);
+            break;
+
+        case 'j':
+            json_path = optarg;
+            break;
+
+        default:
+            fprintf(stderr, "usage: %s [-r runs] [-s size in MB] [-j json file] [file...]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (runs < 1 || runs > MAX_RUNS || !result)
+    {
+        fprintf(stderr, "runs must be between 1 and %d\n", MAX_RUNS);
+        return 1;
+    }
+
+    /* the given files, or else the generated corpora */
+    if (optind < argc)
+    {
+        corpus_count = argc - optind;
+        corpora      = calloc(corpus_count, sizeof(corpus_t));
+
+        for (i = 0; i < corpus_count; ++i)
+        {
+            corpora[i].name = argv[optind + i];
+            corpora[i].path = argv[optind + i];
+        }
+    }
+    else
+    {
+        corpus_count = COUNT(writers);
+        corpora      = calloc(corpus_count, sizeof(corpus_t));
+
+        for (i = 0; i < corpus_count; ++i)
+        {
+            corpora[i].name = names[i];
+            generate(&corpora[i], writers[i], size * 1024 * 1024);
+        }
+    }
+
+    if (json_path && !(json = fopen(json_path, "w")))
+    {
+        fprintf(stderr, "can't open %s\n", json_path);
+        return 1;
+    }
+
+    if (json)
+    {
+        fprintf(json, "{\n  \"results\": [\n");
+    }
+
+    for (i = 0; i < corpus_count; ++i)
+    {
+        run(&corpora[i], result, runs);
+        print_result(stdout, &corpora[i], result, runs, false);
+
+        if (json)
+        {
+            print_result(json, &corpora[i], result, runs, true);
+            fprintf(json, i + 1 < corpus_count ? ",\n" : "\n");
+        }
+
+        if (corpora[i].generated)
+        {
+            unlink(corpora[i].path);
+        }
+    }
+
+    if (json)
+    {
+        fprintf(json, "  ]\n}\n");
+        fclose(json);
+    }
+
+    atom_destroy_table();
+    free(corpora);
+    free(result);
+
+    return 0;
+}
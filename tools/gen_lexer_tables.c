@@ -0,0 +1,762 @@
+/*
+ * generates the lookup tables used by the lexer, run by the build
+ *
+ * usage: gen_lexer_tables <lexer header> <number header>
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ================================================================================= */
+/* keywords */
+
+typedef struct keyword
+{
+    const char *str;
+    const char *type;
+
+} keyword_t;
+
+/* to add a keyword, add a token type for it and add it here */
+static const keyword_t keywords[] = {
+    { "if", "TOK_KEY_IF" },
+    { "else", "TOK_KEY_ELSE" },
+    { "while", "TOK_KEY_WHILE" },
+    { "do", "TOK_KEY_DO" },
+    { "for", "TOK_KEY_FOR" },
+    { "switch", "TOK_KEY_SWITCH" },
+    { "case", "TOK_KEY_CASE" },
+    { "break", "TOK_KEY_BREAK" },
+    { "default", "TOK_KEY_DEFAULT" },
+    { "continue", "TOK_KEY_CONTINUE" },
+    { "return", "TOK_KEY_RETURN" },
+    { "goto", "TOK_KEY_GOTO" },
+    { "int", "TOK_KEY_INT" },
+    { "float", "TOK_KEY_FLOAT" },
+    { "char", "TOK_KEY_CHAR" },
+    { "double", "TOK_KEY_DOUBLE" },
+    { "long", "TOK_KEY_LONG" },
+    { "short", "TOK_KEY_SHORT" },
+    { "void", "TOK_KEY_VOID" },
+    { "const", "TOK_KEY_CONST" },
+    { "volatile", "TOK_KEY_VOLATILE" },
+    { "register", "TOK_KEY_REGISTER" },
+    { "signed", "TOK_KEY_SIGNED" },
+    { "unsigned", "TOK_KEY_UNSIGNED" },
+    { "struct", "TOK_KEY_STRUCT" },
+    { "enum", "TOK_KEY_ENUM" },
+    { "union", "TOK_KEY_UNION" },
+    { "extern", "TOK_KEY_EXTERN" },
+    { "static", "TOK_KEY_STATIC" },
+    { "sizeof", "TOK_KEY_SIZEOF" },
+    { "typedef", "TOK_KEY_TYPEDEF" },
+};
+
+#define KEYWORD_COUNT (sizeof(keywords) / sizeof(keywords[0]))
+
+/* the hash is only computed from the first byte, the last byte and the length,
+ * so those must be unique for every keyword */
+#define KEYWORD_BUCKET_BITS 4
+#define KEYWORD_BUCKETS     (1 << KEYWORD_BUCKET_BITS)
+
+static uint32_t
+keyword_key(const char *str, uint32_t len)
+{
+    return (uint8_t)str[0] | (uint8_t)str[len - 1] << 8 | len << 16;
+}
+
+static uint32_t
+rand32(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return *state >> 32;
+}
+
+/*
+ * builds a minimal perfect hash with hash and displace, every key is put in a
+ * bucket, and each bucket gets a displacement, which moves its keys into
+ * free slots:
+ *
+ *   h    = key * seed
+ *   slot = (((h << BUCKET_BITS) ^ disp[h >> (32 - BUCKET_BITS)]) * COUNT) >> 32
+ */
+static int
+build_keyword_hash(uint32_t seed, uint32_t *disp, int32_t *slots, uint64_t *rng)
+{
+    uint32_t buckets[KEYWORD_BUCKETS][KEYWORD_COUNT];
+    uint32_t bucket_size[KEYWORD_BUCKETS] = { 0 };
+    uint32_t order[KEYWORD_BUCKETS];
+    uint32_t i, j, k, b, tmp, tries, h, slot;
+    int      ok;
+
+    for (i = 0; i < KEYWORD_COUNT; ++i)
+    {
+        h = keyword_key(keywords[i].str, strlen(keywords[i].str)) * seed;
+        b = h >> (32 - KEYWORD_BUCKET_BITS);
+
+        buckets[b][bucket_size[b]++] = i;
+    }
+
+    for (i = 0; i < KEYWORD_COUNT; ++i)
+    {
+        slots[i] = -1;
+    }
+
+    /* place the largest buckets first */
+    for (i = 0; i < KEYWORD_BUCKETS; ++i)
+    {
+        order[i] = i;
+    }
+
+    for (i = 0; i < KEYWORD_BUCKETS; ++i)
+    {
+        for (j = i + 1; j < KEYWORD_BUCKETS; ++j)
+        {
+            if (bucket_size[order[j]] > bucket_size[order[i]])
+            {
+                tmp      = order[i];
+                order[i] = order[j];
+                order[j] = tmp;
+            }
+        }
+    }
+
+    for (i = 0; i < KEYWORD_BUCKETS; ++i)
+    {
+        b       = order[i];
+        disp[b] = 0;
+
+        if (!bucket_size[b])
+        {
+            continue;
+        }
+
+        for (tries = 0; tries < 100000; ++tries)
+        {
+            disp[b] = rand32(rng);
+            ok      = 1;
+
+            for (j = 0; j < bucket_size[b] && ok; ++j)
+            {
+                k    = buckets[b][j];
+                h    = keyword_key(keywords[k].str, strlen(keywords[k].str)) * seed;
+                slot = ((uint64_t)((h << KEYWORD_BUCKET_BITS) ^ disp[b]) * KEYWORD_COUNT) >> 32;
+
+                if (slots[slot] != -1)
+                {
+                    ok = 0;
+                }
+                else
+                {
+                    slots[slot] = k;
+                }
+            }
+
+            if (ok)
+            {
+                break;
+            }
+
+            /* undo the keys placed by this try */
+            for (k = 0; k < KEYWORD_COUNT; ++k)
+            {
+                for (j = 0; j < bucket_size[b]; ++j)
+                {
+                    if (slots[k] == (int32_t)buckets[b][j])
+                    {
+                        slots[k] = -1;
+                    }
+                }
+            }
+        }
+
+        if (!ok)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* the spelling as it is laid out in memory, and a mask of the bytes which are used */
+static void
+keyword_words(const char *str, uint64_t *words, uint64_t *masks)
+{
+    char     spelling[16] = { 0 };
+    char     mask[16]     = { 0 };
+    uint32_t len          = strlen(str);
+
+    memcpy(spelling, str, len);
+    memset(mask, 0xff, len);
+
+    memcpy(words, spelling, 16);
+    memcpy(masks, mask, 16);
+}
+
+static void
+write_keywords(FILE *out)
+{
+    uint32_t disp[KEYWORD_BUCKETS];
+    int32_t  slots[KEYWORD_COUNT];
+    uint64_t rng = 0x2545f4914f6cdd1d;
+    uint64_t words[2];
+    uint64_t masks[2];
+    uint32_t seed;
+    uint32_t i, j, len;
+    uint32_t min_len = 0xff;
+    uint32_t max_len = 0;
+
+    for (i = 0; i < KEYWORD_COUNT; ++i)
+    {
+        len = strlen(keywords[i].str);
+
+        if (len > 16)
+        {
+            fprintf(stderr, "keyword '%s' is longer than 16 bytes\n", keywords[i].str);
+            exit(1);
+        }
+
+        min_len = len < min_len ? len : min_len;
+        max_len = len > max_len ? len : max_len;
+
+        for (j = 0; j < i; ++j)
+        {
+            if (keyword_key(keywords[i].str, len) ==
+                keyword_key(keywords[j].str, strlen(keywords[j].str)))
+            {
+                fprintf(stderr, "keywords '%s' and '%s' have the same first byte, last byte "
+                                "and length\n",
+                        keywords[i].str, keywords[j].str);
+                exit(1);
+            }
+        }
+    }
+
+    do
+    {
+        seed = rand32(&rng) | 1;
+    } while (!build_keyword_hash(seed, disp, slots, &rng));
+
+    fprintf(out, "#define KEYWORD_COUNT       %u\n", (uint32_t)KEYWORD_COUNT);
+    fprintf(out, "#define KEYWORD_MIN_LEN     %u\n", min_len);
+    fprintf(out, "#define KEYWORD_MAX_LEN     %u\n", max_len);
+    fprintf(out, "#define KEYWORD_WORDS       %u\n", max_len > 8 ? 2 : 1);
+    fprintf(out, "#define KEYWORD_SEED        0x%08xu\n", seed);
+    fprintf(out, "#define KEYWORD_BUCKET_BITS %u\n\n", KEYWORD_BUCKET_BITS);
+
+    fprintf(out, "static const uint32_t keyword_disp[%u] = {\n", KEYWORD_BUCKETS);
+
+    for (i = 0; i < KEYWORD_BUCKETS; ++i)
+    {
+        fprintf(out, "    0x%08x,\n", disp[i]);
+    }
+
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static const keyword_entry_t keyword_table[KEYWORD_COUNT] = {\n");
+
+    for (i = 0; i < KEYWORD_COUNT; ++i)
+    {
+        keyword_words(keywords[slots[i]].str, words, masks);
+
+        fprintf(out,
+                "    { %s, %u, { 0x%016llxull, 0x%016llxull }, { 0x%016llxull, 0x%016llxull } }, "
+                "/* %s */\n",
+                keywords[slots[i]].type, (uint32_t)strlen(keywords[slots[i]].str),
+                (unsigned long long)words[0], (unsigned long long)words[1],
+                (unsigned long long)masks[0], (unsigned long long)masks[1], keywords[slots[i]].str);
+    }
+
+    fprintf(out, "};\n\n");
+}
+
+
+/* ================================================================================= */
+/* punctuators */
+
+/* to add a punctuator, add a token type for it and add it here, spellings of
+ * three bytes must start with one of two bytes, or of one byte */
+static const keyword_t punctuators[] = {
+    { "+", "TOK_PLUS" },
+    { "+=", "TOK_PLUS_ASSIGN" },
+    { "++", "TOK_INCREASE" },
+    { "-", "TOK_MINUS" },
+    { "-=", "TOK_MINUS_ASSIGN" },
+    { "--", "TOK_DECREASE" },
+    { "->", "TOK_ARROW" },
+    { "*", "TOK_STAR" },
+    { "*=", "TOK_STAR_ASSIGN" },
+    { "/", "TOK_DIV" },
+    { "/=", "TOK_DIV_ASSIGN" },
+    { "%", "TOK_MOD" },
+    { "%=", "TOK_MOD_ASSIGN" },
+    { "=", "TOK_ASSIGN" },
+    { "==", "TOK_EQUAL" },
+    { "&", "TOK_AMPERSAND" },
+    { "&=", "TOK_AMPERSAND_ASSIGN" },
+    { "&&", "TOK_AND" },
+    { "|", "TOK_OR_BIT" },
+    { "|=", "TOK_OR_ASSIGN" },
+    { "||", "TOK_OR" },
+    { "~", "TOK_NOT_BIT" },
+    { "~=", "TOK_NOT_ASSIGN" },
+    { "^", "TOK_EOR" },
+    { "^=", "TOK_EOR_ASSIGN" },
+    { ">", "TOK_GREATER" },
+    { ">=", "TOK_GREATER_OR_EQUAL" },
+    { ">>", "TOK_RIGHT_SHIFT" },
+    { ">>=", "TOK_RIGHT_SHIFT_ASSIGN" },
+    { "<", "TOK_LESSER" },
+    { "<=", "TOK_LESSER_OR_EQUAL" },
+    { "<<", "TOK_LEFT_SHIFT" },
+    { "<<=", "TOK_LEFT_SHIFT_ASSIGN" },
+    { "!", "TOK_NOT" },
+    { "!=", "TOK_NOT_EQUAL" },
+    { "(", "TOK_PAREN_OPEN" },
+    { ")", "TOK_PAREN_CLOSED" },
+    { "[", "TOK_BRACKET_OPEN" },
+    { "]", "TOK_BRACKET_CLOSED" },
+    { "{", "TOK_BRACE_OPEN" },
+    { "}", "TOK_BRACE_CLOSED" },
+    { ".", "TOK_DOT" },
+    { "...", "TOK_ELLIPSIS" },
+    { ",", "TOK_COMMA" },
+    { ";", "TOK_SEMIKOLON" },
+    { ":", "TOK_KOLON" },
+    { "?", "TOK_QUERY" },
+    { "#", "TOK_HASH" },
+    { "##", "TOK_HASH_HASH" },
+};
+
+#define PUNCTUATOR_COUNT (sizeof(punctuators) / sizeof(punctuators[0]))
+
+/* extensions are numbered from 1, 0 means none */
+#define MAX_EXTENSIONS 3
+
+static int
+find_punctuator(const char *str)
+{
+    uint32_t i;
+
+    for (i = 0; i < PUNCTUATOR_COUNT; ++i)
+    {
+        if (strcmp(punctuators[i].str, str) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* index of the byte 'c' in 'chars', or 'count' if it isn't there */
+static uint32_t
+index_of(const char *chars, uint32_t count, uint32_t c)
+{
+    uint32_t i;
+
+    for (i = 0; i < count; ++i)
+    {
+        if ((uint8_t)chars[i] == c)
+        {
+            return i;
+        }
+    }
+
+    return count;
+}
+
+static void
+write_entry(FILE *out, const char *type, uint32_t len, uint32_t extension)
+{
+    fprintf(out, "    %s | %u << 8 | %u << 10,\n", type, len, extension);
+}
+
+/*
+ * punctuators are found from their first two bytes, the first byte picks a row
+ * and the second a column of a table of entries, which hold the token type in
+ * the low byte, the length in bits 8-9, and an extension in bits 10-11. the
+ * extension is a third byte which makes a longer punctuator, like "<<="
+ */
+static void
+write_punctuators(FILE *out)
+{
+    char        first[PUNCTUATOR_COUNT];
+    char        second[PUNCTUATOR_COUNT];
+    char        prefix[3] = { 0 };
+    char        two[3]    = { 0 };
+    uint32_t    extensions[MAX_EXTENSIONS + 1];
+    uint32_t    row_count       = 0;
+    uint32_t    column_count    = 0;
+    uint32_t    extension_count = 0;
+    uint32_t    extension;
+    uint32_t    i, r, c;
+    int         p;
+    const char *str;
+
+    for (i = 0; i < PUNCTUATOR_COUNT; ++i)
+    {
+        str = punctuators[i].str;
+
+        if (strlen(str) > 3 || !str[0])
+        {
+            fprintf(stderr, "punctuator '%s' must be 1 to 3 bytes\n", str);
+            exit(1);
+        }
+
+        if (index_of(first, row_count, (uint8_t)str[0]) == row_count)
+        {
+            first[row_count++] = str[0];
+        }
+
+        if (str[1] && index_of(second, column_count, (uint8_t)str[1]) == column_count)
+        {
+            second[column_count++] = str[1];
+        }
+
+        if (strlen(str) == 3)
+        {
+            if (extension_count == MAX_EXTENSIONS)
+            {
+                fprintf(stderr, "more than %u punctuators of three bytes\n", MAX_EXTENSIONS);
+                exit(1);
+            }
+
+            extensions[++extension_count] = i;
+        }
+    }
+
+    for (i = 0; i < row_count; ++i)
+    {
+        prefix[0] = first[i];
+        prefix[1] = '\0';
+
+        if (find_punctuator(prefix) < 0)
+        {
+            fprintf(stderr, "'%c' starts a punctuator, but isn't one\n", first[i]);
+            exit(1);
+        }
+    }
+
+    /* row 0 is anything which isn't a punctuator, and row 1 is the sentinel,
+     * column 0 is a second byte which doesn't make a longer punctuator */
+    fprintf(out, "#define PUNCTUATOR_COLUMNS %u\n\n", column_count + 1);
+
+    fprintf(out, "static const uint16_t punctuator_row[256] = {\n");
+
+    for (i = 0; i < 256; ++i)
+    {
+        r = index_of(first, row_count, i);
+
+        if (i == 0)
+        {
+            fprintf(out, "    %u,\n", column_count + 1);
+        }
+        else
+        {
+            fprintf(out, "    %u,\n", r < row_count ? (r + 2) * (column_count + 1) : 0);
+        }
+    }
+
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static const uint8_t punctuator_column[256] = {\n");
+
+    for (i = 0; i < 256; ++i)
+    {
+        c = index_of(second, column_count, i);
+
+        fprintf(out, "    %u,\n", c < column_count ? c + 1 : 0);
+    }
+
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static const uint16_t punctuator_table[%u] = {\n", (row_count + 2) * (column_count + 1));
+
+    for (c = 0; c <= column_count; ++c)
+    {
+        write_entry(out, "TOK_UNKNOWN", 1, 0);
+    }
+
+    for (c = 0; c <= column_count; ++c)
+    {
+        write_entry(out, "TOK_EOF", 0, 0);
+    }
+
+    for (r = 0; r < row_count; ++r)
+    {
+        for (c = 0; c <= column_count; ++c)
+        {
+            two[0] = first[r];
+            two[1] = c ? second[c - 1] : '\0';
+
+            extension = 0;
+
+            for (i = 1; i <= extension_count; ++i)
+            {
+                if (c && strncmp(punctuators[extensions[i]].str, two, 2) == 0)
+                {
+                    extension = i;
+                }
+            }
+
+            /* the longest punctuator of the two bytes, or of the first */
+            if (c && (p = find_punctuator(two)) >= 0)
+            {
+                write_entry(out, punctuators[p].type, 2, extension);
+            }
+            else
+            {
+                prefix[0] = first[r];
+                prefix[1] = '\0';
+
+                write_entry(out, punctuators[find_punctuator(prefix)].type, 1, extension);
+            }
+        }
+    }
+
+    fprintf(out, "};\n\n");
+
+    /* the third byte, and the entry it gives */
+    fprintf(out, "static const punctuator_extension_t punctuator_extensions[%u] = {\n",
+            MAX_EXTENSIONS + 1);
+    fprintf(out, "    { 0, 0 },\n");
+
+    for (i = 1; i <= extension_count; ++i)
+    {
+        fprintf(out, "    { '%c', %s | 3 << 8 },\n", punctuators[extensions[i]].str[2],
+                punctuators[extensions[i]].type);
+    }
+
+    for (; i <= MAX_EXTENSIONS; ++i)
+    {
+        fprintf(out, "    { 0, 0 },\n");
+    }
+
+    fprintf(out, "};\n\n");
+}
+
+static void
+write_lexer_tables(FILE *out)
+{
+    write_keywords(out);
+    write_punctuators(out);
+}
+
+
+/* ================================================================================= */
+/* powers of five */
+
+/*
+ * the 128 most significant bits of 5^q, used to convert decimal floats with
+ * the eisel-lemire algorithm, negative powers are rounded up. this covers every
+ * power where a 19 digit mantissa can still end up as a finite, nonzero double
+ */
+#define POW5_MIN_EXP (-342)
+#define POW5_MAX_EXP 308
+
+/* big enough for 2^1720, which is the largest number needed */
+#define BIG_LIMBS 64
+
+typedef struct big
+{
+    uint32_t limbs[BIG_LIMBS];
+
+} big_t;
+
+static void
+big_set_pow2(big_t *big, uint32_t exp)
+{
+    memset(big, 0, sizeof(*big));
+    big->limbs[exp / 32] = 1u << (exp % 32);
+}
+
+static uint32_t
+big_bit_count(const big_t *big)
+{
+    int32_t i;
+
+    for (i = BIG_LIMBS - 1; i >= 0; --i)
+    {
+        if (big->limbs[i])
+        {
+            return i * 32 + 32 - __builtin_clz(big->limbs[i]);
+        }
+    }
+
+    return 0;
+}
+
+static void
+big_mul_small(big_t *big, uint32_t factor)
+{
+    uint64_t carry = 0;
+    uint32_t i;
+
+    for (i = 0; i < BIG_LIMBS; ++i)
+    {
+        carry          = (uint64_t)big->limbs[i] * factor + carry;
+        big->limbs[i]  = (uint32_t)carry;
+        carry        >>= 32;
+    }
+
+    if (carry)
+    {
+        fprintf(stderr, "big number overflow\n");
+        exit(1);
+    }
+}
+
+/* floor division, and floor(floor(a / b) / c) = floor(a / (b * c)) */
+static void
+big_div_small(big_t *big, uint32_t divisor)
+{
+    uint64_t rem = 0;
+    int32_t  i;
+
+    for (i = BIG_LIMBS - 1; i >= 0; --i)
+    {
+        rem            = rem << 32 | big->limbs[i];
+        big->limbs[i]  = (uint32_t)(rem / divisor);
+        rem           %= divisor;
+    }
+}
+
+static void
+big_add_one(big_t *big)
+{
+    uint32_t i;
+
+    for (i = 0; i < BIG_LIMBS && ++big->limbs[i] == 0; ++i)
+    {
+    }
+}
+
+static uint32_t
+big_bit(const big_t *big, int32_t bit)
+{
+    return bit >= 0 ? big->limbs[bit / 32] >> (bit % 32) & 1 : 0;
+}
+
+/* the 128 most significant bits, where the top bit is set, the rest is truncated */
+static void
+big_top_bits(const big_t *big, uint64_t *high, uint64_t *low)
+{
+    int32_t top = big_bit_count(big) - 1;
+    int32_t i;
+
+    *high = 0;
+    *low  = 0;
+
+    for (i = 0; i < 64; ++i)
+    {
+        *high = *high << 1 | big_bit(big, top - i);
+        *low  = *low << 1 | big_bit(big, top - 64 - i);
+    }
+}
+
+static void
+write_powers_of_five(FILE *out)
+{
+    big_t    pow5;
+    big_t    big;
+    uint64_t high;
+    uint64_t low;
+    uint32_t bits;
+    uint32_t i;
+    int32_t  q;
+
+    fprintf(out, "#define POW5_MIN_EXP (%d)\n", POW5_MIN_EXP);
+    fprintf(out, "#define POW5_MAX_EXP %d\n\n", POW5_MAX_EXP);
+
+    fprintf(out, "static const uint64_t pow5_table[2 * (POW5_MAX_EXP - POW5_MIN_EXP + 1)] = {\n");
+
+    for (q = POW5_MIN_EXP; q <= POW5_MAX_EXP; ++q)
+    {
+        memset(&pow5, 0, sizeof(pow5));
+        pow5.limbs[0] = 1;
+
+        for (i = 0; i < (uint32_t)(q < 0 ? -q : q); ++i)
+        {
+            big_mul_small(&pow5, 5);
+        }
+
+        if (q >= 0)
+        {
+            big = pow5;
+        }
+        else
+        {
+            /* 2^b / 5^-q, with enough bits that the result is exact in
+             * the top 128 bits, plus one to round up */
+            bits = big_bit_count(&pow5);
+            big_set_pow2(&big, q >= -27 ? bits + 127 : 2 * bits + 128);
+
+            for (i = 0; i < (uint32_t)-q; ++i)
+            {
+                big_div_small(&big, 5);
+            }
+
+            big_add_one(&big);
+        }
+
+        big_top_bits(&big, &high, &low);
+
+        fprintf(out, "    0x%016llxull, 0x%016llxull, /* 5^%d */\n", (unsigned long long)high,
+                (unsigned long long)low, q);
+    }
+
+    fprintf(out, "};\n\n");
+}
+
+
+/* ================================================================================= */
+
+/* writes a header with include guards, filled in by 'write' */
+static int
+write_header(const char *path, const char *guard, void (*write)(FILE *out))
+{
+    FILE *out = fopen(path, "w");
+
+    if (!out)
+    {
+        fprintf(stderr, "could not open %s\n", path);
+        return 0;
+    }
+
+    fprintf(out, "/* generated by tools/gen_lexer_tables.c, do not edit */\n\n");
+    fprintf(out, "#ifndef %s\n", guard);
+    fprintf(out, "#define %s\n\n", guard);
+
+    write(out);
+
+    fprintf(out, "#endif\n");
+
+    fclose(out);
+
+    return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s <lexer header> <number header>\n", argv[0]);
+        return 1;
+    }
+
+    if (!write_header(argv[1], "_F_LEXER_TABLES_", write_lexer_tables) ||
+        !write_header(argv[2], "_F_NUMBER_TABLES_", write_powers_of_five))
+    {
+        return 1;
+    }
+
+    return 0;
+}